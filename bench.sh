@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Headless boot benchmark for XG OS
+# Builds the ISO with the "bench" kernel command line, boots it in QEMU without
+# a display and turns the "BENCH <name> <value> <unit>" lines the kernel prints
+# on COM1 into a JSON summary on stdout (and in $1, if given).
+# Requirements: everything build_iso.sh needs, plus qemu-system-x86_64
+#
+# Environment:
+#   BENCH_TIMEOUT  seconds before the run is abandoned (default 300)
+#   QEMU_MEM       guest memory (default 512M)
+#   QEMU_ARGS      extra QEMU arguments, e.g. "-accel kvm -cpu host"
+
+OUT_FILE=${1:-}
+LOG_FILE=build/bench.log
+BENCH_TIMEOUT=${BENCH_TIMEOUT:-300}
+QEMU_MEM=${QEMU_MEM:-512M}
+QEMU_ARGS=${QEMU_ARGS:-}
+
+# build output would corrupt the JSON on stdout
+XGOS_CMDLINE=bench bash -E ./build_iso.sh >&2
+
+echo "[*] Booting headless (timeout ${BENCH_TIMEOUT}s)..." >&2
+status=0
+# shellcheck disable=SC2086
+timeout "$BENCH_TIMEOUT" qemu-system-x86_64 -cdrom xgos.iso -m "$QEMU_MEM" \
+  -display none -serial stdio -monitor none -no-reboot \
+  -device isa-debug-exit,iobase=0xf4,iosize=0x04 $QEMU_ARGS \
+  | tr -d '\r' > "$LOG_FILE" || status=$?
+
+# isa-debug-exit turns the kernel's exit code 0 into QEMU status 1
+if [ "$status" -ne 1 ]; then
+  echo "Error: QEMU exited with status $status (124 = timed out); serial log in $LOG_FILE" >&2
+  exit 1
+fi
+if ! grep -q '^BENCH done ' "$LOG_FILE"; then
+  echo "Error: benchmark did not finish; serial log in $LOG_FILE" >&2
+  exit 1
+fi
+
+json=$(awk '
+  BEGIN { printf "{\n  \"results\": {" }
+  $1 == "BENCH" && NF == 4 && $2 != "done" {
+    printf "%s\n    \"%s\": {\"value\": %s, \"unit\": \"%s\"}", sep, $2, $3, $4
+    sep = ","
+  }
+  END { printf "\n  }\n}\n" }
+' "$LOG_FILE")
+
+echo "$json"
+if [ -n "$OUT_FILE" ]; then
+  echo "$json" > "$OUT_FILE"
+  echo "[*] Wrote $OUT_FILE" >&2
+fi
@@ -9,6 +9,8 @@ BUILD_DIR=build/
 ISO_DIR=build/iso_root
 ISO_NAME=xgos.iso
 KERNEL_BIN=kernel
+# extra kernel command line, e.g. XGOS_CMDLINE=bench for the headless benchmark
+XGOS_CMDLINE=${XGOS_CMDLINE:-}
 
 # Clean previous outputs
 rm -rf "$BUILD_DIR" "$ISO_DIR" "$ISO_NAME"
@@ -40,7 +42,7 @@ cp "$BUILD_DIR/$KERNEL_BIN" "$ISO_DIR/boot/$KERNEL_BIN"
 cat > "$ISO_DIR/boot/grub/grub.cfg" << EOF
 set timeout=0
 menuentry "XG OS" {
-  multiboot /boot/$KERNEL_BIN
+  multiboot /boot/$KERNEL_BIN $XGOS_CMDLINE
   boot
 }
 EOF
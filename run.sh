@@ -1,4 +1,16 @@
+# ./run.sh             build and boot in a QEMU window
+# ./run.sh --headless  boot the benchmark build without a display, serial on
+#                      stdout; QEMU exits when the kernel finishes
 rm -rf build/ xgos.iso
+if [ "$1" = "--headless" ]; then
+  XGOS_CMDLINE=bench bash -E ./build_iso.sh || exit 1
+  qemu-system-x86_64 -cdrom xgos.iso -m 512M -display none -serial stdio -no-reboot \
+    -device isa-debug-exit,iobase=0xf4,iosize=0x04
+  # isa-debug-exit reports the kernel's code 0 as status 1
+  status=$?
+  [ $status -eq 1 ] && exit 0
+  exit $status
+fi
 cmake -B build -S . && cmake --build build
 bash -E ./build_iso.sh
-qemu-system-x86_64 -cdrom xgos.iso
\ No newline at end of file
+qemu-system-x86_64 -cdrom xgos.iso
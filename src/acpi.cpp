@@ -0,0 +1,97 @@
+#include "acpi.h"
+#include "console.h"
+#include "paging.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// the boot identity map covers the first 1 GiB; firmware tables above it
+// are identity-mapped on demand
+#define ACPI_IDENTITY_LIMIT 0x40000000ULL
+
+#define BIOS_EBDA_SEGMENT 0x40E
+#define BIOS_ROM_START 0xE0000
+#define BIOS_ROM_END 0x100000
+
+typedef struct __attribute__((packed)) {
+    char signature[8]; // "RSD PTR "
+    uint8_t checksum;  // over the first 20 bytes
+    char oem_id[6];
+    uint8_t revision;  // 0 for ACPI 1.0, 2 and up with an XSDT
+    uint32_t rsdt_addr;
+    uint32_t length;
+    uint64_t xsdt_addr;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} acpi_rsdp_t;
+
+static bool acpi_checksum_ok(const void *p, size_t len) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) sum += ((const uint8_t *) p)[i];
+    return sum == 0;
+}
+
+static bool acpi_sig_is(const char *a, const char *b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+// make [phys, phys + len) readable through its identity address
+static const void *acpi_map(uint64_t phys, uint64_t len) {
+    if (phys + len > ACPI_IDENTITY_LIMIT) {
+        uint64_t start = phys & ~4095ULL;
+        uint64_t end = (phys + len + 4095) & ~4095ULL;
+        if (paging_map_range(start, start, end - start, PAGE_PRESENT, PAGE_MEM_WB) != 0) return nullptr;
+    }
+    return (const void *) (uintptr_t) phys;
+}
+
+// map a table, first its header and then its full length
+static const acpi_sdt_header_t *acpi_map_table(uint64_t phys) {
+    const acpi_sdt_header_t *hdr = (const acpi_sdt_header_t *) acpi_map(phys, sizeof(acpi_sdt_header_t));
+    if (!hdr || hdr->length < sizeof(acpi_sdt_header_t)) return nullptr;
+    if (!acpi_map(phys, hdr->length) || !acpi_checksum_ok(hdr, hdr->length)) return nullptr;
+    return hdr;
+}
+
+static const acpi_rsdp_t *acpi_scan_rsdp(uintptr_t start, uintptr_t end) {
+    for (uintptr_t p = start; p + sizeof(acpi_rsdp_t) <= end; p += 16) {
+        const acpi_rsdp_t *rsdp = (const acpi_rsdp_t *) p;
+        if (acpi_sig_is(rsdp->signature, "RSD PTR ", 8) && acpi_checksum_ok(rsdp, 20)) return rsdp;
+    }
+    return nullptr;
+}
+
+static const acpi_rsdp_t *acpi_find_rsdp(void) {
+    // first KiB of the EBDA, then the BIOS ROM area. the BDA pointer is hidden
+    // from the compiler, which takes accesses to page zero for null derefs
+    const volatile uint16_t *bda_ebda = (const volatile uint16_t *) BIOS_EBDA_SEGMENT;
+    asm("" : "+r"(bda_ebda));
+    uintptr_t ebda = (uintptr_t) *bda_ebda << 4;
+    const acpi_rsdp_t *rsdp = ebda ? acpi_scan_rsdp(ebda, ebda + 1024) : nullptr;
+    return rsdp ? rsdp : acpi_scan_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+}
+
+const acpi_sdt_header_t *acpi_find_table(const char *signature) {
+    const acpi_rsdp_t *rsdp = acpi_find_rsdp();
+    if (!rsdp) return nullptr;
+
+    // prefer the XSDT's 64-bit entries
+    bool xsdt = rsdp->revision >= 2 && rsdp->xsdt_addr;
+    const acpi_sdt_header_t *root = acpi_map_table(xsdt ? rsdp->xsdt_addr : rsdp->rsdt_addr);
+    if (!root) {
+        kprintf("acpi: %s checksum failed\n", xsdt ? "XSDT" : "RSDT");
+        return nullptr;
+    }
+
+    size_t entry_size = xsdt ? 8 : 4;
+    size_t count = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    const uint8_t *entries = (const uint8_t *) (root + 1);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t phys = xsdt ? *(const uint64_t *) (entries + i * 8) : *(const uint32_t *) (entries + i * 4);
+        const acpi_sdt_header_t *hdr = acpi_map_table(phys);
+        if (hdr && acpi_sig_is(hdr->signature, signature, 4)) return hdr;
+    }
+    return nullptr;
+}
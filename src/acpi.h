@@ -0,0 +1,33 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// common header of every ACPI system description table
+typedef struct __attribute__((packed)) {
+    char signature[4];
+    uint32_t length; // including this header
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} acpi_sdt_header_t;
+
+// find the table with the given 4-character signature through the RSDP in
+// the BIOS areas and the RSDT/XSDT. needs paging_init(); tables outside the
+// boot identity map are identity-mapped on the way. returns nullptr if there
+// is no ACPI or no valid table of that kind
+const acpi_sdt_header_t *acpi_find_table(const char *signature);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ACPI_H
@@ -0,0 +1,237 @@
+#include "bench.h"
+#include "boot_trace.h"
+#include "console.h"
+#include "cpu.h"
+#include "graphics.h"
+#include "io.h"
+#include "kstring.h"
+#include "memory.h"
+#include "time.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define BENCH_BATCH 1024
+
+// port of QEMU's -device isa-debug-exit,iobase=0xf4,iosize=0x04
+#define QEMU_EXIT_PORT 0xF4
+
+static uint64_t tsc_hz = 0;
+
+static void bench_report(const char *name, uint64_t value, const char *unit) {
+    kprintf("BENCH %s %lu %s\n", name, value, unit);
+}
+
+static uint64_t cycles_to_us(uint64_t cycles) {
+    return cycles * 1000 / (tsc_hz / 1000);
+}
+
+// ops per second given the TSC cycles they took
+static uint64_t per_sec(uint64_t ops, uint64_t cycles) {
+    return cycles ? (uint64_t) ((unsigned __int128) ops * tsc_hz / cycles) : 0;
+}
+
+// duration of each boot phase, and the whole boot up to the suite
+static void bench_phases(void) {
+    const boot_trace_phase_t *phases;
+    uint32_t count = boot_trace_phases(&phases);
+    for (uint32_t i = 0; i < count; i++) {
+        kprintf("BENCH phase.%s %lu us\n", phases[i].name, cycles_to_us(phases[i].end_tsc - phases[i].start_tsc));
+    }
+    kprintf("BENCH boot.total %lu us\n", cycles_to_us(cpu_rdtsc() - boot_tsc_start));
+}
+
+static uint64_t frames[BENCH_BATCH];
+static void *objs[BENCH_BATCH];
+
+// each round allocates count blocks then frees them; both count as
+// operations. failed allocations are not counted
+static void bench_frames(const char *name, unsigned int order, uint32_t count, uint32_t rounds) {
+    uint64_t cycles = 0;
+    uint64_t ops = 0;
+    if (count > BENCH_BATCH) count = BENCH_BATCH;
+    for (uint32_t r = 0; r < rounds; r++) {
+        uint64_t t0 = cpu_rdtsc();
+        for (uint32_t i = 0; i < count; i++) frames[i] = order ? frames_alloc(order) : frame_alloc();
+        for (uint32_t i = 0; i < count; i++) {
+            if (!frames[i]) continue;
+            if (order) frames_free(frames[i], order);
+            else frame_free(frames[i]);
+            ops += 2;
+        }
+        cycles += cpu_rdtsc() - t0;
+    }
+    bench_report(name, per_sec(ops, cycles), "ops/s");
+}
+
+static void bench_heap(const char *name, size_t size, uint32_t count, uint32_t rounds) {
+    uint64_t cycles = 0;
+    if (count > BENCH_BATCH) count = BENCH_BATCH;
+    for (uint32_t r = 0; r < rounds; r++) {
+        uint64_t t0 = cpu_rdtsc();
+        for (uint32_t i = 0; i < count; i++) objs[i] = kmalloc(size);
+        for (uint32_t i = 0; i < count; i++) kfree(objs[i]);
+        cycles += cpu_rdtsc() - t0;
+    }
+    bench_report(name, per_sec(2ULL * count * rounds, cycles), "ops/s");
+}
+
+// fill w x h rects across the back buffer, clamped to its size
+static void bench_fill(const char *name, uint32_t w, uint32_t h, uint32_t reps) {
+    graphics_context_t *ctx = graphics_get_context();
+    if (w > ctx->width) w = ctx->width;
+    if (h > ctx->height) h = ctx->height;
+
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint64_t t0 = cpu_rdtsc();
+    for (uint32_t i = 0; i < reps; i++) {
+        graphics_fill_rect(x, y, w, h, (i & 1) ? COLOR_BLUE : COLOR_RED);
+        x = (x + 97) % (ctx->width - w + 1);
+        y = (y + 61) % (ctx->height - h + 1);
+    }
+    uint64_t cycles = cpu_rdtsc() - t0;
+    bench_report(name, per_sec((uint64_t) w * h * 4 * reps, cycles) >> 20, "MB/s");
+}
+
+// draw lines of text down the back buffer
+static void bench_text(uint32_t reps) {
+    graphics_context_t *ctx = graphics_get_context();
+    char line[81];
+    for (int i = 0; i < 80; i++) line[i] = (char) ('!' + i);
+    line[80] = 0;
+
+    uint32_t y = 0;
+    uint64_t t0 = cpu_rdtsc();
+    for (uint32_t i = 0; i < reps; i++) {
+        graphics_draw_string(0, y, line, COLOR_WHITE, COLOR_BLACK);
+        y = y + 16 < ctx->height ? y + 8 : 0;
+    }
+    uint64_t cycles = cpu_rdtsc() - t0;
+    bench_report("gfx.text_80", per_sec(80ULL * reps, cycles), "chars/s");
+}
+
+// filled circles of radius r across the back buffer
+static void bench_circle(const char *name, uint32_t r, uint32_t reps) {
+    graphics_context_t *ctx = graphics_get_context();
+    if (2 * r + 1 > ctx->width || 2 * r + 1 > ctx->height) return;
+
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint64_t t0 = cpu_rdtsc();
+    for (uint32_t i = 0; i < reps; i++) {
+        graphics_fill_circle(x + r, y + r, r, (i & 1) ? COLOR_GREEN : COLOR_YELLOW);
+        x = (x + 97) % (ctx->width - 2 * r);
+        y = (y + 61) % (ctx->height - 2 * r);
+    }
+    uint64_t cycles = cpu_rdtsc() - t0;
+    bench_report(name, per_sec(reps, cycles), "circles/s");
+}
+
+// lines corner to corner, with their ends well off screen
+static void bench_line(uint32_t reps) {
+    graphics_context_t *ctx = graphics_get_context();
+    int32_t w = (int32_t) ctx->width, h = (int32_t) ctx->height;
+
+    uint64_t t0 = cpu_rdtsc();
+    for (uint32_t i = 0; i < reps; i++) {
+        int32_t shift = (int32_t) (i % 64) * 4;
+        graphics_draw_line(-w, shift - h, 2 * w, 2 * h - shift, (i & 1) ? COLOR_WHITE : COLOR_CYAN);
+    }
+    uint64_t cycles = cpu_rdtsc() - t0;
+    bench_report("gfx.line_clipped", per_sec(reps, cycles), "lines/s");
+}
+
+// blit a 64x64 sprite across the back buffer in each mode
+static void bench_blit(uint32_t reps) {
+    graphics_context_t *ctx = graphics_get_context();
+    surface_t *sprite = surface_create(64, 64);
+    if (!sprite || ctx->width < 64 || ctx->height < 64) {
+        surface_destroy(sprite);
+        return;
+    }
+    // translucent everywhere but a keyed-out border
+    for (uint32_t y = 0; y < 64; y++) {
+        for (uint32_t x = 0; x < 64; x++) {
+            color_t c = {(uint8_t) (x * 4), (uint8_t) (y * 4), 0x80, (uint8_t) (x * 4 + 3)};
+            bool border = x < 4 || y < 4 || x >= 60 || y >= 60;
+            sprite->pixels[y * 64 + x] = border ? 0 : graphics_color_to_premultiplied(c);
+        }
+    }
+
+    static const struct {
+        const char *name;
+        graphics_blit_mode_t mode;
+    } modes[] = {
+        {"gfx.blit_copy_64", GRAPHICS_BLIT_COPY},
+        {"gfx.blit_key_64", GRAPHICS_BLIT_COLOR_KEY},
+        {"gfx.blit_alpha_64", GRAPHICS_BLIT_ALPHA},
+    };
+    for (const auto &m : modes) {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint64_t t0 = cpu_rdtsc();
+        for (uint32_t i = 0; i < reps; i++) {
+            graphics_blit(graphics_screen(), (int32_t) x, (int32_t) y, sprite, nullptr, m.mode);
+            x = (x + 97) % (ctx->width - 63);
+            y = (y + 61) % (ctx->height - 63);
+        }
+        uint64_t cycles = cpu_rdtsc() - t0;
+        bench_report(m.name, per_sec(64ULL * 64 * reps, cycles) / 1000000, "Mpix/s");
+    }
+    surface_destroy(sprite);
+}
+
+// copy whole frames from the back buffer to VRAM
+static void bench_swap(uint32_t reps) {
+    graphics_context_t *ctx = graphics_get_context();
+    uint64_t t0 = cpu_rdtsc();
+    for (uint32_t i = 0; i < reps; i++) {
+        graphics_mark_dirty(0, 0, ctx->width, ctx->height);
+        graphics_swap_buffers();
+    }
+    uint64_t cycles = cpu_rdtsc() - t0;
+    uint64_t bytes = (uint64_t) ctx->width * ctx->height * ctx->format.bytes * reps;
+    bench_report("gfx.swap_full", per_sec(bytes, cycles) >> 20, "MB/s");
+}
+
+void bench_run_and_exit(void) {
+    tsc_hz = time_tsc_hz();
+    kprintf("BENCH tsc_hz %lu Hz\n", tsc_hz);
+    kprintf("BENCH tsc_invariant %u bool\n", time_tsc_invariant() ? 1 : 0);
+
+    bench_phases();
+
+    bench_frames("frame.alloc_free", 0, BENCH_BATCH, 256);
+    bench_frames("frame.alloc_free_2m", FRAME_ORDER_2M, 16, 64);
+    bench_heap("heap.kmalloc_64", 64, BENCH_BATCH, 256);
+    bench_heap("heap.kmalloc_1k", 1024, BENCH_BATCH, 64);
+    bench_heap("heap.kmalloc_16k", 16384, 256, 64);
+
+    if (graphics_get_context()) {
+        bench_fill("gfx.fill_16", 16, 16, 20000);
+        bench_fill("gfx.fill_64", 64, 64, 4000);
+        bench_fill("gfx.fill_256", 256, 256, 400);
+        bench_fill("gfx.fill_full", 0xFFFFFFFF, 0xFFFFFFFF, 40);
+        bench_text(5000);
+        bench_circle("gfx.circle_8", 8, 20000);
+        bench_circle("gfx.circle_64", 64, 2000);
+        bench_circle("gfx.circle_256", 256, 200);
+        bench_line(2000);
+        bench_blit(4000);
+        bench_swap(20);
+    } else {
+        kprintf("BENCH gfx.available 0 bool\n");
+    }
+
+    kprintf("BENCH done 1 bool\n");
+    console_flush();
+    qemu_exit(0);
+    // not under QEMU
+    for (;;) {
+        asm volatile("cli; hlt");
+    }
+}
+
+void qemu_exit(uint8_t code) {
+    outb(QEMU_EXIT_PORT, code);
+}
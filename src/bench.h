@@ -0,0 +1,27 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// headless benchmark mode, selected with "bench" on the kernel command line.
+// results go to the console (and so the serial port) as one line each:
+//   BENCH <name> <value> <unit>
+// which bench.sh turns into JSON
+
+// run the benchmark suite (after time_init()), print the results and power off QEMU through
+// its isa-debug-exit device. falls back to halting on real hardware
+[[noreturn]] void bench_run_and_exit(void);
+
+// leave QEMU with exit status (code << 1) | 1, if the isa-debug-exit device
+// is present at port 0xF4; returns otherwise
+void qemu_exit(uint8_t code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BENCH_H
@@ -17,6 +17,7 @@ section .text
     dd 768                          ; height
     dd 32                           ; depth
     global _start
+    global boot_tsc_start
     extern kernel_main
     extern init_global_ctors
 
@@ -27,6 +28,11 @@ _start:
     ; save multiboot info
     mov [multiboot_magic], eax
     mov [multiboot_info], ebx
+
+    ; time zero for the boot tracer
+    rdtsc
+    mov [boot_tsc_start], eax
+    mov [boot_tsc_start + 4], edx
     
     ; Note: VESA setup must be done before entering protected mode
     ; Since we're already in protected mode from GRUB, we'll handle
@@ -170,13 +176,13 @@ long_mode_start:
     ; set up stack pointer for 64-bit mode
     mov rsp, stack_top
     
+    ; call global constructors (may clobber rdi/rsi, so before loading them)
+    call init_global_ctors
+    
     ; load multiboot parameters for kernel_main
     mov rdi, [multiboot_magic]  ; first argument (magic)
     mov rsi, [multiboot_info]   ; second argument (mbi_addr)
     
-    ; call global constructors
-    call init_global_ctors
-    
     ; jump to kernel main with parameters in rdi, rsi (System V ABI)
     call kernel_main
     
@@ -209,6 +215,9 @@ multiboot_magic:
     dd 0
 multiboot_info:
     dd 0
+    align 8
+boot_tsc_start:
+    dq 0
 
 section .rodata
 gdt64:
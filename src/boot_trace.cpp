@@ -0,0 +1,61 @@
+#include "boot_trace.h"
+#include "console.h"
+#include "cpu.h"
+#include "time.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define BOOT_TRACE_MAX 32
+
+static boot_trace_phase_t phases[BOOT_TRACE_MAX];
+static uint32_t phase_count = 0;
+// end of the last phase, kept even when the table is full
+static uint64_t last_tsc = 0;
+
+void boot_trace(const char *name) {
+    uint64_t now = cpu_rdtsc();
+    uint64_t start = last_tsc ? last_tsc : boot_tsc_start;
+    if (phase_count < BOOT_TRACE_MAX) phases[phase_count++] = {name, start, now};
+    last_tsc = now;
+}
+
+uint32_t boot_trace_phases(const boot_trace_phase_t **out) {
+    *out = phases;
+    return phase_count;
+}
+
+void boot_trace_dump(void) {
+    if (!phase_count) return;
+
+    // longest first; insertion sort over a few dozen entries
+    uint32_t order[BOOT_TRACE_MAX];
+    for (uint32_t i = 0; i < phase_count; i++) {
+        uint64_t len = phases[i].end_tsc - phases[i].start_tsc;
+        uint32_t j = i;
+        while (j && phases[order[j - 1]].end_tsc - phases[order[j - 1]].start_tsc < len) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    uint64_t hz = time_tsc_hz();
+    uint64_t total = phases[phase_count - 1].end_tsc - phases[0].start_tsc;
+    if (hz)
+        kprintf("boot trace: %u phases, %lu cycles (%lu us) since _start\n", phase_count, total,
+                total / (hz / 1000000));
+    else kprintf("boot trace: %u phases, %lu cycles since _start\n", phase_count, total);
+    kprintf("  phase                             cycles        us      %%\n");
+
+    for (uint32_t i = 0; i < phase_count; i++) {
+        const boot_trace_phase_t *p = &phases[order[i]];
+        uint64_t cycles = p->end_tsc - p->start_tsc;
+        // percent with one decimal
+        uint64_t permille = total ? cycles * 1000 / total : 0;
+        // one message per row, so the log keeps rows whole
+        if (hz)
+            kprintf("  %-28s%12lu%10lu%5lu.%lu\n", p->name, cycles, cycles / (hz / 1000000), permille / 10,
+                    permille % 10);
+        else kprintf("  %-28s%12lu%10s%5lu.%lu\n", p->name, cycles, "-", permille / 10, permille % 10);
+    }
+}
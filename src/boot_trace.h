@@ -0,0 +1,37 @@
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// boot timeline: each boot_trace() call ends a phase that started at the
+// previous call, or at _start for the first one. phases are flat, so
+// sub-phases (memory_init.*) take the place of their parent
+
+typedef struct {
+    const char *name;
+    uint64_t start_tsc;
+    uint64_t end_tsc;
+} boot_trace_phase_t;
+
+// TSC at _start, stored by boot.asm
+extern uint64_t boot_tsc_start;
+
+// end the current phase, naming it; name must be a string literal
+void boot_trace(const char *name);
+
+// recorded phases in boot order; returns how many
+uint32_t boot_trace_phases(const boot_trace_phase_t **phases);
+
+// print all phases, longest first, in cycles and (once time_init() has run)
+// microseconds
+void boot_trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOT_TRACE_H
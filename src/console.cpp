@@ -1,4 +1,8 @@
 #include "console.h"
+#include "io.h"
+#include "kformat.h"
+#include "klog.h"
+#include "kstring.h"
 #include <stdarg.h>
 #include <stdint.h>
 
@@ -8,16 +12,6 @@ static volatile uint16_t *const VGA_BUFFER = (volatile uint16_t *) 0xB8000;
 static size_t cursor_row = 0;
 static size_t cursor_col = 0;
 
-static inline void outb(uint16_t port, uint8_t value) {
-    asm volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
-}
-
-static inline uint8_t inb(uint16_t port) {
-    uint8_t ret;
-    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
-}
-
 static uint8_t current_color = (uint8_t) (0x07);
 
 static void update_cursor(void) {
@@ -28,7 +22,7 @@ static void update_cursor(void) {
     outb(0x3D5, (uint8_t) (pos & 0xFF));
 }
 
-void kputc(char c) {
+static void vga_putc(char c) {
     if (c == '\n') {
         cursor_col = 0;
         cursor_row++;
@@ -42,147 +36,90 @@ void kputc(char c) {
         }
     }
     if (cursor_row >= VGA_HEIGHT) {
-        for (size_t y = 1; y < VGA_HEIGHT; ++y) {
-            for (size_t x = 0; x < VGA_WIDTH; ++x) {
-                VGA_BUFFER[(y - 1) * VGA_WIDTH + x] = VGA_BUFFER[y * VGA_WIDTH + x];
-            }
-        }
+        kmemmove((void *) VGA_BUFFER, (const void *) (VGA_BUFFER + VGA_WIDTH),
+                 (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16_t));
         for (size_t x = 0; x < VGA_WIDTH; ++x) {
             VGA_BUFFER[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = (uint16_t) ' ' | (uint16_t) (current_color << 8);
         }
         cursor_row = VGA_HEIGHT - 1;
     }
+}
+
+// the hardware cursor costs four port writes, so it moves once per write
+static void vga_write(const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) vga_putc(s[i]);
     update_cursor();
 }
 
+static console_sink_t vga_sink = {"vga", vga_write, nullptr, nullptr};
+static console_sink_t *console_sinks = &vga_sink;
+
+void console_register_sink(console_sink_t *sink) {
+    console_sink_t **link = &console_sinks;
+    while (*link) {
+        if (*link == sink) return;
+        link = &(*link)->next;
+    }
+    sink->next = nullptr;
+    *link = sink;
+}
+
+void console_write(const char *s, size_t len) {
+    if (!len) return;
+    for (console_sink_t *sink = console_sinks; sink; sink = sink->next) sink->write(s, len);
+}
+
+void console_flush(void) {
+    klog_render();
+    for (console_sink_t *sink = console_sinks; sink; sink = sink->next) {
+        if (sink->flush) sink->flush();
+    }
+}
+
+void kputc(char c) {
+    klog_write(KLOG_INFO, &c, 1);
+    klog_render();
+}
+
+// messages up to this long reach the log as one write; longer ones are
+// appended in pieces of this size
+#define KPRINTF_CHUNK 256
+
+static void kprintf_flush(kformat_out_t *out) {
+    klog_write(*(klog_level_t *) out->ctx, out->buf, out->len);
+    out->len = 0;
+}
+
+static void kvprintf(klog_level_t level, const char *format, va_list args) {
+    char buf[KPRINTF_CHUNK];
+    kformat_out_t out = {buf, sizeof(buf), 0, kprintf_flush, &level};
+    kformat(&out, format, args);
+    kprintf_flush(&out);
+    // messages the console does not show stop at the ring
+    if (level <= klog_console_level()) klog_render();
+}
+
 void kprintf(const char *format, ...) {
     va_list args;
     va_start(args, format);
-    for (const char *p = format; *p; ++p) {
-        if (*p == '%') {
-            ++p;
-            switch (*p) {
-                case '%': kputc('%');
-                    break;
-                case 'c': kputc((char) va_arg(args, int));
-                    break;
-                case 's': {
-                    const char *s = va_arg(args, const char*);
-                    while (*s) kputc(*s++);
-                }
-                break;
-                case 'd':
-                case 'i': {
-                    int num = va_arg(args, int);
-                    if (num < 0) {
-                        kputc('-');
-                        num = -num;
-                    }
-                    char buf[12];
-                    int len = 0;
-                    unsigned int v = (unsigned int) num;
-                    do {
-                        buf[len++] = '0' + (v % 10);
-                        v /= 10;
-                    } while (v);
-                    while (len--) kputc(buf[len]);
-                }
-                break;
-                case 'u': {
-                    unsigned int v = va_arg(args, unsigned int);
-                    char buf[11];
-                    int len = 0;
-                    do {
-                        buf[len++] = '0' + (v % 10);
-                        v /= 10;
-                    } while (v);
-                    while (len--) kputc(buf[len]);
-                }
-                break;
-                case 'x':
-                case 'X': {
-                    unsigned int v = va_arg(args, unsigned int);
-                    char buf[9];
-                    int len = 0;
-                    const char *digits = (*p == 'x') ? "0123456789abcdef" : "0123456789ABCDEF";
-                    do {
-                        buf[len++] = digits[v % 16];
-                        v /= 16;
-                    } while (v);
-                    while (len--) kputc(buf[len]);
-                }
-                break;
-                case 'l': {
-                    ++p; // consume the 'l'
-                    switch (*p) {
-                        case 'u': {
-                            unsigned long v = va_arg(args, unsigned long);
-                            char buf[21];
-                            int len = 0;
-                            do {
-                                buf[len++] = '0' + (v % 10);
-                                v /= 10;
-                            } while (v);
-                            while (len--) kputc(buf[len]);
-                        }
-                        break;
-                        case 'x': {
-                            unsigned long v = va_arg(args, unsigned long);
-                            char buf[17];
-                            int len = 0;
-                            const char *digits = "0123456789abcdef";
-                            do {
-                                buf[len++] = digits[v % 16];
-                                v /= 16;
-                            } while (v);
-                            while (len--) kputc(buf[len]);
-                        }
-                        break;
-                        case 'd': {
-                            long num = va_arg(args, long);
-                            if (num < 0) {
-                                kputc('-');
-                                num = -num;
-                            }
-                            char buf[21];
-                            int len = 0;
-                            unsigned long v = (unsigned long) num;
-                            do {
-                                buf[len++] = '0' + (v % 10);
-                                v /= 10;
-                            } while (v);
-                            while (len--) kputc(buf[len]);
-                        }
-                        break;
-                        default:
-                            kputc('%');
-                            kputc('l');
-                            kputc(*p);
-                            break;
-                    }
-                }
-                break;
-                case 'p': {
-                    unsigned long ptr = va_arg(args, unsigned long);
-                    kprintf("0x%lx", ptr);
-                }
-                break;
-                default:
-                    kputc('%');
-                    kputc(*p);
-                    break;
-            }
-        } else {
-            kputc(*p);
-        }
-    }
+    kvprintf(KLOG_INFO, format, args);
+    va_end(args);
+}
+
+void klog(klog_level_t level, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    kvprintf(level, format, args);
     va_end(args);
 }
 
-// panic message and halt
+// panic message, log dump and halt
 void panic(const char *msg) {
     kprintf("PANIC: %s\n", msg);
+    klog_dump();
+    console_flush();
     for (;;) {
+        asm volatile("cli; hlt");
     }
 }
 
@@ -8,11 +8,34 @@
 extern "C" {
 #endif
 
+// an output device for kernel messages. kprintf appends to the kernel log
+// (klog.h) and the sinks get whole log slots rendered from it, so a sink
+// pays its per-call costs (cursor updates, port writes, locking) once per
+// chunk instead of per character
+typedef struct console_sink {
+    const char *name;
+    void (*write)(const char *s, size_t len);
+    void (*flush)(void); // push out anything buffered; may be nullptr
+    struct console_sink *next;
+} console_sink_t;
+
+// add a sink; it receives all output from then on. the VGA text console is
+// always the first
+void console_register_sink(console_sink_t *sink);
+
+// send len bytes to every sink
+void console_write(const char *s, size_t len);
+
+// render pending log messages and make every sink push out buffered
+// output, e.g. before halting
+void console_flush(void);
+
 void kputc(char c);
 
-void kprintf(const char *format, ...);
+// klog(KLOG_INFO, ...); conversions as in kformat.h
+void kprintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
 
-// panic message and halt
+// panic message, dump of the kernel log and halt
 void panic(const char *msg);
 
 typedef enum {
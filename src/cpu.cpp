@@ -0,0 +1,143 @@
+#include "cpu.h"
+#include "console.h"
+#include <stdint.h>
+
+cpu_features_t g_cpu_features;
+
+#define CR0_MP (1ULL << 1)
+#define CR0_EM (1ULL << 2)
+#define CR0_TS (1ULL << 3)
+#define CR0_NE (1ULL << 5)
+#define CR4_OSFXSR (1ULL << 9)
+#define CR4_OSXMMEXCPT (1ULL << 10)
+#define CR4_OSXSAVE (1ULL << 18)
+
+#define XCR0_X87 (1ULL << 0)
+#define XCR0_SSE (1ULL << 1)
+#define XCR0_AVX (1ULL << 2)
+
+// save area for the outermost kernel_fpu_begin(). 4 KiB holds the legacy
+// area, the xsave header and the AVX upper halves with plenty to spare
+#define FPU_SAVE_SIZE 4096
+
+alignas(64) static uint8_t fpu_save_area[FPU_SAVE_SIZE];
+static uint32_t fpu_depth = 0;
+static uint64_t fpu_saved_flags = 0;
+static uint64_t fpu_xcr0 = 0;
+
+static inline uint64_t read_cr0(void) {
+    uint64_t value;
+    asm volatile("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(uint64_t value) {
+    asm volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t value;
+    asm volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint64_t value) {
+    asm volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+static inline void xsetbv(uint32_t reg, uint64_t value) {
+    asm volatile("xsetbv" : : "c"(reg), "a"((uint32_t) value), "d"((uint32_t) (value >> 32)));
+}
+
+void cpu_init(void) {
+    uint32_t regs[4];
+    cpu_cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+
+    cpu_cpuid(1, 0, regs);
+    uint32_t ecx1 = regs[2];
+    uint32_t edx1 = regs[3];
+    uint32_t ebx7 = 0;
+    uint32_t edx7 = 0;
+    if (max_leaf >= 7) {
+        cpu_cpuid(7, 0, regs);
+        ebx7 = regs[1];
+        edx7 = regs[3];
+    }
+
+    g_cpu_features.erms = ebx7 & (1u << 9);
+    g_cpu_features.fsrm = edx7 & (1u << 4);
+
+    // x87 and SSE: no emulation, native error reporting, fxsave/fxrstor and
+    // unmasked SIMD exceptions raise #XM instead of #UD
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+    asm volatile("fninit");
+    if (!(edx1 & (1u << 24)) || !(edx1 & (1u << 25))) {
+        kprintf("cpu_init: no FXSR/SSE, SIMD code disabled\n");
+        g_cpu_features.fpu_state_size = 512;
+        return;
+    }
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    g_cpu_features.sse2 = edx1 & (1u << 26);
+    g_cpu_features.sse41 = ecx1 & (1u << 19);
+    g_cpu_features.fpu_state_size = 512;
+
+    // AVX needs xsave so the OS can declare the YMM state in XCR0
+    if ((ecx1 & (1u << 26)) && max_leaf >= 0xD) {
+        write_cr4(read_cr4() | CR4_OSXSAVE);
+        fpu_xcr0 = XCR0_X87 | XCR0_SSE;
+        if (ecx1 & (1u << 28)) fpu_xcr0 |= XCR0_AVX;
+        xsetbv(0, fpu_xcr0);
+
+        // ebx: save area size for the features enabled in XCR0
+        cpu_cpuid(0xD, 0, regs);
+        if (regs[1] <= FPU_SAVE_SIZE) {
+            g_cpu_features.xsave = true;
+            g_cpu_features.fpu_state_size = regs[1];
+            g_cpu_features.avx = fpu_xcr0 & XCR0_AVX;
+            g_cpu_features.avx2 = g_cpu_features.avx && (ebx7 & (1u << 5));
+        } else {
+            // should not happen with only x87/SSE/AVX enabled
+            fpu_xcr0 = XCR0_X87 | XCR0_SSE;
+            xsetbv(0, fpu_xcr0);
+        }
+    }
+
+    kprintf("cpu_init:%s%s%s%s%s%s, FPU state %u bytes (%s)\n",
+            g_cpu_features.sse2 ? " SSE2" : "", g_cpu_features.sse41 ? " SSE4.1" : "",
+            g_cpu_features.avx ? " AVX" : "", g_cpu_features.avx2 ? " AVX2" : "",
+            g_cpu_features.erms ? " ERMS" : "", g_cpu_features.fsrm ? " FSRM" : "",
+            g_cpu_features.fpu_state_size, g_cpu_features.xsave ? "xsave" : "fxsave");
+}
+
+void kernel_fpu_begin(void) {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    if (fpu_depth++) return;
+
+    fpu_saved_flags = flags;
+    if (g_cpu_features.xsave) {
+        asm volatile("xsave64 (%0)"
+            : : "r"(fpu_save_area), "a"((uint32_t) fpu_xcr0), "d"((uint32_t) (fpu_xcr0 >> 32))
+            : "memory");
+    } else {
+        asm volatile("fxsave64 (%0)" : : "r"(fpu_save_area) : "memory");
+    }
+}
+
+void kernel_fpu_end(void) {
+    if (!fpu_depth) {
+        panic("kernel_fpu_end: not in an FPU section");
+    }
+    if (--fpu_depth) return;
+
+    if (g_cpu_features.xsave) {
+        asm volatile("xrstor64 (%0)"
+            : : "r"(fpu_save_area), "a"((uint32_t) fpu_xcr0), "d"((uint32_t) (fpu_xcr0 >> 32))
+            : "memory");
+    } else {
+        asm volatile("fxrstor64 (%0)" : : "r"(fpu_save_area) : "memory");
+    }
+    // interrupts come back only if they were on at the outermost begin
+    if (fpu_saved_flags & (1ULL << 9)) asm volatile("sti" : : : "memory");
+}
@@ -0,0 +1,101 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CPU features detected by cpu_init(). SIMD flags are only set when the
+// matching register state is also enabled, so they can gate code directly
+typedef struct {
+    bool sse2;
+    bool sse41;
+    bool avx;
+    bool avx2;
+    bool xsave; // state saved with xsave instead of fxsave
+    bool erms; // enhanced rep movsb/stosb
+    bool fsrm; // fast short rep movsb
+    uint32_t fpu_state_size; // bytes saved by kernel_fpu_begin()
+} cpu_features_t;
+
+extern cpu_features_t g_cpu_features;
+
+// detect CPU features and enable x87/SSE/AVX state (CR0, CR4, XCR0)
+void cpu_init(void);
+
+// bracket kernel code that touches x87/SSE/AVX registers. the outermost
+// call saves the register state and disables interrupts until the matching
+// kernel_fpu_end(); nested calls only count
+void kernel_fpu_begin(void);
+
+void kernel_fpu_end(void);
+
+// disable interrupts, returning RFLAGS for cpu_irq_restore()
+static inline uint64_t cpu_irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+// re-enable interrupts if they were on at the matching cpu_irq_save()
+static inline void cpu_irq_restore(uint64_t flags) {
+    if (flags & (1ULL << 9)) asm volatile("sti" : : : "memory");
+}
+
+// read the time-stamp counter
+static inline uint64_t cpu_rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+// read a model-specific register
+static inline uint64_t cpu_rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+// write a model-specific register
+static inline void cpu_wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t) value), "d"((uint32_t) (value >> 32)) : "memory");
+}
+
+// execute CPUID for leaf/subleaf; regs receives eax, ebx, ecx, edx
+static inline void cpu_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+    asm volatile("cpuid"
+        : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+        : "a"(leaf), "c"(subleaf));
+}
+
+// highest supported extended CPUID leaf
+static inline uint32_t cpu_cpuid_max_ext(void) {
+    uint32_t regs[4];
+    cpu_cpuid(0x80000000, 0, regs);
+    return regs[0];
+}
+
+// TSC frequency in Hz from CPUID leaves 0x15/0x16, 0 if the CPU does not
+// report it
+static inline uint64_t cpu_tsc_hz(void) {
+    uint32_t regs[4];
+    cpu_cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+    if (max_leaf >= 0x15) {
+        cpu_cpuid(0x15, 0, regs);
+        if (regs[0] && regs[1] && regs[2]) return (uint64_t) regs[2] * regs[1] / regs[0];
+    }
+    if (max_leaf >= 0x16) {
+        cpu_cpuid(0x16, 0, regs);
+        if (regs[0] & 0xFFFF) return (uint64_t) (regs[0] & 0xFFFF) * 1000000;
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CPU_H
@@ -0,0 +1,173 @@
+#include "fbcon.h"
+#include "console.h"
+#include "graphics.h"
+#include "memory.h"
+#include "span.h"
+#include "time.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define GLYPH_COUNT 95 // printable ASCII, as in the built-in font
+
+static struct {
+    bool active;
+    uint32_t cols, rows; // text cells
+    uint32_t stride; // pixels per text buffer scanline, cols * 8
+    uint32_t *text; // rows * 8 scanlines; screen row r is ring row (origin + r) % rows
+    unsigned int text_order; // frames_alloc() order of text
+    uint32_t origin;
+    uint32_t col, row; // cursor
+    uint32_t bg;
+    // screen rows changed since the last present, first > last when none
+    uint32_t dirty_first, dirty_last;
+    bool scrolled; // everything moved: the next present copies all rows
+    uint64_t last_full_ns;
+} fbcon;
+
+// every glyph expanded to pixels for the current colors, so drawing a cell is
+// eight 32-byte row copies
+static uint32_t glyph_pixels[GLYPH_COUNT][8][8];
+
+static console_sink_t fbcon_sink;
+
+void fbcon_set_color(color_t fg, color_t bg) {
+    uint32_t fg_pixel = graphics_color_to_pixel(fg);
+    uint32_t bg_pixel = graphics_color_to_pixel(bg);
+    for (int c = 0; c < GLYPH_COUNT; c++) {
+        const uint8_t *glyph = graphics_glyph((char) (c + 32));
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) glyph_pixels[c][y][x] = (glyph[y] >> x) & 1 ? fg_pixel : bg_pixel;
+        }
+    }
+    fbcon.bg = bg_pixel;
+}
+
+static inline uint32_t *cell_pixels(uint32_t row, uint32_t col) {
+    uint32_t ring_row = fbcon.origin + row;
+    if (ring_row >= fbcon.rows) ring_row -= fbcon.rows;
+    return fbcon.text + ((size_t) ring_row * 8) * fbcon.stride + (size_t) col * 8;
+}
+
+static inline void mark_row(uint32_t row) {
+    if (row < fbcon.dirty_first) fbcon.dirty_first = row;
+    if (row > fbcon.dirty_last) fbcon.dirty_last = row;
+}
+
+static void newline(void) {
+    fbcon.col = 0;
+    if (fbcon.row + 1 < fbcon.rows) {
+        fbcon.row++;
+        return;
+    }
+    // the top row becomes the new bottom row
+    fbcon.origin = fbcon.origin + 1 == fbcon.rows ? 0 : fbcon.origin + 1;
+    span_fill(cell_pixels(fbcon.row, 0), fbcon.bg, (size_t) fbcon.stride * 8);
+    fbcon.scrolled = true;
+}
+
+static void put_glyph(char c) {
+    if (fbcon.col == fbcon.cols) newline();
+    const uint64_t *src = (const uint64_t *) glyph_pixels[c - 32];
+    uint64_t *dst = (uint64_t *) cell_pixels(fbcon.row, fbcon.col);
+    size_t stride = fbcon.stride / 2;
+    for (int y = 0; y < 8; y++, src += 4, dst += stride) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = src[3];
+    }
+    mark_row(fbcon.row);
+    fbcon.col++;
+}
+
+// copy screen rows [first, last] to VRAM, converted to its layout
+static void present_rows(uint32_t first, uint32_t last) {
+    for (uint32_t row = first; row <= last; row++) {
+        graphics_write_vram(0, row * 8, cell_pixels(row, 0), fbcon.stride, fbcon.stride, 8);
+    }
+}
+
+static void present(bool force) {
+    if (fbcon.scrolled) {
+        uint64_t now = time_now_ns();
+        if (!force && now - fbcon.last_full_ns < FBCON_PRESENT_NS) return;
+        present_rows(0, fbcon.rows - 1);
+        fbcon.scrolled = false;
+        fbcon.last_full_ns = now;
+    } else if (fbcon.dirty_first <= fbcon.dirty_last) {
+        present_rows(fbcon.dirty_first, fbcon.dirty_last);
+    }
+    fbcon.dirty_first = fbcon.rows;
+    fbcon.dirty_last = 0;
+}
+
+static void fbcon_write(const char *s, size_t len) {
+    if (!fbcon.active) return;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (c >= 32 && c <= 126) {
+            put_glyph(c);
+        } else if (c == '\n') {
+            newline();
+        } else if (c == '\r') {
+            fbcon.col = 0;
+        } else if (c == '\t') {
+            do {
+                put_glyph(' ');
+            } while (fbcon.col % 8 && fbcon.col < fbcon.cols);
+        }
+    }
+    present(false);
+}
+
+static void fbcon_flush(void) {
+    if (fbcon.active) present(true);
+}
+
+int fbcon_init(void) {
+    graphics_context_t *ctx = graphics_get_context();
+    if (!ctx || ctx->width < 8 || ctx->height < 8) return -1;
+
+    uint32_t cols = ctx->width / 8;
+    uint32_t rows = ctx->height / 8;
+    uint64_t size = (uint64_t) cols * 8 * rows * 8 * 4;
+    unsigned int order = 0;
+    while ((4096ULL << order) < size && order < FRAME_MAX_ORDER) order++;
+    uint64_t phys = (4096ULL << order) >= size ? frames_alloc(order) : 0;
+    if (!phys) {
+        kprintf("fbcon: no memory for a %lu KiB text buffer\n", size / 1024);
+        return -1;
+    }
+
+    fbcon.cols = cols;
+    fbcon.rows = rows;
+    fbcon.stride = cols * 8;
+    fbcon.text = (uint32_t *) phys_to_virt(phys);
+    fbcon.text_order = order;
+    fbcon.origin = 0;
+    fbcon.col = 0;
+    fbcon.row = 0;
+    fbcon_set_color(COLOR_GRAY, COLOR_BLACK);
+    span_fill(fbcon.text, fbcon.bg, size / 4);
+    fbcon.scrolled = true;
+    fbcon.last_full_ns = 0;
+    fbcon.active = true;
+    present(true);
+
+    if (!fbcon_sink.write) {
+        fbcon_sink.name = "fbcon";
+        fbcon_sink.write = fbcon_write;
+        fbcon_sink.flush = fbcon_flush;
+        console_register_sink(&fbcon_sink);
+    }
+    kprintf("fbcon: %ux%u text console\n", cols, rows);
+    return 0;
+}
+
+void fbcon_release(void) {
+    if (!fbcon.active) return;
+    present(true);
+    fbcon.active = false;
+    frames_free(virt_to_phys(fbcon.text), fbcon.text_order);
+    fbcon.text = nullptr;
+}
@@ -0,0 +1,35 @@
+#ifndef FBCON_H
+#define FBCON_H
+
+#include "graphics.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// text console on the linear framebuffer, as a console sink. text is drawn
+// into a RAM buffer of 8x8 cells whose rows form a ring, so scrolling moves
+// the ring origin and clears one row instead of moving the screen. changed
+// rows are copied to VRAM after each write; after a scroll the whole screen
+// is, at most every FBCON_PRESENT_NS, with the rest deferred to a later write
+// or console_flush()
+
+#define FBCON_PRESENT_NS 20000000ULL
+
+// take over the screen set up by graphics_init*() and register the sink.
+// 0 on success, -1 without graphics or memory for the text buffer
+int fbcon_init(void);
+
+// colors for text written from now on
+void fbcon_set_color(color_t fg, color_t bg);
+
+// stop drawing and leave the screen to the graphics code; the sink stays
+// registered but drops output
+void fbcon_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FBCON_H
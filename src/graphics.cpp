@@ -2,6 +2,10 @@
 #include "memory.h"
 #include "console.h"
 #include "paging.h"
+#include "cpu.h"
+#include "span.h"
+#include "kstring.h"
+#include "time.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -10,14 +14,17 @@ static graphics_context_t g_graphics_ctx = {
     .width = 0,
     .height = 0,
     .pitch = 0,
-    .bpp = 0,
-    .red_shift = 0,
-    .green_shift = 0,
-    .blue_shift = 0,
-    .red_mask = 0,
-    .green_mask = 0,
-    .blue_mask = 0,
-    .initialized = 0
+    .format = {},
+    .initialized = 0,
+    .backbuffer = NULL,
+    .backbuffer_order = 0,
+    .draw_buffer = NULL,
+    .draw_stride = 0,
+    .screen = {},
+    .dirty = {},
+    .dirty_count = 0,
+    .last_swap_tsc = 0,
+    .stats = {}
 };
 
 const color_t COLOR_BLACK = {0x00, 0x00, 0x00, 0xFF};
@@ -129,6 +136,139 @@ static const uint8_t font_8x8[95][8] = {
     {0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // U+007E (~)
 };
 
+// packers for the layouts with their own conversion loop; RGB888 packs like
+// XRGB8888, minus the top byte
+static inline uint32_t pack_xrgb8888(color_t color) {
+    return (uint32_t) color.red << 16 | (uint32_t) color.green << 8 | color.blue;
+}
+
+static inline uint32_t pack_xbgr8888(color_t color) {
+    return (uint32_t) color.blue << 16 | (uint32_t) color.green << 8 | color.red;
+}
+
+static inline uint32_t pack_rgb565(color_t color) {
+    return (uint32_t) (color.red >> 3) << 11 | (uint32_t) (color.green >> 2) << 5 | color.blue >> 3;
+}
+
+// any other layout: each channel keeps its top bits
+static uint32_t pack_fields(const graphics_pixel_format_t *format, color_t color) {
+    return (uint32_t) (color.red >> (8 - format->red_size)) << format->red_position |
+           (uint32_t) (color.green >> (8 - format->green_size)) << format->green_position |
+           (uint32_t) (color.blue >> (8 - format->blue_size)) << format->blue_position;
+}
+
+int graphics_pixel_format_init(graphics_pixel_format_t *format, uint32_t bpp, uint8_t red_position,
+                               uint8_t red_size, uint8_t green_position, uint8_t green_size,
+                               uint8_t blue_position, uint8_t blue_size) {
+    const uint32_t positions[3] = {red_position, green_position, blue_position};
+    const uint32_t sizes[3] = {red_size, green_size, blue_size};
+    bool usable = bpp >= 8 && bpp <= 32;
+    for (int i = 0; i < 3; i++) {
+        if (sizes[i] == 0 || sizes[i] > 8 || positions[i] + sizes[i] > bpp) usable = false;
+    }
+    if (!usable) {
+        kprintf("Graphics: unsupported %u bpp layout R:%u@%u G:%u@%u B:%u@%u\n", bpp, red_size, red_position,
+                green_size, green_position, blue_size, blue_position);
+        return -1;
+    }
+
+    *format = {SURFACE_FORMAT_OTHER, bpp, (bpp + 7) / 8, red_position, red_size, green_position, green_size,
+               blue_position, blue_size};
+    bool bytes = red_size == 8 && green_size == 8 && blue_size == 8 && green_position == 8;
+    if (bytes && bpp == 32 && red_position == 16 && blue_position == 0) {
+        format->format = SURFACE_FORMAT_XRGB8888;
+    } else if (bytes && bpp == 32 && red_position == 0 && blue_position == 16) {
+        format->format = SURFACE_FORMAT_XBGR8888;
+    } else if (bytes && bpp == 24 && red_position == 16 && blue_position == 0) {
+        format->format = SURFACE_FORMAT_RGB888;
+    } else if (bpp == 16 && red_size == 5 && red_position == 11 && green_size == 6 && green_position == 5 &&
+               blue_size == 5 && blue_position == 0) {
+        format->format = SURFACE_FORMAT_RGB565;
+    }
+    return 0;
+}
+
+uint32_t graphics_pixel_format_pack(const graphics_pixel_format_t *format, color_t color) {
+    switch (format->format) {
+    case SURFACE_FORMAT_XRGB8888:
+    case SURFACE_FORMAT_RGB888:
+        return pack_xrgb8888(color);
+    case SURFACE_FORMAT_XBGR8888:
+        return pack_xbgr8888(color);
+    case SURFACE_FORMAT_RGB565:
+        return pack_rgb565(color);
+    default:
+        return pack_fields(format, color);
+    }
+}
+
+// layout of the draw buffer and every surface: VRAM's own when it is a
+// 32-bit one, so the swap is a copy, else XRGB8888 for the swap to convert
+static inline surface_format_t draw_format(void) {
+    return g_graphics_ctx.format.format == SURFACE_FORMAT_XBGR8888 ? SURFACE_FORMAT_XBGR8888
+                                                                   : SURFACE_FORMAT_XRGB8888;
+}
+
+static inline uint32_t surface_pixel(const surface_t *surface, color_t color) {
+    return surface->format == SURFACE_FORMAT_XBGR8888 ? pack_xbgr8888(color) : pack_xrgb8888(color);
+}
+
+static inline color_t surface_color(const surface_t *surface, uint32_t pixel) {
+    uint8_t high = (uint8_t) (pixel >> 16), low = (uint8_t) pixel;
+    if (surface->format == SURFACE_FORMAT_XBGR8888) return {low, (uint8_t) (pixel >> 8), high, 255};
+    return {high, (uint8_t) (pixel >> 8), low, 255};
+}
+
+// allocate a RAM back buffer of width x height pixels for primitives to draw
+// into. without one, primitives draw straight into the framebuffer, which
+// only works when VRAM is in the draw layout. -1 when it is not and there is
+// no memory
+static int graphics_setup_backbuffer(void) {
+    bool direct = g_graphics_ctx.format.format == draw_format();
+    g_graphics_ctx.draw_buffer = direct ? g_graphics_ctx.framebuffer : NULL;
+    g_graphics_ctx.draw_stride = direct ? g_graphics_ctx.pitch / 4 : 0;
+    g_graphics_ctx.dirty_count = 0;
+    surface_init(&g_graphics_ctx.screen, g_graphics_ctx.draw_buffer, g_graphics_ctx.width, g_graphics_ctx.height,
+                 g_graphics_ctx.draw_stride);
+
+    uint64_t size = (uint64_t) g_graphics_ctx.width * g_graphics_ctx.height * 4;
+    unsigned int order = 0;
+    while ((4096ULL << order) < size && order < FRAME_MAX_ORDER) order++;
+
+    uint64_t phys = (4096ULL << order) >= size ? frames_alloc(order) : 0;
+    if (!phys) {
+        if (!direct) {
+            kprintf("Graphics: no memory for the back buffer %u bpp VRAM needs\n", g_graphics_ctx.format.bpp);
+            return -1;
+        }
+        kprintf("Graphics: no memory for a back buffer, drawing to VRAM directly\n");
+        return 0;
+    }
+
+    uint32_t *buffer = (uint32_t *) phys_to_virt(phys);
+    span_fill(buffer, 0, size / 4);
+    g_graphics_ctx.backbuffer = buffer;
+    g_graphics_ctx.backbuffer_order = order;
+    g_graphics_ctx.draw_buffer = buffer;
+    g_graphics_ctx.draw_stride = g_graphics_ctx.width;
+    surface_init(&g_graphics_ctx.screen, buffer, g_graphics_ctx.width, g_graphics_ctx.height, g_graphics_ctx.width);
+    kprintf("Graphics: back buffer at 0x%lx, %lu KiB\n", phys, (4096UL << order) / 1024);
+    return 0;
+}
+
+// the part of initialization shared by both entry points, once the context
+// describes VRAM
+static int graphics_start(void) {
+    g_graphics_ctx.initialized = 1;
+    span_init();
+    if (graphics_setup_backbuffer() != 0) {
+        g_graphics_ctx.initialized = 0;
+        return -1;
+    }
+    kprintf("Graphics: Initialized %dx%d %d bpp framebuffer\n",
+            g_graphics_ctx.width, g_graphics_ctx.height, g_graphics_ctx.format.bpp);
+    return 0;
+}
 
 int graphics_init(vbe_mode_info_t *mode_info) {
     if (!mode_info) {
@@ -148,9 +288,11 @@ int graphics_init(vbe_mode_info_t *mode_info) {
         return -1;
     }
 
-    // only support 32-bit color for now
-    if (mode_info->bpp != 32) {
-        kprintf("Graphics: Only 32-bit color modes supported, got %d bpp\n", mode_info->bpp);
+    // the VBE mask fields are channel sizes in bits
+    graphics_pixel_format_t format;
+    if (graphics_pixel_format_init(&format, mode_info->bpp, mode_info->red_position, mode_info->red_mask,
+                                   mode_info->green_position, mode_info->green_mask, mode_info->blue_position,
+                                   mode_info->blue_mask) != 0) {
         return -1;
     }
 
@@ -168,21 +310,9 @@ int graphics_init(vbe_mode_info_t *mode_info) {
     g_graphics_ctx.width = mode_info->width;
     g_graphics_ctx.height = mode_info->height;
     g_graphics_ctx.pitch = mode_info->pitch;
-    g_graphics_ctx.bpp = mode_info->bpp;
-
-    // calculate color masks and shifts for 32-bit RGBA/BGRA
-    g_graphics_ctx.red_shift = mode_info->red_position;
-    g_graphics_ctx.green_shift = mode_info->green_position;
-    g_graphics_ctx.blue_shift = mode_info->blue_position;
-
-    g_graphics_ctx.red_mask = (1U << mode_info->red_mask) - 1;
-    g_graphics_ctx.green_mask = (1U << mode_info->green_mask) - 1;
-    g_graphics_ctx.blue_mask = (1U << mode_info->blue_mask) - 1;
+    g_graphics_ctx.format = format;
 
-    g_graphics_ctx.initialized = 1;
-
-    kprintf("Graphics: Initialized %dx%d %d bpp framebuffer\n",
-            g_graphics_ctx.width, g_graphics_ctx.height, g_graphics_ctx.bpp);
+    if (graphics_start() != 0) return -1;
     kprintf("Graphics: Color masks - R:%d@%d G:%d@%d B:%d@%d\n",
             mode_info->red_mask, mode_info->red_position,
             mode_info->green_mask, mode_info->green_position,
@@ -195,15 +325,10 @@ int graphics_init(vbe_mode_info_t *mode_info) {
 }
 
 // initialize graphics subsystem with simple parameters (for multiboot framebuffer)
-int graphics_init_simple(uint32_t *framebuffer, uint32_t width, uint32_t height, uint32_t pitch, uint8_t bpp) {
-    if (!framebuffer) {
-        kprintf("Graphics: Invalid framebuffer pointer\n");
-        return -1;
-    }
-
-    // only support 32-bit color for now
-    if (bpp != 32) {
-        kprintf("Graphics: Only 32-bit color modes supported, got %d bpp\n", bpp);
+int graphics_init_simple(uint32_t *framebuffer, uint32_t width, uint32_t height, uint32_t pitch,
+                         const graphics_pixel_format_t *format) {
+    if (!framebuffer || !format) {
+        kprintf("Graphics: Invalid framebuffer pointer or format\n");
         return -1;
     }
 
@@ -229,26 +354,12 @@ int graphics_init_simple(uint32_t *framebuffer, uint32_t width, uint32_t height,
     g_graphics_ctx.width = width;
     g_graphics_ctx.height = height;
     g_graphics_ctx.pitch = pitch;
-    g_graphics_ctx.bpp = bpp;
-
-    // assume standard 32-bit RGBA format for multiboot framebuffer
-    g_graphics_ctx.red_shift = 16;
-    g_graphics_ctx.green_shift = 8;
-    g_graphics_ctx.blue_shift = 0;
-
-    g_graphics_ctx.red_mask = 0xFF;
-    g_graphics_ctx.green_mask = 0xFF;
-    g_graphics_ctx.blue_mask = 0xFF;
-
-    g_graphics_ctx.initialized = 1;
-
-    kprintf("Graphics: Initialized %dx%d %d bpp framebuffer\n",
-            g_graphics_ctx.width, g_graphics_ctx.height, g_graphics_ctx.bpp);
+    g_graphics_ctx.format = *format;
 
     // WARNING: do not clear screen immediately - this might cause page fault
     // graphics_clear_screen(COLOR_BLACK);
 
-    return 0;
+    return graphics_start();
 }
 
 // get the current graphics context
@@ -258,69 +369,189 @@ graphics_context_t *graphics_get_context(void) {
 
 // convert color structure to pixel value
 uint32_t graphics_color_to_pixel(color_t color) {
-    if (!g_graphics_ctx.initialized) return 0;
-
-    uint32_t pixel = 0;
-    pixel |= ((uint32_t) (color.red & g_graphics_ctx.red_mask) << g_graphics_ctx.red_shift);
-    pixel |= ((uint32_t) (color.green & g_graphics_ctx.green_mask) << g_graphics_ctx.green_shift);
-    pixel |= ((uint32_t) (color.blue & g_graphics_ctx.blue_mask) << g_graphics_ctx.blue_shift);
-
-    return pixel;
+    return surface_pixel(&g_graphics_ctx.screen, color);
 }
 
 // convert pixel value to color structure
 color_t graphics_pixel_to_color(uint32_t pixel) {
-    color_t color = {.red = 0, .green = 0, .blue = 0, .alpha = 0};
+    return surface_color(&g_graphics_ctx.screen, pixel);
+}
 
-    if (!g_graphics_ctx.initialized) return color;
+void surface_init(surface_t *surface, uint32_t *pixels, uint32_t width, uint32_t height, uint32_t stride) {
+    surface->pixels = pixels;
+    surface->width = width;
+    surface->height = height;
+    surface->stride = stride;
+    surface->format = draw_format();
+    surface->color_key = 0;
+    surface->clip = {0, 0, width, height};
+    surface->clip_depth = 0;
+}
 
-    color.red = (pixel >> g_graphics_ctx.red_shift) & g_graphics_ctx.red_mask;
-    color.green = (pixel >> g_graphics_ctx.green_shift) & g_graphics_ctx.green_mask;
-    color.blue = (pixel >> g_graphics_ctx.blue_shift) & g_graphics_ctx.blue_mask;
-    color.alpha = 255;
+surface_t *surface_create(uint32_t width, uint32_t height) {
+    surface_t *surface = (surface_t *) kmalloc(sizeof(surface_t));
+    uint32_t *pixels = (uint32_t *) kcalloc((size_t) width * height, 4);
+    if (!surface || !pixels) {
+        kprintf("surface_create: no memory for %ux%u pixels\n", width, height);
+        kfree(surface);
+        kfree(pixels);
+        return nullptr;
+    }
+    surface_init(surface, pixels, width, height, width);
+    return surface;
+}
 
-    return color;
+void surface_destroy(surface_t *surface) {
+    if (!surface) return;
+    kfree(surface->pixels);
+    kfree(surface);
 }
 
-// put a pixel at the specified coordinates
-void graphics_put_pixel(uint32_t x, uint32_t y, color_t color) {
-    if (!g_graphics_ctx.initialized || x >= g_graphics_ctx.width || y >= g_graphics_ctx.height) {
-        return;
+int surface_push_clip(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height) {
+    if (surface->clip_depth == SURFACE_MAX_CLIP) {
+        kprintf("surface_push_clip: more than %u clip rectangles\n", SURFACE_MAX_CLIP);
+        return -1;
     }
+    graphics_rect_t *clip = &surface->clip;
+    surface->clip_stack[surface->clip_depth++] = *clip;
+
+    // an empty intersection stays inside the old clip, with x0 == x1 or y0 == y1
+    int64_t x0 = x, y0 = y, x1 = x0 + width, y1 = y0 + height;
+    if (x0 < clip->x0) x0 = clip->x0;
+    if (x0 > clip->x1) x0 = clip->x1;
+    if (y0 < clip->y0) y0 = clip->y0;
+    if (y0 > clip->y1) y0 = clip->y1;
+    if (x1 > clip->x1) x1 = clip->x1;
+    if (x1 < x0) x1 = x0;
+    if (y1 > clip->y1) y1 = clip->y1;
+    if (y1 < y0) y1 = y0;
+    *clip = {(uint32_t) x0, (uint32_t) y0, (uint32_t) x1, (uint32_t) y1};
+    return 0;
+}
 
-    uint32_t pixel = graphics_color_to_pixel(color);
-    uint32_t offset = (y * g_graphics_ctx.pitch / 4) + x;
-    g_graphics_ctx.framebuffer[offset] = pixel;
+void surface_pop_clip(surface_t *surface) {
+    if (surface->clip_depth) surface->clip = surface->clip_stack[--surface->clip_depth];
 }
 
-// get a pixel at the specified coordinates
-color_t graphics_get_pixel(uint32_t x, uint32_t y) {
-    color_t black = COLOR_BLACK;
+surface_t *graphics_screen(void) {
+    return g_graphics_ctx.initialized ? &g_graphics_ctx.screen : NULL;
+}
 
-    if (!g_graphics_ctx.initialized || x >= g_graphics_ctx.width || y >= g_graphics_ctx.height) {
-        return black;
-    }
+// whether anything can be drawn on surface
+static inline bool surface_drawable(const surface_t *surface) {
+    return surface && surface->pixels && surface->clip.x0 < surface->clip.x1 && surface->clip.y0 < surface->clip.y1;
+}
 
-    uint32_t offset = (y * g_graphics_ctx.pitch / 4) + x;
-    uint32_t pixel = g_graphics_ctx.framebuffer[offset];
+static inline bool clip_contains(const graphics_rect_t *clip, int64_t x, int64_t y) {
+    return x >= clip->x0 && x < clip->x1 && y >= clip->y0 && y < clip->y1;
+}
 
-    return graphics_pixel_to_color(pixel);
+// note that the inclusive box [x0, x1] x [y0, y1] of surface was drawn on.
+// only the screen keeps track, so the next swap copies the clipped box
+static void surface_touched(const surface_t *surface, int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+    if (surface != &g_graphics_ctx.screen) return;
+    const graphics_rect_t *clip = &surface->clip;
+    if (x0 < clip->x0) x0 = clip->x0;
+    if (y0 < clip->y0) y0 = clip->y0;
+    if (x1 >= clip->x1) x1 = (int64_t) clip->x1 - 1;
+    if (y1 >= clip->y1) y1 = (int64_t) clip->y1 - 1;
+    if (x0 > x1 || y0 > y1) return;
+    graphics_mark_dirty((uint32_t) x0, (uint32_t) y0, (uint32_t) (x1 - x0 + 1), (uint32_t) (y1 - y0 + 1));
 }
 
-// clear the entire screen with the specified color
-void graphics_clear_screen(color_t color) {
-    if (!g_graphics_ctx.initialized) return;
+// screen positions above INT32_MAX are off every surface anyway
+static inline int32_t screen_coord(uint32_t v) {
+    return v > INT32_MAX ? INT32_MAX : (int32_t) v;
+}
 
-    uint32_t pixel = graphics_color_to_pixel(color);
-    uint32_t pixels_per_line = g_graphics_ctx.pitch / 4;
+// fill the inclusive box [x0, x1] x [y0, y1], clipped
+static void fill_box(surface_t *surface, int64_t x0, int64_t y0, int64_t x1, int64_t y1, uint32_t pixel) {
+    const graphics_rect_t *clip = &surface->clip;
+    if (x0 < clip->x0) x0 = clip->x0;
+    if (y0 < clip->y0) y0 = clip->y0;
+    if (x1 >= clip->x1) x1 = (int64_t) clip->x1 - 1;
+    if (y1 >= clip->y1) y1 = (int64_t) clip->y1 - 1;
+    if (x0 > x1 || y0 > y1) return;
+
+    uint32_t stride = surface->stride;
+    span_fill_rect(surface->pixels + (size_t) y0 * stride + x0, stride, (size_t) (x1 - x0 + 1),
+                   (size_t) (y1 - y0 + 1), pixel);
+    surface_touched(surface, x0, y0, x1, y1);
+}
 
-    for (uint32_t y = 0; y < g_graphics_ctx.height; y++) {
-        for (uint32_t x = 0; x < g_graphics_ctx.width; x++) {
-            g_graphics_ctx.framebuffer[y * pixels_per_line + x] = pixel;
-        }
+void surface_put_packed(surface_t *surface, int32_t x, int32_t y, uint32_t pixel) {
+    if (!surface_drawable(surface) || !clip_contains(&surface->clip, x, y)) return;
+    surface->pixels[(size_t) y * surface->stride + x] = pixel;
+    surface_touched(surface, x, y, x, y);
+}
+
+void surface_put_pixel(surface_t *surface, int32_t x, int32_t y, color_t color) {
+    surface_put_packed(surface, x, y, surface_pixel(surface, color));
+}
+
+color_t surface_get_pixel(const surface_t *surface, int32_t x, int32_t y) {
+    if (!surface || !surface->pixels || x < 0 || y < 0 || (uint32_t) x >= surface->width ||
+        (uint32_t) y >= surface->height) {
+        return COLOR_BLACK;
+    }
+    return surface_color(surface, surface->pixels[(size_t) y * surface->stride + x]);
+}
+
+void surface_clear(surface_t *surface, color_t color) {
+    if (!surface_drawable(surface)) return;
+    const graphics_rect_t *clip = &surface->clip;
+    fill_box(surface, clip->x0, clip->y0, (int64_t) clip->x1 - 1, (int64_t) clip->y1 - 1,
+             surface_pixel(surface, color));
+}
+
+void surface_fill_rect(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height, color_t color) {
+    if (!surface_drawable(surface) || width == 0 || height == 0) return;
+    fill_box(surface, x, y, (int64_t) x + width - 1, (int64_t) y + height - 1, surface_pixel(surface, color));
+}
+
+void surface_draw_rect(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height, color_t color) {
+    if (!surface_drawable(surface) || width == 0 || height == 0) return;
+
+    uint32_t pixel = surface_pixel(surface, color);
+    int64_t x1 = (int64_t) x + width - 1, y1 = (int64_t) y + height - 1;
+    fill_box(surface, x, y, x1, y, pixel);
+    if (height > 1) fill_box(surface, x, y1, x1, y1, pixel);
+    if (height > 2) {
+        fill_box(surface, x, (int64_t) y + 1, x, y1 - 1, pixel);
+        if (width > 1) fill_box(surface, x1, (int64_t) y + 1, x1, y1 - 1, pixel);
     }
 }
 
+void surface_draw_horizontal_line(surface_t *surface, int32_t x, int32_t y, uint32_t width, color_t color) {
+    if (!surface_drawable(surface)) return;
+    fill_box(surface, x, y, (int64_t) x + width - 1, y, surface_pixel(surface, color));
+}
+
+void surface_draw_vertical_line(surface_t *surface, int32_t x, int32_t y, uint32_t height, color_t color) {
+    if (!surface_drawable(surface)) return;
+    fill_box(surface, x, y, x, (int64_t) y + height - 1, surface_pixel(surface, color));
+}
+
+// put a pixel at the specified coordinates
+void graphics_put_pixel(uint32_t x, uint32_t y, color_t color) {
+    surface_put_pixel(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), color);
+}
+
+void graphics_put_packed(uint32_t x, uint32_t y, uint32_t pixel) {
+    surface_put_packed(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), pixel);
+}
+
+// get a pixel at the specified coordinates
+color_t graphics_get_pixel(uint32_t x, uint32_t y) {
+    return surface_get_pixel(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y));
+}
+
+// clear the entire screen with the specified color, or the clip rectangle
+// when one is pushed
+void graphics_clear_screen(color_t color) {
+    surface_clear(&g_graphics_ctx.screen, color);
+}
+
 // test framebuffer access by writing and reading a single pixel
 // 0 on success, -1 on failure
 
@@ -345,164 +576,648 @@ int graphics_test_framebuffer(void) {
 
 // fill a rectangle with the specified color
 void graphics_fill_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, color_t color) {
-    if (!g_graphics_ctx.initialized) return;
+    surface_fill_rect(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), width, height, color);
+}
 
-    uint32_t pixel = graphics_color_to_pixel(color);
-    uint32_t pixels_per_line = g_graphics_ctx.pitch / 4;
+// draw a rectangle outline with the specified color
+void graphics_draw_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, color_t color) {
+    surface_draw_rect(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), width, height, color);
+}
+
+// draw a horizontal line
+void graphics_draw_horizontal_line(uint32_t x, uint32_t y, uint32_t width, color_t color) {
+    surface_draw_horizontal_line(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), width, color);
+}
+
+// draw a vertical line
+void graphics_draw_vertical_line(uint32_t x, uint32_t y, uint32_t height, color_t color) {
+    surface_draw_vertical_line(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), height, color);
+}
+
+// Cohen-Sutherland outcodes against the clip rectangle
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_TOP 4
+#define CLIP_BOTTOM 8
+
+static inline int clip_outcode(const graphics_rect_t *clip, int64_t x, int64_t y) {
+    int code = 0;
+    if (x < clip->x0) code |= CLIP_LEFT;
+    else if (x >= clip->x1) code |= CLIP_RIGHT;
+    if (y < clip->y0) code |= CLIP_TOP;
+    else if (y >= clip->y1) code |= CLIP_BOTTOM;
+    return code;
+}
+
+// inclusive bounding box of drawn pixels, empty while x0 > x1
+typedef struct {
+    int64_t x0, y0, x1, y1;
+} line_box_t;
+
+static inline void line_box_add(line_box_t *box, int64_t x, int64_t y) {
+    if (x < box->x0) box->x0 = x;
+    if (x > box->x1) box->x1 = x;
+    if (y < box->y0) box->y0 = y;
+    if (y > box->y1) box->y1 = y;
+}
+
+// along the major axis, step i of a line lands on minor offset
+// k(i) = floor((2 * i * dm + dM) / (2 * dM)), i.e. i * dm / dM rounded.
+// first step with k(i) >= t (t > 0, dm > 0)
+static inline uint64_t line_first_step(uint64_t t, uint64_t dM, uint64_t dm) {
+    return ((2 * t - 1) * dM + 2 * dm - 1) / (2 * dm);
+}
+
+// last step with k(i) <= t (dm > 0)
+static inline uint64_t line_last_step(uint64_t t, uint64_t dM, uint64_t dm) {
+    return ((2 * t + 1) * dM + 2 * dm - 1) / (2 * dm) - 1;
+}
+
+// draw the pixels of the line from (x0, y0) to (x1, y1) inside the clip,
+// both ends included. lines that cross the clip edge start and stop at the
+// first and last visible step, found directly, with the error term those
+// steps would have had, so clipping never changes which pixels are lit
+static void draw_segment(surface_t *surface, int64_t x0, int64_t y0, int64_t x1, int64_t y1, uint32_t pixel,
+                         line_box_t *box) {
+    const graphics_rect_t *clip = &surface->clip;
+    int code0 = clip_outcode(clip, x0, y0);
+    int code1 = clip_outcode(clip, x1, y1);
+    if (code0 & code1) return; // both ends beyond the same edge
+
+    uint64_t adx = x1 > x0 ? x1 - x0 : x0 - x1;
+    uint64_t ady = y1 > y0 ? y1 - y0 : y0 - y1;
+    int64_t sx = x1 < x0 ? -1 : 1;
+    int64_t sy = y1 < y0 ? -1 : 1;
+    bool x_major = adx >= ady;
+    uint64_t dM = x_major ? adx : ady;
+    uint64_t dm = x_major ? ady : adx;
+    int64_t major0 = x_major ? x0 : y0, minor0 = x_major ? y0 : x0;
+    int64_t smajor = x_major ? sx : sy, sminor = x_major ? sy : sx;
+
+    if (dM == 0) {
+        if (code0) return;
+        surface->pixels[(size_t) y0 * surface->stride + x0] = pixel;
+        line_box_add(box, x0, y0);
+        return;
+    }
+
+    uint64_t first = 0, last = dM;
+    if (code0 | code1) {
+        // steps whose major coordinate is inside the clip
+        int64_t major_lo = x_major ? clip->x0 : clip->y0;
+        int64_t major_hi = (int64_t) (x_major ? clip->x1 : clip->y1) - 1;
+        int64_t lo = smajor > 0 ? major_lo - major0 : major0 - major_hi;
+        int64_t hi = smajor > 0 ? major_hi - major0 : major0 - major_lo;
+        if (hi < 0) return;
+        if (lo > 0) first = (uint64_t) lo;
+        if ((uint64_t) hi < last) last = (uint64_t) hi;
+
+        // and whose minor offset k keeps the minor coordinate inside
+        int64_t minor_lo = x_major ? clip->y0 : clip->x0;
+        int64_t minor_hi = (int64_t) (x_major ? clip->y1 : clip->x1) - 1;
+        int64_t klo = sminor > 0 ? minor_lo - minor0 : minor0 - minor_hi;
+        int64_t khi = sminor > 0 ? minor_hi - minor0 : minor0 - minor_lo;
+        if (khi < 0 || (klo > 0 && (uint64_t) klo > dm)) return;
+        if (klo > 0) {
+            uint64_t step = line_first_step((uint64_t) klo, dM, dm);
+            if (step > first) first = step;
+        }
+        if ((uint64_t) khi < dm) {
+            uint64_t step = line_last_step((uint64_t) khi, dM, dm);
+            if (step < last) last = step;
+        }
+        if (first > last) return;
+    }
 
-    for (uint32_t row = y; row < y + height && row < g_graphics_ctx.height; row++) {
-        for (uint32_t col = x; col < x + width && col < g_graphics_ctx.width; col++) {
-            g_graphics_ctx.framebuffer[row * pixels_per_line + col] = pixel;
+    // position and error term at the first visible step
+    uint64_t num = 2 * first * dm + dM;
+    int64_t major = major0 + smajor * (int64_t) first;
+    int64_t minor = minor0 + sminor * (int64_t) (num / (2 * dM));
+    uint64_t err = num % (2 * dM);
+    int64_t x = x_major ? major : minor, y = x_major ? minor : major;
+
+    int64_t stride = surface->stride;
+    int64_t step_major = x_major ? sx : sy * stride;
+    int64_t step_minor = x_major ? sy * stride : sx;
+    uint32_t *p = surface->pixels + y * stride + x;
+    uint64_t err_step = 2 * dm, err_wrap = 2 * dM;
+    for (uint64_t n = last - first + 1; n; n--) {
+        *p = pixel;
+        p += step_major;
+        err += err_step;
+        if (err >= err_wrap) {
+            err -= err_wrap;
+            p += step_minor;
         }
     }
+
+    line_box_add(box, x, y);
+    major = major0 + smajor * (int64_t) last;
+    minor = minor0 + sminor * (int64_t) ((2 * last * dm + dM) / (2 * dM));
+    line_box_add(box, x_major ? major : minor, x_major ? minor : major);
 }
 
-// draw a rectangle outline with the specified color
-void graphics_draw_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, color_t color) {
-    if (!g_graphics_ctx.initialized || width == 0 || height == 0) return;
+static inline bool line_coords_ok(int64_t x, int64_t y) {
+    return x >= -GRAPHICS_MAX_COORD && x <= GRAPHICS_MAX_COORD && y >= -GRAPHICS_MAX_COORD &&
+           y <= GRAPHICS_MAX_COORD;
+}
+
+static inline void line_box_mark(const surface_t *surface, const line_box_t *box) {
+    if (box->x0 <= box->x1) surface_touched(surface, box->x0, box->y0, box->x1, box->y1);
+}
+
+void surface_draw_line(surface_t *surface, int32_t x0, int32_t y0, int32_t x1, int32_t y1, color_t color) {
+    if (!surface_drawable(surface) || !line_coords_ok(x0, y0) || !line_coords_ok(x1, y1)) return;
+
+    line_box_t box = {INT64_MAX, INT64_MAX, INT64_MIN, INT64_MIN};
+    draw_segment(surface, x0, y0, x1, y1, surface_pixel(surface, color), &box);
+    line_box_mark(surface, &box);
+}
 
-    // top and bottom lines
-    graphics_draw_horizontal_line(x, y, width, color);
-    if (height > 1) {
-        graphics_draw_horizontal_line(x, y + height - 1, width, color);
+void surface_draw_polyline(surface_t *surface, const graphics_point_t *points, size_t count, color_t color) {
+    if (!surface_drawable(surface) || !points) return;
+
+    uint32_t pixel = surface_pixel(surface, color);
+    line_box_t box = {INT64_MAX, INT64_MAX, INT64_MIN, INT64_MIN};
+    for (size_t i = 1; i < count; i++) {
+        const graphics_point_t *a = &points[i - 1], *b = &points[i];
+        if (line_coords_ok(a->x, a->y) && line_coords_ok(b->x, b->y)) {
+            draw_segment(surface, a->x, a->y, b->x, b->y, pixel, &box);
+        }
     }
+    line_box_mark(surface, &box);
+}
 
-    // left and right lines
-    if (height > 2) {
-        graphics_draw_vertical_line(x, y + 1, height - 2, color);
-        if (width > 1) {
-            graphics_draw_vertical_line(x + width - 1, y + 1, height - 2, color);
+void surface_draw_segments(surface_t *surface, const graphics_point_t *points, size_t count, color_t color) {
+    if (!surface_drawable(surface) || !points) return;
+
+    uint32_t pixel = surface_pixel(surface, color);
+    line_box_t box = {INT64_MAX, INT64_MAX, INT64_MIN, INT64_MIN};
+    for (size_t i = 0; i < count; i++) {
+        const graphics_point_t *a = &points[2 * i], *b = &points[2 * i + 1];
+        if (line_coords_ok(a->x, a->y) && line_coords_ok(b->x, b->y)) {
+            draw_segment(surface, a->x, a->y, b->x, b->y, pixel, &box);
         }
     }
+    line_box_mark(surface, &box);
 }
 
-// draw a horizontal line
-void graphics_draw_horizontal_line(uint32_t x, uint32_t y, uint32_t width, color_t color) {
-    if (!g_graphics_ctx.initialized || y >= g_graphics_ctx.height) return;
+// draw a line; either end may be off screen
+void graphics_draw_line(int32_t x0, int32_t y0, int32_t x1, int32_t y1, color_t color) {
+    surface_draw_line(&g_graphics_ctx.screen, x0, y0, x1, y1, color);
+}
 
-    uint32_t pixel = graphics_color_to_pixel(color);
-    uint32_t pixels_per_line = g_graphics_ctx.pitch / 4;
-    uint32_t end_x = x + width;
+void graphics_draw_polyline(const graphics_point_t *points, size_t count, color_t color) {
+    surface_draw_polyline(&g_graphics_ctx.screen, points, count, color);
+}
+
+void graphics_draw_segments(const graphics_point_t *points, size_t count, color_t color) {
+    surface_draw_segments(&g_graphics_ctx.screen, points, count, color);
+}
+
+const uint8_t *graphics_glyph(char c) {
+    if (c < 32 || c > 126) return nullptr;
+    return font_8x8[c - 32];
+}
 
-    if (end_x > g_graphics_ctx.width) {
-        end_x = g_graphics_ctx.width;
+// pixel masks for one glyph row: entry b is all ones in the pixels whose bit
+// is set in b (bit 0 leftmost). independent of the colors, so a glyph row
+// becomes eight masked stores with no per-bit branches
+struct glyph_mask_table {
+    uint32_t masks[256][8];
+
+    constexpr glyph_mask_table() : masks() {
+        for (int b = 0; b < 256; b++) {
+            for (int x = 0; x < 8; x++) masks[b][x] = (b >> x) & 1 ? 0xFFFFFFFF : 0;
+        }
     }
+};
 
-    for (uint32_t col = x; col < end_x; col++) {
-        g_graphics_ctx.framebuffer[y * pixels_per_line + col] = pixel;
+static constexpr glyph_mask_table glyph_masks;
+
+// draw n characters in one text row at (x, y), clipped once. unprintable
+// characters leave their cell untouched. with transparent set only the
+// glyph pixels are written
+static void draw_text_run(surface_t *surface, int64_t x, int64_t y, const char *s, size_t n, uint32_t fg_pixel,
+                          uint32_t bg_pixel, bool transparent) {
+    const graphics_rect_t *clip = &surface->clip;
+    if (!n || y >= clip->y1 || y + 8 <= clip->y0 || x >= clip->x1 || x + 8 * (int64_t) n <= clip->x0) return;
+
+    uint32_t row0 = y < clip->y0 ? (uint32_t) (clip->y0 - y) : 0;
+    uint32_t row1 = y + 8 > clip->y1 ? (uint32_t) (clip->y1 - y) : 8;
+    // characters with at least one visible column; the first and last may be cut
+    size_t first = x < clip->x0 ? (size_t) ((clip->x0 - x) / 8) : 0;
+    size_t end = (size_t) ((clip->x1 - x + 7) / 8);
+    if (end > n) end = n;
+    int64_t first_x = x + 8 * (int64_t) first, last_x = x + 8 * (int64_t) (end - 1);
+    uint32_t first_col = first_x < clip->x0 ? (uint32_t) (clip->x0 - first_x) : 0;
+    uint32_t last_cols = last_x + 8 > clip->x1 ? (uint32_t) (clip->x1 - last_x) : 8;
+    uint32_t diff = fg_pixel ^ bg_pixel;
+
+    uint32_t stride = surface->stride;
+    uint32_t *line = surface->pixels + (size_t) (y + row0) * stride + first_x;
+    for (uint32_t row = row0; row < row1; row++, line += stride) {
+        uint32_t *dst = line;
+        for (size_t i = first; i < end; i++, dst += 8) {
+            const uint8_t *glyph = graphics_glyph(s[i]);
+            if (!glyph) continue;
+            const uint32_t *m = glyph_masks.masks[glyph[row]];
+            uint32_t col0 = i == first ? first_col : 0, col1 = i + 1 == end ? last_cols : 8;
+            if (col0 == 0 && col1 == 8) {
+                if (transparent) {
+                    for (int col = 0; col < 8; col++) dst[col] ^= (dst[col] ^ fg_pixel) & m[col];
+                } else {
+                    for (int col = 0; col < 8; col++) dst[col] = bg_pixel ^ (diff & m[col]);
+                }
+            } else {
+                for (uint32_t col = col0; col < col1; col++) {
+                    dst[col] = transparent ? dst[col] ^ ((dst[col] ^ fg_pixel) & m[col]) : bg_pixel ^ (diff & m[col]);
+                }
+            }
+        }
     }
+    surface_touched(surface, first_x + first_col, y + row0, last_x + last_cols - 1, y + row1 - 1);
 }
 
-// draw a vertical line
-void graphics_draw_vertical_line(uint32_t x, uint32_t y, uint32_t height, color_t color) {
-    if (!g_graphics_ctx.initialized || x >= g_graphics_ctx.width) return;
+// draw text line by line, splitting at '\n'
+static void draw_text(surface_t *surface, int64_t x, int64_t y, const char *str, color_t fg, color_t bg,
+                      bool transparent) {
+    if (!surface_drawable(surface) || !str) return;
 
-    uint32_t pixel = graphics_color_to_pixel(color);
-    uint32_t pixels_per_line = g_graphics_ctx.pitch / 4;
-    uint32_t end_y = y + height;
+    uint32_t fg_pixel = surface_pixel(surface, fg);
+    uint32_t bg_pixel = surface_pixel(surface, bg);
+    while (*str) {
+        const char *end = str;
+        while (*end && *end != '\n') end++;
+        draw_text_run(surface, x, y, str, (size_t) (end - str), fg_pixel, bg_pixel, transparent);
+        if (!*end) break;
+        str = end + 1;
+        y += 8;
+        if (y >= surface->clip.y1) break;
+    }
+}
 
-    if (end_y > g_graphics_ctx.height) {
-        end_y = g_graphics_ctx.height;
+void surface_draw_char(surface_t *surface, int32_t x, int32_t y, char c, color_t fg, color_t bg) {
+    if (!surface_drawable(surface)) return;
+    draw_text_run(surface, x, y, &c, 1, surface_pixel(surface, fg), surface_pixel(surface, bg), false);
+}
+
+void surface_draw_string(surface_t *surface, int32_t x, int32_t y, const char *str, color_t fg, color_t bg) {
+    draw_text(surface, x, y, str, fg, bg, false);
+}
+
+void surface_draw_string_transparent(surface_t *surface, int32_t x, int32_t y, const char *str, color_t fg) {
+    draw_text(surface, x, y, str, fg, fg, true);
+}
+
+// draw a character using the built-in font
+void graphics_draw_char(uint32_t x, uint32_t y, char c, color_t fg, color_t bg) {
+    surface_draw_char(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), c, fg, bg);
+}
+
+// draw a string using the built-in font
+void graphics_draw_string(uint32_t x, uint32_t y, const char *str, color_t fg, color_t bg) {
+    surface_draw_string(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), str, fg, bg);
+}
+
+void graphics_draw_string_transparent(uint32_t x, uint32_t y, const char *str, color_t fg) {
+    surface_draw_string_transparent(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), str, fg);
+}
+
+// whether two rectangles overlap or share an edge
+static bool rect_touches(const graphics_rect_t *a, const graphics_rect_t *b) {
+    return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+static uint64_t rect_area(const graphics_rect_t *r) {
+    return (uint64_t) (r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static void rect_union(graphics_rect_t *dst, const graphics_rect_t *src) {
+    if (src->x0 < dst->x0) dst->x0 = src->x0;
+    if (src->y0 < dst->y0) dst->y0 = src->y0;
+    if (src->x1 > dst->x1) dst->x1 = src->x1;
+    if (src->y1 > dst->y1) dst->y1 = src->y1;
+}
+
+// mark a region as changed so the next swap copies it. touching rectangles
+// are merged so no pixel is copied twice
+void graphics_mark_dirty(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (!g_graphics_ctx.backbuffer || x >= g_graphics_ctx.width || y >= g_graphics_ctx.height) return;
+    if (width == 0 || height == 0) return;
+
+    graphics_rect_t rect = {x, y, x + width, y + height};
+    if (width > g_graphics_ctx.width - x) rect.x1 = g_graphics_ctx.width;
+    if (height > g_graphics_ctx.height - y) rect.y1 = g_graphics_ctx.height;
+
+    graphics_rect_t *dirty = g_graphics_ctx.dirty;
+    uint32_t count = g_graphics_ctx.dirty_count;
+
+    // fast path: already covered by the most recent rectangle
+    if (count) {
+        const graphics_rect_t *last = &dirty[count - 1];
+        if (rect.x0 >= last->x0 && rect.x1 <= last->x1 && rect.y0 >= last->y0 && rect.y1 <= last->y1) return;
     }
 
-    for (uint32_t row = y; row < end_y; row++) {
-        g_graphics_ctx.framebuffer[row * pixels_per_line + x] = pixel;
+    // absorb every rectangle the new one touches; the union may reach
+    // rectangles it did not touch before, so repeat until nothing changes
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (uint32_t i = 0; i < count; i++) {
+            if (rect_touches(&rect, &dirty[i])) {
+                rect_union(&rect, &dirty[i]);
+                dirty[i] = dirty[--count];
+                merged = true;
+                break;
+            }
+        }
+
+        if (!merged && count == GRAPHICS_MAX_DIRTY) {
+            // out of slots: fold into the rectangle whose area grows least.
+            // the grown rectangle may now touch others, so absorb again
+            uint32_t best = 0;
+            uint64_t best_growth = ~0ULL;
+            for (uint32_t i = 0; i < count; i++) {
+                graphics_rect_t u = dirty[i];
+                rect_union(&u, &rect);
+                uint64_t growth = rect_area(&u) - rect_area(&dirty[i]);
+                if (growth < best_growth) {
+                    best_growth = growth;
+                    best = i;
+                }
+            }
+            rect_union(&rect, &dirty[best]);
+            dirty[best] = dirty[--count];
+            merged = true;
+        }
     }
+
+    dirty[count++] = rect;
+    g_graphics_ctx.dirty_count = count;
 }
 
-// draw a line using Bresenham's algorithm
-void graphics_draw_line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, color_t color) {
-    if (!g_graphics_ctx.initialized) return;
+// draw-buffer pixels, XRGB8888, converted for VRAM in the other layouts.
+// rows of 16-bit and 24-bit VRAM need not be 4-byte aligned
+typedef uint16_t vram_u16_t __attribute__((aligned(1)));
+typedef uint32_t vram_u32_t __attribute__((aligned(1)));
 
-    const int dx = x1 > x0 ? x1 - x0 : x0 - x1;
-    const int dy = y1 > y0 ? y1 - y0 : y0 - y1;
-    const int sx = x0 < x1 ? 1 : -1;
-    const int sy = y0 < y1 ? 1 : -1;
-    int err = dx - dy;
+static inline uint32_t xrgb_to_rgb565(uint32_t p) {
+    return (p >> 8 & 0xF800) | (p >> 5 & 0x07E0) | (p >> 3 & 0x001F);
+}
 
-    while (1) {
-        graphics_put_pixel(x0, y0, color);
+// two pixels go out as one word
+static void convert_rgb565(uint8_t *dst, const uint32_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2, dst += 4) {
+        *(vram_u32_t *) dst = xrgb_to_rgb565(src[i]) | xrgb_to_rgb565(src[i + 1]) << 16;
+    }
+    if (i < count) *(vram_u16_t *) dst = (uint16_t) xrgb_to_rgb565(src[i]);
+}
 
-        if (x0 == x1 && y0 == y1) break;
+// four pixels go out as three words
+static void convert_rgb888(uint8_t *dst, const uint32_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, dst += 12) {
+        uint32_t p0 = src[i], p1 = src[i + 1], p2 = src[i + 2], p3 = src[i + 3];
+        vram_u32_t *out = (vram_u32_t *) dst;
+        out[0] = (p0 & 0xFFFFFF) | p1 << 24;
+        out[1] = (p1 >> 8 & 0xFFFF) | p2 << 16;
+        out[2] = (p2 >> 16 & 0xFF) | p3 << 8;
+    }
+    for (; i < count; i++, dst += 3) {
+        dst[0] = (uint8_t) src[i];
+        dst[1] = (uint8_t) (src[i] >> 8);
+        dst[2] = (uint8_t) (src[i] >> 16);
+    }
+}
 
-        const int e2 = 2 * err;
-        if (e2 > -dy) {
-            err -= dy;
-            x0 += sx;
-        }
-        if (e2 < dx) {
-            err += dx;
-            y0 += sy;
+static void convert_fields(uint8_t *dst, const uint32_t *src, size_t count, const graphics_pixel_format_t *format) {
+    for (size_t i = 0; i < count; i++, dst += format->bytes) {
+        uint32_t p = src[i];
+        uint32_t pixel = pack_fields(format, {(uint8_t) (p >> 16), (uint8_t) (p >> 8), (uint8_t) p, 255});
+        switch (format->bytes) {
+        case 4:
+            *(vram_u32_t *) dst = pixel;
+            break;
+        case 2:
+            *(vram_u16_t *) dst = (uint16_t) pixel;
+            break;
+        default:
+            for (uint32_t b = 0; b < format->bytes; b++) dst[b] = (uint8_t) (pixel >> (8 * b));
+            break;
         }
     }
 }
 
-// draw a character using the built-in font
-void graphics_draw_char(uint32_t x, uint32_t y, char c, color_t fg, color_t bg) {
-    if (!g_graphics_ctx.initialized || c < 32 || c > 126) return;
-
-    const uint8_t *glyph = font_8x8[c - 32];
-    // standard VGA font bit order: LSB to MSB corresponds to left to right pixels
-    // bit masks for each column (left to right): {1,2,4,8,16,32,64,128}
-    const int mask[8] = {1, 2, 4, 8, 16, 32, 64, 128};
-
-    for (int row = 0; row < 8; row++) {
-        uint8_t line = glyph[row];
-        for (int col = 0; col < 8; col++) {
-            color_t pixel_color = (line & mask[col]) ? fg : bg;
-            graphics_put_pixel(x + col, y + row, pixel_color);
+void graphics_write_vram(uint32_t x, uint32_t y, const uint32_t *src, uint32_t src_stride, uint32_t width,
+                         uint32_t height) {
+    if (!g_graphics_ctx.initialized || x >= g_graphics_ctx.width || y >= g_graphics_ctx.height) return;
+    if (width > g_graphics_ctx.width - x) width = g_graphics_ctx.width - x;
+    if (height > g_graphics_ctx.height - y) height = g_graphics_ctx.height - y;
+
+    const graphics_pixel_format_t *format = &g_graphics_ctx.format;
+    uint32_t pitch = g_graphics_ctx.pitch;
+    uint8_t *dst = (uint8_t *) g_graphics_ctx.framebuffer + (size_t) y * pitch + (size_t) x * format->bytes;
+    for (uint32_t row = 0; row < height; row++, src += src_stride, dst += pitch) {
+        switch (format->format) {
+        case SURFACE_FORMAT_XRGB8888:
+        case SURFACE_FORMAT_XBGR8888:
+            kmemcpy(dst, src, (size_t) width * 4);
+            break;
+        case SURFACE_FORMAT_RGB565:
+            convert_rgb565(dst, src, width);
+            break;
+        case SURFACE_FORMAT_RGB888:
+            convert_rgb888(dst, src, width);
+            break;
+        default:
+            convert_fields(dst, src, width, format);
+            break;
         }
     }
 }
 
-// draw a string using the built-in font
-void graphics_draw_string(uint32_t x, uint32_t y, const char *str, color_t fg, color_t bg) {
-    if (!g_graphics_ctx.initialized || !str) return;
+// copy the dirty regions of the back buffer to VRAM
+void graphics_swap_buffers(void) {
+    if (!g_graphics_ctx.initialized) return;
 
-    uint32_t pos_x = x;
+    uint64_t start = cpu_rdtsc();
+    uint64_t bytes = 0;
 
-    while (*str) {
-        if (*str == '\n') {
-            pos_x = x;
-            y += 8;
-        } else {
-            graphics_draw_char(pos_x, y, *str, fg, bg);
-            pos_x += 8;
+    if (g_graphics_ctx.backbuffer) {
+        uint32_t stride = g_graphics_ctx.draw_stride;
+        for (uint32_t i = 0; i < g_graphics_ctx.dirty_count; i++) {
+            const graphics_rect_t *r = &g_graphics_ctx.dirty[i];
+            graphics_write_vram(r->x0, r->y0, g_graphics_ctx.backbuffer + (size_t) r->y0 * stride + r->x0, stride,
+                                r->x1 - r->x0, r->y1 - r->y0);
+            bytes += rect_area(r) * g_graphics_ctx.format.bytes;
         }
-        str++;
+        g_graphics_ctx.dirty_count = 0;
     }
+
+    uint64_t end = cpu_rdtsc();
+    graphics_frame_stats_t *stats = &g_graphics_ctx.stats;
+    stats->frames++;
+    stats->last_vram_bytes = bytes;
+    stats->total_vram_bytes += bytes;
+    stats->last_swap_cycles = end - start;
+    stats->last_frame_cycles = g_graphics_ctx.last_swap_tsc ? start - g_graphics_ctx.last_swap_tsc : 0;
+    g_graphics_ctx.last_swap_tsc = start;
+}
+
+const graphics_frame_stats_t *graphics_get_frame_stats(void) {
+    return &g_graphics_ctx.stats;
+}
+
+// run the graphics self-benchmarks on the draw buffer, which is left with
+// garbage; callers redraw the screen afterwards
+void graphics_benchmark(void) {
+    if (!g_graphics_ctx.initialized) return;
+    span_benchmark(g_graphics_ctx.draw_buffer, g_graphics_ctx.draw_stride, g_graphics_ctx.width,
+                   g_graphics_ctx.height);
 }
 
 // cleanup graphics subsystem
 void graphics_cleanup(void) {
+    if (g_graphics_ctx.backbuffer) {
+        frames_free(virt_to_phys(g_graphics_ctx.backbuffer), g_graphics_ctx.backbuffer_order);
+        g_graphics_ctx.backbuffer = NULL;
+    }
     g_graphics_ctx.initialized = 0;
     g_graphics_ctx.framebuffer = NULL;
+    g_graphics_ctx.format = {};
+    g_graphics_ctx.draw_buffer = NULL;
+    g_graphics_ctx.screen = {};
+    g_graphics_ctx.dirty_count = 0;
 }
 
-// simple delay function (busy wait)
-void graphics_delay(uint32_t cycles) {
-    for (volatile uint32_t i = 0; i < cycles; i++) {
-        // busy wait
+// delay in wall-clock time, so animations run at the same speed everywhere
+void graphics_delay(uint32_t us) {
+    time_sleep_us(us);
+}
+
+void graphics_pacer_start(graphics_pacer_t *pacer, uint32_t fps) {
+    uint64_t now = time_now_ns();
+    pacer->period_ns = 1000000000ULL / (fps ? fps : 1);
+    pacer->deadline_ns = now + pacer->period_ns;
+    pacer->last_ns = now;
+    pacer->frames = 0;
+    pacer->total_ns = 0;
+    pacer->min_ns = ~0ULL;
+    pacer->max_ns = 0;
+    pacer->late = 0;
+}
+
+void graphics_pacer_wait(graphics_pacer_t *pacer) {
+    uint64_t now = time_now_ns();
+    if (now < pacer->deadline_ns) {
+        time_sleep_us((pacer->deadline_ns - now) / 1000);
+        now = time_now_ns();
+        pacer->deadline_ns += pacer->period_ns;
+    } else {
+        pacer->late++;
+        pacer->deadline_ns = now + pacer->period_ns;
     }
+
+    uint64_t frame_ns = now - pacer->last_ns;
+    pacer->last_ns = now;
+    pacer->frames++;
+    pacer->total_ns += frame_ns;
+    if (frame_ns < pacer->min_ns) pacer->min_ns = frame_ns;
+    if (frame_ns > pacer->max_ns) pacer->max_ns = frame_ns;
 }
 
-// draw a filled circle using midpoint algorithm
-void graphics_draw_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t color) {
-    if (!g_graphics_ctx.initialized) return;
+void graphics_pacer_report(const graphics_pacer_t *pacer, const char *name) {
+    if (!pacer->frames) return;
+    kprintf("graphics: %s: %lu frames, target %lu us, avg %lu us (min %lu, max %lu), %lu late\n", name,
+            pacer->frames, pacer->period_ns / 1000, pacer->total_ns / pacer->frames / 1000,
+            pacer->min_ns / 1000, pacer->max_ns / 1000, pacer->late);
+}
+
+uint32_t graphics_color_to_premultiplied(color_t color) {
+    uint32_t a = color.alpha;
+    color_t scaled = {(uint8_t) ((color.red * a + 127) / 255), (uint8_t) ((color.green * a + 127) / 255),
+                      (uint8_t) ((color.blue * a + 127) / 255), color.alpha};
+    return graphics_color_to_pixel(scaled) | a << 24;
+}
 
-    int x = 0;
-    int y = radius;
-    int d = 3 - 2 * radius;
+void graphics_blit(surface_t *dst, int32_t dx, int32_t dy, const surface_t *src, const graphics_rect_t *src_rect,
+                   graphics_blit_mode_t mode) {
+    if (!surface_drawable(dst) || !src || !src->pixels) return;
+
+    // the source rectangle, within src
+    int64_t sx = 0, sy = 0, sx1 = src->width, sy1 = src->height;
+    if (src_rect) {
+        if (src_rect->x0 > sx) sx = src_rect->x0;
+        if (src_rect->y0 > sy) sy = src_rect->y0;
+        if (src_rect->x1 < sx1) sx1 = src_rect->x1;
+        if (src_rect->y1 < sy1) sy1 = src_rect->y1;
+    }
+
+    // and where it lands, within dst's clip
+    const graphics_rect_t *clip = &dst->clip;
+    int64_t x0 = dx, y0 = dy, x1 = x0 + (sx1 - sx), y1 = y0 + (sy1 - sy);
+    if (x0 < clip->x0) {
+        sx += clip->x0 - x0;
+        x0 = clip->x0;
+    }
+    if (y0 < clip->y0) {
+        sy += clip->y0 - y0;
+        y0 = clip->y0;
+    }
+    if (x1 > clip->x1) x1 = clip->x1;
+    if (y1 > clip->y1) y1 = clip->y1;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    uint32_t *d = dst->pixels + (size_t) y0 * dst->stride + x0;
+    const uint32_t *s = src->pixels + (size_t) sy * src->stride + sx;
+    size_t width = (size_t) (x1 - x0), height = (size_t) (y1 - y0);
+    switch (mode) {
+    case GRAPHICS_BLIT_COPY:
+        span_copy_rect(d, dst->stride, s, src->stride, width, height);
+        break;
+    case GRAPHICS_BLIT_COLOR_KEY:
+        span_key_rect(d, dst->stride, s, src->stride, width, height, src->color_key);
+        break;
+    case GRAPHICS_BLIT_ALPHA:
+        span_blend_rect(d, dst->stride, s, src->stride, width, height);
+        break;
+    default:
+        kprintf("graphics_blit: unknown mode %d\n", (int) mode);
+        return;
+    }
+    surface_touched(dst, x0, y0, x1 - 1, y1 - 1);
+}
+
+// write a pixel value if it is inside the clip, without dirty tracking;
+// callers mark the bounding box
+static inline void plot(surface_t *surface, int64_t x, int64_t y, uint32_t pixel) {
+    if (clip_contains(&surface->clip, x, y)) surface->pixels[(size_t) y * surface->stride + x] = pixel;
+}
+
+// draw a circle outline using the midpoint algorithm
+void surface_draw_circle(surface_t *surface, int32_t cx, int32_t cy, uint32_t radius, color_t color) {
+    if (!surface_drawable(surface)) return;
+    if (radius > GRAPHICS_MAX_RADIUS) radius = GRAPHICS_MAX_RADIUS;
+
+    int64_t x = 0;
+    int64_t y = radius;
+    int64_t d = 3 - 2 * (int64_t) radius;
+    uint32_t pixel = surface_pixel(surface, color);
+
+    surface_touched(surface, (int64_t) cx - radius, (int64_t) cy - radius, (int64_t) cx + radius,
+                    (int64_t) cy + radius);
 
     // draw initial points
-    graphics_put_pixel(cx + x, cy + y, color);
-    graphics_put_pixel(cx - x, cy + y, color);
-    graphics_put_pixel(cx + x, cy - y, color);
-    graphics_put_pixel(cx - x, cy - y, color);
-    graphics_put_pixel(cx + y, cy + x, color);
-    graphics_put_pixel(cx - y, cy + x, color);
-    graphics_put_pixel(cx + y, cy - x, color);
-    graphics_put_pixel(cx - y, cy - x, color);
+    plot(surface, cx + x, cy + y, pixel);
+    plot(surface, cx - x, cy + y, pixel);
+    plot(surface, cx + x, cy - y, pixel);
+    plot(surface, cx - x, cy - y, pixel);
+    plot(surface, cx + y, cy + x, pixel);
+    plot(surface, cx - y, cy + x, pixel);
+    plot(surface, cx + y, cy - x, pixel);
+    plot(surface, cx - y, cy - x, pixel);
 
     while (y >= x) {
         x++;
@@ -514,30 +1229,97 @@ void graphics_draw_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t col
             d = d + 4 * x + 6;
         }
 
-        graphics_put_pixel(cx + x, cy + y, color);
-        graphics_put_pixel(cx - x, cy + y, color);
-        graphics_put_pixel(cx + x, cy - y, color);
-        graphics_put_pixel(cx - x, cy - y, color);
-        graphics_put_pixel(cx + y, cy + x, color);
-        graphics_put_pixel(cx - y, cy + x, color);
-        graphics_put_pixel(cx + y, cy - x, color);
-        graphics_put_pixel(cx - y, cy - x, color);
+        plot(surface, cx + x, cy + y, pixel);
+        plot(surface, cx - x, cy + y, pixel);
+        plot(surface, cx + x, cy - y, pixel);
+        plot(surface, cx - x, cy - y, pixel);
+        plot(surface, cx + y, cy + x, pixel);
+        plot(surface, cx - y, cy + x, pixel);
+        plot(surface, cx + y, cy - x, pixel);
+        plot(surface, cx - y, cy - x, pixel);
     }
 }
 
-// draw a filled circle
-void graphics_fill_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t color) {
-    if (!g_graphics_ctx.initialized) return;
+// fill columns [x0, x1] of row y, clipped
+static inline void fill_span(surface_t *surface, int64_t x0, int64_t x1, int64_t y, uint32_t pixel) {
+    const graphics_rect_t *clip = &surface->clip;
+    if (y < clip->y0 || y >= clip->y1) return;
+    if (x0 < clip->x0) x0 = clip->x0;
+    if (x1 >= clip->x1) x1 = (int64_t) clip->x1 - 1;
+    if (x0 > x1) return;
+    span_fill(surface->pixels + (size_t) y * surface->stride + x0, pixel, (size_t) (x1 - x0 + 1));
+}
 
-    for (int y = -radius; y <= (int) radius; y++) {
-        for (int x = -radius; x <= (int) radius; x++) {
-            if (x * x + y * y <= (int) (radius * radius)) {
-                uint32_t px = cx + x;
-                uint32_t py = cy + y;
-                if (px < g_graphics_ctx.width && py < g_graphics_ctx.height) {
-                    graphics_put_pixel(px, py, color);
-                }
-            }
-        }
+// fill the ellipse x^2 * ry^2 + y^2 * rx^2 <= rx^2 * ry^2 around (cx, cy),
+// widened by stretch pixels in the middle (for rounded rectangles, whose
+// corners are quarter circles). each row is one span; the half width only
+// shrinks as rows move away from the center, so it is found incrementally
+static void fill_ellipse_spans(surface_t *surface, int64_t cx, int64_t cy, uint64_t rx, uint64_t ry,
+                               int64_t stretch_x, int64_t stretch_y, uint32_t pixel) {
+    const graphics_rect_t *clip = &surface->clip;
+    uint64_t rx2 = rx * rx, ry2 = ry * ry, limit = rx2 * ry2;
+    uint64_t half = rx;
+    for (uint64_t dy = 0; dy <= ry; dy++) {
+        while (half * half * ry2 + dy * dy * rx2 > limit) half--;
+        int64_t x0 = cx - (int64_t) half, x1 = cx + (int64_t) half + stretch_x;
+        int64_t top = cy - (int64_t) dy, bottom = cy + (int64_t) dy + stretch_y;
+        // rows beyond the clip on both sides end the shape
+        if (bottom >= clip->y1 && top < clip->y0) break;
+        fill_span(surface, x0, x1, top, pixel);
+        if (bottom != top) fill_span(surface, x0, x1, bottom, pixel);
     }
+    // the straight middle rows of a stretched shape
+    int64_t y0 = cy + 1 > clip->y0 ? cy + 1 : clip->y0;
+    int64_t y1 = cy + stretch_y < clip->y1 ? cy + stretch_y : clip->y1;
+    for (int64_t y = y0; y < y1; y++) fill_span(surface, cx - (int64_t) rx, cx + (int64_t) rx + stretch_x, y, pixel);
+}
+
+// draw a filled circle: every pixel with x^2 + y^2 <= r^2, one span per row
+void surface_fill_circle(surface_t *surface, int32_t cx, int32_t cy, uint32_t radius, color_t color) {
+    if (!surface_drawable(surface)) return;
+    if (radius > GRAPHICS_MAX_RADIUS) radius = GRAPHICS_MAX_RADIUS;
+
+    fill_ellipse_spans(surface, cx, cy, radius, radius, 0, 0, surface_pixel(surface, color));
+    surface_touched(surface, (int64_t) cx - radius, (int64_t) cy - radius, (int64_t) cx + radius,
+                    (int64_t) cy + radius);
+}
+
+void surface_fill_ellipse(surface_t *surface, int32_t cx, int32_t cy, uint32_t rx, uint32_t ry, color_t color) {
+    if (!surface_drawable(surface)) return;
+    if (rx > GRAPHICS_MAX_RADIUS) rx = GRAPHICS_MAX_RADIUS;
+    if (ry > GRAPHICS_MAX_RADIUS) ry = GRAPHICS_MAX_RADIUS;
+
+    fill_ellipse_spans(surface, cx, cy, rx, ry, 0, 0, surface_pixel(surface, color));
+    surface_touched(surface, (int64_t) cx - rx, (int64_t) cy - ry, (int64_t) cx + rx, (int64_t) cy + ry);
+}
+
+void surface_fill_rounded_rect(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height,
+                               uint32_t radius, color_t color) {
+    if (!surface_drawable(surface) || width == 0 || height == 0) return;
+    if (radius > (width - 1) / 2) radius = (width - 1) / 2;
+    if (radius > (height - 1) / 2) radius = (height - 1) / 2;
+
+    // a circle of the corner radius, split at its center and stretched
+    // apart to the rectangle's size
+    fill_ellipse_spans(surface, (int64_t) x + radius, (int64_t) y + radius, radius, radius,
+                       (int64_t) width - 1 - 2 * radius, (int64_t) height - 1 - 2 * radius,
+                       surface_pixel(surface, color));
+    surface_touched(surface, x, y, (int64_t) x + width - 1, (int64_t) y + height - 1);
+}
+
+void graphics_draw_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t color) {
+    surface_draw_circle(&g_graphics_ctx.screen, screen_coord(cx), screen_coord(cy), radius, color);
+}
+
+void graphics_fill_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t color) {
+    surface_fill_circle(&g_graphics_ctx.screen, screen_coord(cx), screen_coord(cy), radius, color);
+}
+
+void graphics_fill_ellipse(uint32_t cx, uint32_t cy, uint32_t rx, uint32_t ry, color_t color) {
+    surface_fill_ellipse(&g_graphics_ctx.screen, screen_coord(cx), screen_coord(cy), rx, ry, color);
+}
+
+void graphics_fill_rounded_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t radius,
+                                color_t color) {
+    surface_fill_rounded_rect(&g_graphics_ctx.screen, screen_coord(x), screen_coord(y), width, height, radius, color);
 }
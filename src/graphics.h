@@ -45,20 +45,80 @@ typedef struct {
     uint8_t reserved1[206];
 } __attribute__((packed)) vbe_mode_info_t;
 
+// maximum number of dirty rectangles tracked between swaps; past that a new
+// rectangle is merged into the one it grows least
+#define GRAPHICS_MAX_DIRTY 32
+
+// rectangle, right and bottom edges exclusive
+typedef struct {
+    uint32_t x0, y0, x1, y1;
+} graphics_rect_t;
+
+// pixel layouts. surfaces hold 32-bit pixels, XRGB8888 or XBGR8888; VRAM may
+// use any of them
+typedef enum {
+    SURFACE_FORMAT_XRGB8888, // 32 bits, red in bits 16-23, blue in bits 0-7
+    SURFACE_FORMAT_XBGR8888, // 32 bits, red in bits 0-7, blue in bits 16-23
+    SURFACE_FORMAT_RGB565, // 16 bits, red in bits 11-15, blue in bits 0-4
+    SURFACE_FORMAT_RGB888, // 24 bits, blue in the first byte, red in the third
+    SURFACE_FORMAT_OTHER, // any other direct-color layout, packed channel by channel
+} surface_format_t;
+
+// a direct-color pixel layout as VBE or Multiboot report it, classified once
+// by graphics_pixel_format_init()
+typedef struct {
+    surface_format_t format;
+    uint32_t bpp; // bits per pixel
+    uint32_t bytes; // bytes per pixel in memory
+    uint8_t red_position, red_size;
+    uint8_t green_position, green_size;
+    uint8_t blue_position, blue_size;
+} graphics_pixel_format_t;
+
+// nesting depth of surface_push_clip()
+#define SURFACE_MAX_CLIP 16
+
+// a bitmap the primitives draw into: the screen's draw buffer or an
+// off-screen bitmap. drawing is limited to clip, the intersection of the
+// bitmap and every clip rectangle pushed
+typedef struct {
+    uint32_t *pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride; // pixels per row
+    surface_format_t format;
+    uint32_t color_key; // source pixel GRAPHICS_BLIT_COLOR_KEY skips, 0 unless set
+    graphics_rect_t clip;
+    graphics_rect_t clip_stack[SURFACE_MAX_CLIP]; // clip before each push
+    uint32_t clip_depth;
+} surface_t;
+
+// frame statistics updated by graphics_swap_buffers()
+typedef struct {
+    uint64_t frames; // swaps since initialization
+    uint64_t last_vram_bytes; // bytes copied to VRAM by the last swap
+    uint64_t total_vram_bytes; // bytes copied to VRAM since initialization
+    uint64_t last_frame_cycles; // TSC cycles between the last two swaps
+    uint64_t last_swap_cycles; // TSC cycles spent in the last swap
+} graphics_frame_stats_t;
+
 // Graphics context structure
 typedef struct {
     uint32_t *framebuffer; // Virtual address of framebuffer
     uint32_t width; // Screen width in pixels
     uint32_t height; // Screen height in pixels
     uint32_t pitch; // Bytes per scanline
-    uint32_t bpp; // Bits per pixel
-    uint32_t red_shift; // Red component bit shift
-    uint32_t green_shift; // Green component bit shift
-    uint32_t blue_shift; // Blue component bit shift
-    uint32_t red_mask; // Red component mask
-    uint32_t green_mask; // Green component mask
-    uint32_t blue_mask; // Blue component mask
+    graphics_pixel_format_t format; // VRAM pixel layout
     uint8_t initialized; // Whether graphics is initialized
+    uint32_t *backbuffer; // RAM back buffer, NULL when drawing straight to VRAM
+    uint32_t backbuffer_order; // frames_alloc() order of the back buffer
+    uint32_t *draw_buffer; // Buffer primitives draw into
+    uint32_t draw_stride; // Pixels per scanline of draw_buffer
+    surface_t screen; // draw_buffer as a surface; drawing to it marks regions dirty
+    graphics_rect_t dirty[GRAPHICS_MAX_DIRTY]; // Regions drawn since the last swap
+    uint32_t dirty_count; // Number of valid entries in dirty
+    uint64_t last_swap_tsc; // TSC at the last swap
+    graphics_frame_stats_t stats; // Frame statistics
 } graphics_context_t;
 
 // Color structure for convenience
@@ -84,17 +144,27 @@ extern const color_t COLOR_DARK_GRAY;
 // graphics initialization and management
 int graphics_init(vbe_mode_info_t *mode_info);
 
-int graphics_init_simple(uint32_t *framebuffer, uint32_t width, uint32_t height, uint32_t pitch, uint8_t bpp);
+// framebuffer is the mapped VRAM, laid out as format. drawing always goes to
+// 32-bit pixels; VRAM in any other layout needs the back buffer, which the
+// swap converts from
+int graphics_init_simple(uint32_t *framebuffer, uint32_t width, uint32_t height, uint32_t pitch,
+                         const graphics_pixel_format_t *format);
 
 void graphics_cleanup(void);
 
 graphics_context_t *graphics_get_context(void);
 
+// the screen surface, nullptr before initialization
+surface_t *graphics_screen(void);
+
 int graphics_test_framebuffer(void);
 
 // basic drawing primitives
 void graphics_put_pixel(uint32_t x, uint32_t y, color_t color);
 
+// put a pixel already converted by graphics_color_to_pixel()
+void graphics_put_packed(uint32_t x, uint32_t y, uint32_t pixel);
+
 color_t graphics_get_pixel(uint32_t x, uint32_t y);
 
 void graphics_clear_screen(color_t color);
@@ -103,32 +173,201 @@ void graphics_fill_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
 
 void graphics_draw_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, color_t color);
 
-// line drawing
-void graphics_draw_line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, color_t color);
+// line drawing. endpoints are signed and may lie off screen, within
+// +-GRAPHICS_MAX_COORD; lines reaching further are not drawn. the visible
+// part is found before drawing, so off-screen stretches cost nothing
+#define GRAPHICS_MAX_COORD (1 << 30)
+
+typedef struct {
+    int32_t x, y;
+} graphics_point_t;
+
+void graphics_draw_line(int32_t x0, int32_t y0, int32_t x1, int32_t y1, color_t color);
+
+// connected lines through count points
+void graphics_draw_polyline(const graphics_point_t *points, size_t count, color_t color);
+
+// count separate lines, from points[2 * i] to points[2 * i + 1]
+void graphics_draw_segments(const graphics_point_t *points, size_t count, color_t color);
 
 void graphics_draw_horizontal_line(uint32_t x, uint32_t y, uint32_t width, color_t color);
 
 void graphics_draw_vertical_line(uint32_t x, uint32_t y, uint32_t height, color_t color);
 
 // utility functions
+
+// describe a layout from the bit position and size of each channel. returns
+// -1 for layouts that cannot be drawn: pixels outside 8 to 32 bits, or a
+// channel of no or more than 8 bits, or reaching past the pixel
+int graphics_pixel_format_init(graphics_pixel_format_t *format, uint32_t bpp, uint8_t red_position,
+                               uint8_t red_size, uint8_t green_position, uint8_t green_size,
+                               uint8_t blue_position, uint8_t blue_size);
+
+// color as a pixel of format, in the low format->bytes bytes
+uint32_t graphics_pixel_format_pack(const graphics_pixel_format_t *format, color_t color);
+
+// color as a pixel of the screen's draw buffer. primitives convert their
+// colors once per call; loops plotting one color pixel by pixel can convert
+// it here and use graphics_put_packed()
 uint32_t graphics_color_to_pixel(color_t color);
 
 color_t graphics_pixel_to_color(uint32_t pixel);
 
+// copy width x height draw-buffer pixels, rows src_stride apart, to VRAM at
+// (x, y), converted to the VRAM layout. the swap and the text console present
+// through this
+void graphics_write_vram(uint32_t x, uint32_t y, const uint32_t *src, uint32_t src_stride, uint32_t width,
+                         uint32_t height);
+
+// copy the regions drawn since the last swap from the back buffer to VRAM
 void graphics_swap_buffers(void);
 
+// mark a region as changed so the next swap copies it
+void graphics_mark_dirty(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+const graphics_frame_stats_t *graphics_get_frame_stats(void);
+
+// boot-time throughput report for the drawing primitives; clobbers the
+// draw buffer
+void graphics_benchmark(void);
+
 // text rendering (basic bitmap font)
+
+// the 8 rows of the 8x8 glyph for c, bit 0 the leftmost pixel; nullptr
+// outside printable ASCII
+const uint8_t *graphics_glyph(char c);
+
 void graphics_draw_char(uint32_t x, uint32_t y, char c, color_t fg, color_t bg);
 
+// draw str with '\n' starting a new line 8 pixels down; the colors are
+// converted and each line clipped once per call
 void graphics_draw_string(uint32_t x, uint32_t y, const char *str, color_t fg, color_t bg);
 
+// like graphics_draw_string(), but only the glyph pixels are drawn and the
+// background shows through
+void graphics_draw_string_transparent(uint32_t x, uint32_t y, const char *str, color_t fg);
+
 // advanced drawing functions
 void graphics_draw_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t color);
 
+// filled shapes are drawn as one clipped span per row. radii are capped at
+// GRAPHICS_MAX_RADIUS
+#define GRAPHICS_MAX_RADIUS 32767
+
 void graphics_fill_circle(uint32_t cx, uint32_t cy, uint32_t radius, color_t color);
 
+// every pixel with (x/rx)^2 + (y/ry)^2 <= 1 around (cx, cy)
+void graphics_fill_ellipse(uint32_t cx, uint32_t cy, uint32_t rx, uint32_t ry, color_t color);
+
+// rectangle with quarter-circle corners of the given radius, reduced to fit
+void graphics_fill_rounded_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t radius,
+                                color_t color);
+
+// surfaces. the surface_* primitives draw like their graphics_* namesakes,
+// which draw on the screen surface, but take signed positions: shapes may
+// start above or left of the surface and are clipped once per call
+
+// describe an existing bitmap of width x height pixels, rows stride pixels
+// apart, with no clipping beyond its edges. surfaces take the screen's pixel
+// layout, so blits between them are plain copies
+void surface_init(surface_t *surface, uint32_t *pixels, uint32_t width, uint32_t height, uint32_t stride);
+
+// allocate a cleared off-screen surface; nullptr when out of memory
+surface_t *surface_create(uint32_t width, uint32_t height);
+
+// free a surface from surface_create()
+void surface_destroy(surface_t *surface);
+
+// limit drawing to the part of the rectangle inside the current clip, which
+// surface_pop_clip() restores. returns -1 when SURFACE_MAX_CLIP are pushed
+int surface_push_clip(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height);
+
+void surface_pop_clip(surface_t *surface);
+
+void surface_put_pixel(surface_t *surface, int32_t x, int32_t y, color_t color);
+
+// put a pixel already in the surface's layout
+void surface_put_packed(surface_t *surface, int32_t x, int32_t y, uint32_t pixel);
+
+// black outside the surface; reads ignore the clip
+color_t surface_get_pixel(const surface_t *surface, int32_t x, int32_t y);
+
+// fill the clip rectangle
+void surface_clear(surface_t *surface, color_t color);
+
+void surface_fill_rect(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height, color_t color);
+
+void surface_draw_rect(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height, color_t color);
+
+void surface_draw_horizontal_line(surface_t *surface, int32_t x, int32_t y, uint32_t width, color_t color);
+
+void surface_draw_vertical_line(surface_t *surface, int32_t x, int32_t y, uint32_t height, color_t color);
+
+void surface_draw_line(surface_t *surface, int32_t x0, int32_t y0, int32_t x1, int32_t y1, color_t color);
+
+void surface_draw_polyline(surface_t *surface, const graphics_point_t *points, size_t count, color_t color);
+
+void surface_draw_segments(surface_t *surface, const graphics_point_t *points, size_t count, color_t color);
+
+void surface_draw_char(surface_t *surface, int32_t x, int32_t y, char c, color_t fg, color_t bg);
+
+void surface_draw_string(surface_t *surface, int32_t x, int32_t y, const char *str, color_t fg, color_t bg);
+
+void surface_draw_string_transparent(surface_t *surface, int32_t x, int32_t y, const char *str, color_t fg);
+
+void surface_draw_circle(surface_t *surface, int32_t cx, int32_t cy, uint32_t radius, color_t color);
+
+void surface_fill_circle(surface_t *surface, int32_t cx, int32_t cy, uint32_t radius, color_t color);
+
+void surface_fill_ellipse(surface_t *surface, int32_t cx, int32_t cy, uint32_t rx, uint32_t ry, color_t color);
+
+void surface_fill_rounded_rect(surface_t *surface, int32_t x, int32_t y, uint32_t width, uint32_t height,
+                               uint32_t radius, color_t color);
+
+// how graphics_blit() combines source and destination pixels
+typedef enum {
+    GRAPHICS_BLIT_COPY, // the source replaces the destination
+    GRAPHICS_BLIT_COLOR_KEY, // as copy, except source pixels equal to the source's color_key
+    GRAPHICS_BLIT_ALPHA, // premultiplied source-over, alpha in bits 24-31 of the source
+} graphics_blit_mode_t;
+
+// draw src_rect of src (all of src when nullptr) on dst with its top left
+// corner at (dx, dy). the rectangle is cut to src, then to dst's clip. dst
+// and src may be the same surface with overlapping rectangles, for scrolling
+void graphics_blit(surface_t *dst, int32_t dx, int32_t dy, const surface_t *src, const graphics_rect_t *src_rect,
+                   graphics_blit_mode_t mode);
+
+// source pixel for GRAPHICS_BLIT_ALPHA: the color's channels scaled by its
+// alpha, which goes in bits 24-31
+uint32_t graphics_color_to_premultiplied(color_t color);
+
 // animation functions
-void graphics_delay(uint32_t cycles);
+
+// busy-wait for us microseconds
+void graphics_delay(uint32_t us);
+
+// frame pacing for animations at a fixed target rate, with the frame times
+// actually achieved
+typedef struct {
+    uint64_t period_ns; // target frame time
+    uint64_t deadline_ns; // when the current frame should end
+    uint64_t last_ns; // end of the previous frame
+    uint64_t frames;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t late; // frames that overran their deadline
+} graphics_pacer_t;
+
+// start pacing at fps frames per second
+void graphics_pacer_start(graphics_pacer_t *pacer, uint32_t fps);
+
+// end a frame: sleep until its deadline and record how long it took. a frame
+// that overruns starts the next one immediately instead of being made up
+void graphics_pacer_wait(graphics_pacer_t *pacer);
+
+// print achieved frame times (average, min, max) for an animation
+void graphics_pacer_report(const graphics_pacer_t *pacer, const char *name);
 
 #ifdef __cplusplus
 }
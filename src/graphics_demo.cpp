@@ -3,6 +3,10 @@
 #include <stdint.h>
 #include "math.h"
 
+// target frame rates; the color wave redraws every pixel each frame
+#define DEMO_FPS 60
+#define DEMO_WAVE_FPS 30
+
 // Animation: Bouncing ball
 void graphics_animate_bouncing_ball(void) {
     graphics_context_t *ctx = graphics_get_context();
@@ -19,10 +23,18 @@ void graphics_animate_bouncing_ball(void) {
     uint32_t color_index = 0;
     uint32_t frame_count = 0;
 
+    // the background is static, so only the ball's old and new positions
+    // change from frame to frame
+    graphics_clear_screen(COLOR_BLACK);
+    graphics_draw_string(10, 10, "XG OS Graphics Demo", COLOR_WHITE, COLOR_BLACK);
+
+    graphics_pacer_t pacer;
+    graphics_pacer_start(&pacer, DEMO_FPS);
     for (int i = 0; i < 1000; i++) {
         // run for 1000 frames
-        // clear screen
-        graphics_clear_screen(COLOR_BLACK);
+        // erase the ball at its previous position
+        graphics_fill_rect((uint32_t) (x - radius), (uint32_t) (y - radius), 2 * radius + 1, 2 * radius + 1,
+                           COLOR_BLACK);
 
         // update ball position
         x += vx;
@@ -50,13 +62,11 @@ void graphics_animate_bouncing_ball(void) {
         // draw ball
         graphics_fill_circle((uint32_t) x, (uint32_t) y, radius, ball_colors[color_index]);
 
-        // draw frame counter
         frame_count++;
-        graphics_draw_string(10, 10, "XG OS Graphics Demo", COLOR_WHITE, COLOR_BLACK);
-
-        // simple frame rate control
-        graphics_delay(500000); // adjust this value to control animation speed
+        graphics_swap_buffers();
+        graphics_pacer_wait(&pacer);
     }
+    graphics_pacer_report(&pacer, "bouncing ball");
 }
 
 // color wave effect
@@ -67,6 +77,8 @@ void graphics_animate_color_wave(void) {
     uint32_t width = ctx->width;
     uint32_t height = ctx->height;
 
+    graphics_pacer_t pacer;
+    graphics_pacer_start(&pacer, DEMO_WAVE_FPS);
     for (int frame = 0; frame < 500; frame++) {
         for (uint32_t y = 0; y < height; y++) {
             for (uint32_t x = 0; x < width; x++) {
@@ -87,9 +99,10 @@ void graphics_animate_color_wave(void) {
                 graphics_put_pixel(x, y, color);
             }
         }
-        // Frame rate control
-        graphics_delay(100000);
+        graphics_swap_buffers();
+        graphics_pacer_wait(&pacer);
     }
+    graphics_pacer_report(&pacer, "color wave");
 }
 
 // Rotating rectangles
@@ -102,6 +115,8 @@ void graphics_animate_rotating_rects(void) {
     uint32_t cx = width / 2;
     uint32_t cy = height / 2;
 
+    graphics_pacer_t pacer;
+    graphics_pacer_start(&pacer, DEMO_FPS);
     for (int frame = 0; frame < 360; frame += 2) {
         graphics_clear_screen(COLOR_BLACK);
 
@@ -131,7 +146,8 @@ void graphics_animate_rotating_rects(void) {
 
         // draw center text
         graphics_draw_string(cx - 50, cy, "XG OS", COLOR_WHITE, COLOR_BLACK);
-
-        graphics_delay(50000);
+        graphics_swap_buffers();
+        graphics_pacer_wait(&pacer);
     }
+    graphics_pacer_report(&pacer, "rotating rects");
 }
@@ -0,0 +1,462 @@
+#include "memory.h"
+#include "console.h"
+#include "kstring.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// kernel heap: objects are carved out of slabs of naturally aligned frame
+// blocks from the buddy allocator. typed caches (kmem_cache) hold one object
+// size each; kmalloc() uses a fixed set of power-of-two caches from 16 B to
+// 2 KiB and takes larger requests straight from the buddy allocator.
+// kmalloc slabs and large blocks start on a 16 KiB boundary with a header,
+// so kfree() finds the owner by masking the pointer. caches of large-aligned
+// objects keep the slab header off-slab in a kmalloc'd descriptor, found
+// through a per-cache hash of slab addresses.
+
+#define HEAP_SLAB_ORDER 2
+#define HEAP_SLAB_SIZE (4096UL << HEAP_SLAB_ORDER)
+#define HEAP_MIN_SHIFT 4
+#define HEAP_MAX_SHIFT 11
+#define HEAP_NUM_CLASSES (HEAP_MAX_SHIFT - HEAP_MIN_SHIFT + 1)
+#define HEAP_MAX_CLASS_SIZE (1UL << HEAP_MAX_SHIFT)
+#define HEAP_HEADER_SIZE 64
+
+#define HEAP_SLAB_MAGIC 0x534C4142u  // "SLAB"
+#define HEAP_LARGE_MAGIC 0x4C415247u // "LARG"
+
+// largest slab order a cache will pick to keep waste under 1/8
+#define KMEM_MAX_SLAB_ORDER 6
+// above this alignment an on-slab header padded to the alignment alone
+// would waste more than 1/8 of an order-0 slab
+#define KMEM_MAX_ON_SLAB_ALIGN 512
+
+typedef struct heap_slab {
+    uint32_t magic;
+    uint32_t inuse;
+    uint32_t capacity;
+    void *free_list; // next-pointers are stored in the free objects
+    kmem_cache_t *cache;
+    struct heap_slab *next;
+    struct heap_slab *prev;
+    uintptr_t base;  // start of the slab's frames
+} heap_slab_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t order;
+    size_t size;
+} heap_large_t;
+
+struct kmem_cache {
+    const char *name;
+    size_t size;         // object stride, a multiple of align
+    size_t align;
+    uint32_t slab_order;
+    uint32_t first;      // offset of the first object in a slab
+    uint32_t per_slab;
+    kmem_ctor_t ctor;
+    heap_slab_t *partial; // slabs with at least one free object
+    heap_slab_t *empty;   // one fully free slab kept to avoid frame churn
+    uint64_t slabs;
+    uint64_t inuse;
+    uint64_t capacity;
+    uint64_t hits;        // allocations served from an existing slab
+    uint64_t misses;      // allocations that needed a new slab
+    kmem_cache_t *next;
+    bool off_slab;        // slab headers are kmalloc'd descriptors
+    heap_slab_t **slab_table; // off-slab descriptors by base, linear probing
+    uint32_t table_size;  // power of two, 0 before the first slab
+    uint32_t table_used;
+};
+
+static_assert(sizeof(heap_slab_t) <= HEAP_HEADER_SIZE, "slab header too large");
+
+// kmalloc caches: 16 KiB slabs, objects start right after the 64 byte header
+#define KMALLOC_CACHE(sz) { \
+    .name = "kmalloc-" #sz, .size = sz, .align = (sz) < 64 ? (sz) : 64, \
+    .slab_order = HEAP_SLAB_ORDER, .first = HEAP_HEADER_SIZE, \
+    .per_slab = (uint32_t) ((HEAP_SLAB_SIZE - HEAP_HEADER_SIZE) / (sz)), .ctor = nullptr, \
+    .partial = nullptr, .empty = nullptr, .slabs = 0, .inuse = 0, .capacity = 0, \
+    .hits = 0, .misses = 0, .next = nullptr, .off_slab = false, .slab_table = nullptr, \
+    .table_size = 0, .table_used = 0 }
+
+static kmem_cache_t kmalloc_caches[HEAP_NUM_CLASSES] = {
+    KMALLOC_CACHE(16), KMALLOC_CACHE(32), KMALLOC_CACHE(64), KMALLOC_CACHE(128),
+    KMALLOC_CACHE(256), KMALLOC_CACHE(512), KMALLOC_CACHE(1024), KMALLOC_CACHE(2048),
+};
+
+// caches created with kmem_cache_create(), for stats
+static kmem_cache_t *kmem_cache_list = nullptr;
+
+// global counters
+static uint64_t heap_live_bytes = 0;  // bytes handed out by kmalloc, rounded to class size
+static uint64_t heap_slab_bytes = 0;  // bytes held in slabs of all caches
+static uint64_t heap_large_bytes = 0; // bytes held by large objects
+static uint64_t heap_large_count = 0;
+
+// smallest class index whose object size holds size bytes
+static inline unsigned int heap_class_index(size_t size) {
+    if (size <= (1UL << HEAP_MIN_SHIFT)) return 0;
+    return (64 - __builtin_clzll(size - 1)) - HEAP_MIN_SHIFT;
+}
+
+static inline size_t heap_slab_size(kmem_cache_t *cache) {
+    return 4096UL << cache->slab_order;
+}
+
+static void heap_partial_push(kmem_cache_t *cache, heap_slab_t *slab) {
+    slab->prev = nullptr;
+    slab->next = cache->partial;
+    if (cache->partial) cache->partial->prev = slab;
+    cache->partial = slab;
+}
+
+static void heap_partial_remove(kmem_cache_t *cache, heap_slab_t *slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else cache->partial = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->next = slab->prev = nullptr;
+}
+
+// off-slab descriptors are found by the address of their slab
+static inline uint32_t heap_slab_hash(kmem_cache_t *cache, uintptr_t base) {
+    uint64_t key = base >> (12 + cache->slab_order);
+    return (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32) & (cache->table_size - 1);
+}
+
+static heap_slab_t *heap_slab_lookup(kmem_cache_t *cache, uintptr_t base) {
+    if (!cache->table_size) return nullptr;
+    uint32_t mask = cache->table_size - 1;
+    for (uint32_t i = heap_slab_hash(cache, base);; i = (i + 1) & mask) {
+        heap_slab_t *slab = cache->slab_table[i];
+        if (!slab || slab->base == base) return slab;
+    }
+}
+
+static void heap_slab_place(kmem_cache_t *cache, heap_slab_t *slab) {
+    uint32_t mask = cache->table_size - 1;
+    uint32_t i = heap_slab_hash(cache, slab->base);
+    while (cache->slab_table[i]) i = (i + 1) & mask;
+    cache->slab_table[i] = slab;
+}
+
+// record an off-slab descriptor, keeping the table at most half full
+static bool heap_slab_insert(kmem_cache_t *cache, heap_slab_t *slab) {
+    if ((cache->table_used + 1) * 2 > cache->table_size) {
+        uint32_t size = cache->table_size ? cache->table_size * 2 : 16;
+        heap_slab_t **table = (heap_slab_t **) kcalloc(size, sizeof(heap_slab_t *));
+        if (!table) return false;
+        heap_slab_t **old = cache->slab_table;
+        uint32_t old_size = cache->table_size;
+        cache->slab_table = table;
+        cache->table_size = size;
+        for (uint32_t i = 0; i < old_size; ++i) {
+            if (old[i]) heap_slab_place(cache, old[i]);
+        }
+        kfree(old);
+    }
+    heap_slab_place(cache, slab);
+    cache->table_used++;
+    return true;
+}
+
+// drop an off-slab descriptor, shifting later entries of its probe run back
+// into the hole so lookups never need tombstones
+static void heap_slab_remove(kmem_cache_t *cache, heap_slab_t *slab) {
+    heap_slab_t **table = cache->slab_table;
+    uint32_t mask = cache->table_size - 1;
+    uint32_t hole = heap_slab_hash(cache, slab->base);
+    while (table[hole] != slab) hole = (hole + 1) & mask;
+    for (uint32_t j = (hole + 1) & mask; table[j]; j = (j + 1) & mask) {
+        // the entry at j may fill the hole unless its home slot lies after it
+        uint32_t home = heap_slab_hash(cache, table[j]->base);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            table[hole] = table[j];
+            hole = j;
+        }
+    }
+    table[hole] = nullptr;
+    cache->table_used--;
+}
+
+// get a slab with free objects for a cache, refilling from frames if needed
+static heap_slab_t *heap_slab_refill(kmem_cache_t *cache) {
+    heap_slab_t *slab = cache->empty;
+    if (slab) {
+        cache->empty = nullptr;
+        heap_partial_push(cache, slab);
+        cache->hits++;
+        return slab;
+    }
+
+    uint64_t frame = frames_alloc(cache->slab_order);
+    if (!frame) {
+        kprintf("%s: out of memory for %lu byte slab\n", cache->name, heap_slab_size(cache));
+        return nullptr;
+    }
+    uintptr_t base = (uintptr_t) phys_to_virt(frame);
+    if (cache->off_slab) {
+        slab = (heap_slab_t *) kmalloc(sizeof(heap_slab_t));
+        if (slab) slab->base = base;
+        if (!slab || !heap_slab_insert(cache, slab)) {
+            kprintf("%s: out of memory for slab descriptor\n", cache->name);
+            kfree(slab);
+            frames_free(frame, cache->slab_order);
+            return nullptr;
+        }
+    } else {
+        slab = (heap_slab_t *) base;
+        slab->base = base;
+    }
+    cache->misses++;
+
+    slab->magic = HEAP_SLAB_MAGIC;
+    slab->inuse = 0;
+    slab->capacity = cache->per_slab;
+    slab->cache = cache;
+
+    // thread the free list through the objects in address order,
+    // constructing each object once for the lifetime of the slab
+    uintptr_t obj = base + cache->first;
+    slab->free_list = (void *) obj;
+    for (uint32_t i = 0; i < slab->capacity; ++i, obj += cache->size) {
+        if (cache->ctor) cache->ctor((void *) obj, cache->size);
+        *(void **) obj = (i + 1 < slab->capacity) ? (void *) (obj + cache->size) : nullptr;
+    }
+
+    cache->slabs++;
+    cache->capacity += slab->capacity;
+    heap_slab_bytes += heap_slab_size(cache);
+    heap_partial_push(cache, slab);
+    return slab;
+}
+
+// create a cache of fixed-size objects; align 0 means cache-line aligned
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align, kmem_ctor_t ctor) {
+    if (!align) align = KMEM_CACHE_LINE;
+    if (align & (align - 1)) {
+        kprintf("kmem_cache_create: %s: alignment %lu is not a power of two\n", name, align);
+        return nullptr;
+    }
+    if (size < sizeof(void *)) size = sizeof(void *);
+    size = (size + align - 1) & ~(align - 1);
+
+    // past KMEM_MAX_ON_SLAB_ALIGN the header moves off-slab, so page tables
+    // get order-0 slabs with no waste instead of losing a page to it
+    bool off_slab = align > KMEM_MAX_ON_SLAB_ALIGN;
+    uint32_t first = off_slab ? 0 : (uint32_t) ((HEAP_HEADER_SIZE + align - 1) & ~(align - 1));
+    uint32_t order = 0;
+    for (;; ++order) {
+        if (order > KMEM_MAX_SLAB_ORDER) {
+            kprintf("kmem_cache_create: %s: object size %lu too large\n", name, size);
+            return nullptr;
+        }
+        size_t slab_bytes = 4096UL << order;
+        if (slab_bytes < first + size) continue;
+        size_t waste = slab_bytes - (slab_bytes - first) / size * size;
+        if (waste * 8 <= slab_bytes) break;
+    }
+
+    kmem_cache_t *cache = (kmem_cache_t *) kcalloc(1, sizeof(kmem_cache_t));
+    if (!cache) return nullptr;
+    cache->name = name;
+    cache->size = size;
+    cache->align = align;
+    cache->slab_order = order;
+    cache->first = first;
+    cache->per_slab = (uint32_t) (((4096UL << order) - first) / size);
+    cache->ctor = ctor;
+    cache->off_slab = off_slab;
+    cache->next = kmem_cache_list;
+    kmem_cache_list = cache;
+    return cache;
+}
+
+// allocate one object; for caches with a constructor it is in the state the
+// constructor left it in, except that the first pointer-sized word is zeroed
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    heap_slab_t *slab = cache->partial;
+    if (slab) {
+        cache->hits++;
+    } else {
+        slab = heap_slab_refill(cache);
+        if (!slab) return nullptr;
+    }
+
+    void *obj = slab->free_list;
+    slab->free_list = *(void **) obj;
+    slab->inuse++;
+    if (!slab->free_list) heap_partial_remove(cache, slab);
+    cache->inuse++;
+    // the free-list link overwrote the first word of the constructed object
+    if (cache->ctor) *(void **) obj = nullptr;
+    return obj;
+}
+
+// return an object to its cache
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    if (!obj) return;
+
+    uintptr_t base = (uintptr_t) obj & ~(heap_slab_size(cache) - 1);
+    heap_slab_t *slab = cache->off_slab ? heap_slab_lookup(cache, base) : (heap_slab_t *) base;
+    if (!slab || slab->magic != HEAP_SLAB_MAGIC || slab->cache != cache) {
+        kprintf("kmem_cache_free: %s: bad pointer %p\n", cache->name, obj);
+        return;
+    }
+
+    *(void **) obj = slab->free_list;
+    slab->free_list = obj;
+    if (slab->inuse == slab->capacity) heap_partial_push(cache, slab); // was full
+    slab->inuse--;
+    cache->inuse--;
+
+    if (slab->inuse == 0) {
+        heap_partial_remove(cache, slab);
+        if (!cache->empty) {
+            cache->empty = slab;
+            return;
+        }
+        // already caching an empty slab; give the frames back
+        cache->slabs--;
+        cache->capacity -= slab->capacity;
+        heap_slab_bytes -= heap_slab_size(cache);
+        slab->magic = 0;
+        if (cache->off_slab) {
+            heap_slab_remove(cache, slab);
+            kfree(slab);
+        }
+        frames_free(virt_to_phys((void *) base), cache->slab_order);
+    }
+}
+
+// constructor for caches whose objects are handed out zeroed
+void kmem_ctor_zero(void *obj, size_t size) {
+    kmemset(obj, 0, size);
+}
+
+static void *heap_alloc_large(size_t size) {
+    unsigned int order = HEAP_SLAB_ORDER;
+    while ((4096UL << order) < size + HEAP_HEADER_SIZE) {
+        if (++order > FRAME_MAX_ORDER) return nullptr;
+    }
+
+    uint64_t frame = frames_alloc(order);
+    if (!frame) {
+        kprintf("kmalloc: out of memory for %lu byte object\n", size);
+        return nullptr;
+    }
+
+    heap_large_t *hdr = (heap_large_t *) phys_to_virt(frame);
+    hdr->magic = HEAP_LARGE_MAGIC;
+    hdr->order = order;
+    hdr->size = size;
+    heap_large_bytes += 4096UL << order;
+    heap_large_count++;
+    heap_live_bytes += size;
+    return (uint8_t *) hdr + HEAP_HEADER_SIZE;
+}
+
+// allocate size bytes from the kernel heap
+void *kmalloc(size_t size) {
+    if (!size) return nullptr;
+    if (size > HEAP_MAX_CLASS_SIZE) return heap_alloc_large(size);
+
+    kmem_cache_t *cache = &kmalloc_caches[heap_class_index(size)];
+    void *obj = kmem_cache_alloc(cache);
+    if (obj) heap_live_bytes += cache->size;
+    return obj;
+}
+
+// free memory returned by kmalloc/kcalloc/krealloc
+void kfree(void *ptr) {
+    if (!ptr) return;
+
+    uintptr_t base = (uintptr_t) ptr & ~(HEAP_SLAB_SIZE - 1);
+    heap_slab_t *slab = (heap_slab_t *) base;
+
+    if (slab->magic == HEAP_LARGE_MAGIC) {
+        heap_large_t *hdr = (heap_large_t *) base;
+        heap_large_bytes -= 4096UL << hdr->order;
+        heap_large_count--;
+        heap_live_bytes -= hdr->size;
+        hdr->magic = 0;
+        frames_free(virt_to_phys((void *) base), hdr->order);
+        return;
+    }
+
+    if (slab->magic != HEAP_SLAB_MAGIC) {
+        kprintf("kfree: bad pointer %p\n", ptr);
+        return;
+    }
+
+    heap_live_bytes -= slab->cache->size;
+    kmem_cache_free(slab->cache, ptr);
+}
+
+// number of bytes usable at ptr
+static size_t heap_usable_size(void *ptr) {
+    uintptr_t base = (uintptr_t) ptr & ~(HEAP_SLAB_SIZE - 1);
+    heap_slab_t *slab = (heap_slab_t *) base;
+    if (slab->magic == HEAP_LARGE_MAGIC) {
+        return (4096UL << ((heap_large_t *) base)->order) - HEAP_HEADER_SIZE;
+    }
+    return slab->cache->size;
+}
+
+// resize an allocation, moving it if it no longer fits
+void *krealloc(void *ptr, size_t size) {
+    if (!ptr) return kmalloc(size);
+    if (!size) {
+        kfree(ptr);
+        return nullptr;
+    }
+
+    size_t old_size = heap_usable_size(ptr);
+    if (size <= old_size) return ptr;
+
+    void *new_ptr = kmalloc(size);
+    if (!new_ptr) return nullptr;
+    kmemcpy(new_ptr, ptr, old_size);
+    kfree(ptr);
+    return new_ptr;
+}
+
+// allocate zeroed memory for count objects of size bytes
+void *kcalloc(size_t count, size_t size) {
+    if (size && count > (size_t) -1 / size) return nullptr;
+    size_t total = count * size;
+    void *ptr = kmalloc(total);
+    if (!ptr) return nullptr;
+    return kmemset(ptr, 0, total);
+}
+
+static void kmem_cache_print(kmem_cache_t *cache) {
+    kprintf("  %s: size=%lu slabs=%lu objects=%lu/%lu (%lu%%) hits=%lu misses=%lu\n",
+            cache->name, cache->size, cache->slabs, cache->inuse, cache->capacity,
+            cache->inuse * 100 / cache->capacity, cache->hits, cache->misses);
+}
+
+// print heap usage: live bytes, per-class occupancy and fragmentation
+void heap_dump_stats(void) {
+    uint64_t kmalloc_slab_bytes = 0;
+    for (unsigned int i = 0; i < HEAP_NUM_CLASSES; ++i) {
+        kmalloc_slab_bytes += kmalloc_caches[i].slabs * HEAP_SLAB_SIZE;
+    }
+    uint64_t held = kmalloc_slab_bytes + heap_large_bytes;
+    kprintf("[Heap] live=%lu bytes held=%lu bytes (slabs %lu, large %lu in %lu objects)\n",
+            heap_live_bytes, held, kmalloc_slab_bytes, heap_large_bytes, heap_large_count);
+    for (unsigned int i = 0; i < HEAP_NUM_CLASSES; ++i) {
+        if (kmalloc_caches[i].slabs) kmem_cache_print(&kmalloc_caches[i]);
+    }
+    // share of held memory not handed out: free slots, slab headers, page rounding
+    if (held) kprintf("  fragmentation=%lu%%\n", (held - heap_live_bytes) * 100 / held);
+}
+
+// print hit/miss statistics of every cache made with kmem_cache_create()
+void kmem_cache_dump_stats(void) {
+    kprintf("[Caches] slab memory=%lu bytes\n", heap_slab_bytes);
+    for (kmem_cache_t *cache = kmem_cache_list; cache; cache = cache->next) {
+        if (cache->slabs) kmem_cache_print(cache);
+        else kprintf("  %s: size=%lu empty\n", cache->name, cache->size);
+    }
+}
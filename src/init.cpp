@@ -1,5 +1,6 @@
 // C++ initialization call global constructors
 #include <stddef.h>
+#include "boot_trace.h"
 
 extern "C" {
 using ctor_t = void (*)();
@@ -7,8 +8,10 @@ extern ctor_t __init_array_start[];
 extern ctor_t __init_array_end[];
 
 void init_global_ctors() {
+    boot_trace("boot.asm");
     for (ctor_t *ctor = __init_array_start; ctor < __init_array_end; ++ctor) {
         (*ctor)();
     }
+    boot_trace("ctors");
 }
 }
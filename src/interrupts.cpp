@@ -0,0 +1,142 @@
+#include "interrupts.h"
+#include "console.h"
+#include "io.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define IDT_ENTRIES 256
+#define IDT_STUBS (IRQ_BASE + IRQ_COUNT)
+#define IDT_INTERRUPT_GATE 0x8E // present, ring 0, 64-bit interrupt gate
+
+// 8259 PIC ports and commands
+#define PIC1_CMD 0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0B
+#define PIC_ICW1_INIT 0x11 // edge triggered, cascade, ICW4 follows
+#define PIC_ICW4_8086 0x01
+
+typedef struct __attribute__((packed)) {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t reserved;
+} idt_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t limit;
+    uint64_t base;
+} idt_pointer_t;
+
+extern "C" const uint64_t isr_stub_table[IDT_STUBS];
+
+static idt_entry_t idt[IDT_ENTRIES] __attribute__((aligned(16)));
+static interrupt_handler_t handlers[IDT_STUBS];
+static uint16_t irq_mask = 0xFFFF;
+
+static const char *const exception_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range", "invalid opcode",
+    "device not available", "double fault", "coprocessor overrun", "invalid TSS", "segment not present",
+    "stack fault", "general protection", "page fault", "reserved", "x87 error", "alignment check",
+    "machine check", "SIMD error", "virtualization", "control protection", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved", "hypervisor injection", "VMM communication",
+    "security", "reserved",
+};
+
+static void pic_write_mask(void) {
+    outb(PIC1_DATA, (uint8_t) irq_mask);
+    outb(PIC2_DATA, (uint8_t) (irq_mask >> 8));
+}
+
+static void pic_init(void) {
+    outb(PIC1_CMD, PIC_ICW1_INIT);
+    outb(PIC2_CMD, PIC_ICW1_INIT);
+    outb(PIC1_DATA, IRQ_BASE); // ICW2: vector offsets
+    outb(PIC2_DATA, IRQ_BASE + 8);
+    outb(PIC1_DATA, 0x04); // ICW3: slave on IRQ2
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, PIC_ICW4_8086);
+    outb(PIC2_DATA, PIC_ICW4_8086);
+    pic_write_mask();
+}
+
+// IRQ 7 and 15 also fire spuriously; a real one is set in the in-service register
+static bool irq_is_spurious(uint8_t irq) {
+    if (irq != 7 && irq != 15) return false;
+    uint16_t port = irq == 7 ? PIC1_CMD : PIC2_CMD;
+    outb(port, PIC_READ_ISR);
+    return !(inb(port) & 0x80);
+}
+
+static void irq_eoi(uint8_t irq) {
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+extern "C" void interrupt_dispatch(interrupt_frame_t *frame) {
+    uint64_t vector = frame->vector;
+
+    if (vector >= IRQ_BASE) {
+        uint8_t irq = (uint8_t) (vector - IRQ_BASE);
+        if (irq_is_spurious(irq)) {
+            // a spurious IRQ 15 still needs the master acknowledged
+            if (irq == 15) outb(PIC1_CMD, PIC_EOI);
+            return;
+        }
+        if (handlers[vector]) handlers[vector](frame);
+        irq_eoi(irq);
+        return;
+    }
+
+    if (handlers[vector]) {
+        handlers[vector](frame);
+        return;
+    }
+    kprintf("exception %lu (%s), error 0x%lx at rip 0x%lx, rsp 0x%lx\n", vector, exception_names[vector],
+            frame->error_code, frame->rip, frame->rsp);
+    if (vector == 14) {
+        uint64_t cr2;
+        asm volatile("mov %%cr2, %0" : "=r"(cr2));
+        kprintf("  faulting address 0x%lx\n", cr2);
+    }
+    panic("unhandled exception");
+}
+
+void interrupts_init(void) {
+    uint16_t cs;
+    asm volatile("mov %%cs, %0" : "=r"(cs));
+
+    for (uint32_t v = 0; v < IDT_STUBS; v++) {
+        uint64_t addr = isr_stub_table[v];
+        idt[v].offset_low = (uint16_t) addr;
+        idt[v].selector = cs;
+        idt[v].ist = 0;
+        idt[v].type_attr = IDT_INTERRUPT_GATE;
+        idt[v].offset_mid = (uint16_t) (addr >> 16);
+        idt[v].offset_high = (uint32_t) (addr >> 32);
+        idt[v].reserved = 0;
+    }
+
+    idt_pointer_t ptr = {sizeof(idt) - 1, (uint64_t) (uintptr_t) idt};
+    asm volatile("lidt %0" : : "m"(ptr));
+    pic_init();
+    kprintf("interrupts: IDT loaded, PIC remapped to vectors %u-%u\n", IRQ_BASE, IRQ_BASE + IRQ_COUNT - 1);
+}
+
+void interrupts_set_handler(uint8_t vector, interrupt_handler_t handler) {
+    if (vector < IDT_STUBS) handlers[vector] = handler;
+}
+
+void irq_set_handler(uint8_t irq, interrupt_handler_t handler) {
+    if (irq >= IRQ_COUNT) return;
+    handlers[IRQ_BASE + irq] = handler;
+    irq_mask &= (uint16_t) ~(1u << irq);
+    // the slave's lines reach the CPU through the cascade on IRQ 2
+    if (irq >= 8) irq_mask &= (uint16_t) ~(1u << 2);
+    pic_write_mask();
+}
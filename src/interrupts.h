@@ -0,0 +1,45 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// vectors 0-31 are CPU exceptions; the two 8259 PICs are remapped to 32-47
+#define IRQ_BASE 0x20
+#define IRQ_COUNT 16
+#define IRQ_COM1 4
+
+// register state saved by the entry stubs in isr.asm
+typedef struct {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error_code; // 0 for vectors without one
+    uint64_t rip, cs, rflags, rsp, ss; // pushed by the CPU
+} interrupt_frame_t;
+
+typedef void (*interrupt_handler_t)(interrupt_frame_t *frame);
+
+// load the IDT and remap the PICs with every IRQ masked. interrupts stay
+// disabled until interrupts_enable()
+void interrupts_init(void);
+
+// handle an exception vector; unhandled exceptions panic
+void interrupts_set_handler(uint8_t vector, interrupt_handler_t handler);
+
+// handle a PIC interrupt line and unmask it. the line is acknowledged after
+// the handler returns
+void irq_set_handler(uint8_t irq, interrupt_handler_t handler);
+
+static inline void interrupts_enable(void) {
+    asm volatile("sti" : : : "memory");
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INTERRUPTS_H
@@ -0,0 +1,18 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdint.h>
+
+// x86 port I/O
+
+static inline void outb(uint16_t port, uint8_t value) {
+    asm volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+#endif // IO_H
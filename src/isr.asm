@@ -0,0 +1,73 @@
+; Interrupt entry stubs for XG OS
+; Every vector gets a stub that pushes the vector number (and a zero where the
+; CPU pushes no error code), saves the general registers and calls
+; interrupt_dispatch(interrupt_frame_t *) from interrupts.cpp
+bits 64
+
+section .text
+    extern interrupt_dispatch
+    global isr_stub_table
+
+; exceptions for which the CPU pushes an error code
+%define HAS_ERROR_CODE(v) ((v) == 8 || ((v) >= 10 && (v) <= 14) || (v) == 17 || (v) == 21 || (v) == 29 || (v) == 30)
+
+%assign i 0
+%rep 48
+isr_stub_%+i:
+%if !HAS_ERROR_CODE(i)
+    push 0
+%endif
+    push i
+    jmp isr_common
+%assign i i + 1
+%endrep
+
+isr_common:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    ; the CPU aligned rsp to 16 before its 5-word frame; with the 2 words
+    ; pushed by the stub and 15 registers it is aligned again for the call
+    mov rdi, rsp
+    cld
+    call interrupt_dispatch
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    add rsp, 16 ; vector and error code
+    iretq
+
+section .rodata
+    align 8
+isr_stub_table:
+%assign i 0
+%rep 48
+    dq isr_stub_%+i
+%assign i i + 1
+%endrep
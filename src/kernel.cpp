@@ -1,9 +1,17 @@
 #include <stdint.h>
+#include "bench.h"
+#include "boot_trace.h"
 #include "console.h"
+#include "cpu.h"
+#include "fbcon.h"
+#include "kstring.h"
 #include "memory.h"
 #include "paging.h"
+#include "serial.h"
+#include "time.h"
 #include "graphics.h"
 #include "graphics_demo.h"
+#include "interrupts.h"
 
 // early debug function to write directly to VGA memory
 static void early_print(const char *msg) {
@@ -18,6 +26,21 @@ static void early_print(const char *msg) {
 // Multiboot loader magic value passed in RAX
 static const uint32_t MULTIBOOT_MAGIC = 0x2BADB002;
 
+// whether the space-separated command line contains word
+static bool cmdline_has(const char *cmdline, const char *word) {
+    while (*cmdline) {
+        while (*cmdline == ' ') cmdline++;
+        const char *w = word;
+        while (*w && *cmdline == *w) {
+            cmdline++;
+            w++;
+        }
+        if (!*w && (*cmdline == ' ' || !*cmdline)) return true;
+        while (*cmdline && *cmdline != ' ') cmdline++;
+    }
+    return false;
+}
+
 extern "C" void kernel_main(uint64_t magic, uint64_t mbi_addr) {
     early_print("64BIT START");
 
@@ -29,13 +52,41 @@ extern "C" void kernel_main(uint64_t magic, uint64_t mbi_addr) {
 
     early_print("MAGIC OK");
 
-    // memory management
+    // console output to COM1 as well, polled until interrupts are up
+    serial_init();
+    bool bench_mode = cmdline_has(multiboot_cmdline((uint32_t) mbi_addr), "bench");
+    boot_trace("serial");
+
+    // CPU features and FPU/SSE/AVX state
+    cpu_init();
+    kstring_init();
+    boot_trace("cpu_init");
+
+    // exceptions and IRQs; serial output drains from its interrupt from here on
+    interrupts_init();
+    serial_enable_irq();
+    interrupts_enable();
+    boot_trace("interrupts_init");
+
+    // memory management; traces its own sub-phases
     memory_init((uint32_t) mbi_addr);
 
     early_print("MEM OK");
 
+#ifdef XGOS_BOOT_BENCH
+    if (!bench_mode) {
+        memory_benchmark();
+        boot_trace("memory_benchmark");
+    }
+#endif
+
     // set up advanced paging
     paging_init();
+    boot_trace("paging_init");
+
+    // calibrated clock; the HPET registers need the page tables
+    time_init();
+    boot_trace("time_init");
 
     early_print("PAGE OK");
 
@@ -50,11 +101,19 @@ extern "C" void kernel_main(uint64_t magic, uint64_t mbi_addr) {
         framebuffer_get_info((uint32_t) mbi_addr, &fb_addr, &fb_width, 
                            &fb_height, &fb_pitch, &fb_bpp);
         
+        // channel layout as the boot loader set the mode up
+        uint8_t fb_position[3], fb_channel_size[3];
+        framebuffer_get_channels((uint32_t) mbi_addr, fb_position, fb_channel_size);
+        graphics_pixel_format_t fb_format;
+        bool fb_format_ok = graphics_pixel_format_init(&fb_format, fb_bpp, fb_position[0], fb_channel_size[0],
+                                                       fb_position[1], fb_channel_size[1], fb_position[2],
+                                                       fb_channel_size[2]) == 0;
+        
         early_print("FB INFO");
         
         // validate framebuffer parameters before proceeding
         if (fb_addr < 0x100000 || fb_width == 0 || fb_height == 0 || 
-            fb_pitch == 0 || fb_bpp != 32) {
+            fb_pitch == 0 || !fb_format_ok) {
             early_print("FB BAD PARAMS");
         } else {
             uint64_t fb_size = (uint64_t)fb_pitch * fb_height;
@@ -62,28 +121,49 @@ extern "C" void kernel_main(uint64_t magic, uint64_t mbi_addr) {
             // map framebuffer to virtual memory
             if (paging_map_framebuffer(fb_addr, fb_size) == 0) {
                 early_print("FB MAPPED");
+                boot_trace("framebuffer_map");
                 
                 uint32_t *fb_ptr = (uint32_t *) fb_addr;
                 
-                if (graphics_init_simple(fb_ptr, fb_width, fb_height, fb_pitch, fb_bpp) == 0) {
+                if (graphics_init_simple(fb_ptr, fb_width, fb_height, fb_pitch, &fb_format) == 0) {
                     early_print("GFX INIT OK");
                     
                     if (graphics_test_framebuffer() == 0) {
                         early_print("FB TEST OK");
+                        boot_trace("graphics_init");
+                        // kernel messages on screen until the demos take it over
+                        fbcon_init();
+                        boot_trace_dump();
+                        if (bench_mode) {
+                            fbcon_release();
+                            bench_run_and_exit();
+                        }
+
+#ifdef XGOS_BOOT_BENCH
+                        graphics_benchmark();
+#endif
+                        fbcon_release();
                         
                         // clear screen and show initial message
                         graphics_clear_screen(COLOR_BLACK);
                         graphics_draw_string(10, 10, "XG OS Graphics Mode - Starting Animation...", COLOR_WHITE, COLOR_BLACK);
-                        graphics_delay(1000000);
+                        graphics_swap_buffers();
+                        graphics_delay(1000000); // show it for a second
                         
                         // run bouncing ball animation
                         graphics_animate_bouncing_ball();
+
+                        const graphics_frame_stats_t *stats = graphics_get_frame_stats();
+                        kprintf("graphics: %lu frames, last frame %lu VRAM bytes, %lu cycles (swap %lu)\n",
+                                stats->frames, stats->last_vram_bytes, stats->last_frame_cycles,
+                                stats->last_swap_cycles);
                         
                         // after animation, show final screen
                         graphics_clear_screen(COLOR_BLUE);
                         graphics_draw_rect(50, 50, 200, 100, COLOR_WHITE);
                         graphics_draw_string(60, 70, "XG OS Graphics Demo", COLOR_BLACK, COLOR_WHITE);
                         graphics_draw_string(60, 90, "Animation Complete!", COLOR_BLACK, COLOR_WHITE);
+                        graphics_swap_buffers();
                         
                         early_print("ANIMATION DONE");
                         
@@ -104,10 +184,18 @@ extern "C" void kernel_main(uint64_t magic, uint64_t mbi_addr) {
         early_print("NO FB");
     }
 
+    // no usable framebuffer; the suite skips the graphics part
+    boot_trace("framebuffer_setup");
+    if (bench_mode) {
+        boot_trace_dump();
+        bench_run_and_exit();
+    }
+
     clear();
     set_color(VGA_COLOR_RED);
     kprintf("Hello from XG OS 64-bit!\n");
     kprintf("Running in long mode\n");
+    boot_trace_dump();
     for (;;) {
     }
 }
@@ -0,0 +1,244 @@
+#include "kformat.h"
+#include "kstring.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLAG_LEFT 0x01
+#define FLAG_ZERO 0x02
+#define FLAG_PLUS 0x04
+#define FLAG_SPACE 0x08
+#define FLAG_ALT 0x10
+
+static void out_write(kformat_out_t *out, const char *s, size_t n) {
+    while (n) {
+        size_t room = out->size - out->len;
+        if (!room) {
+            if (!out->flush) return;
+            out->flush(out);
+            room = out->size - out->len;
+        }
+        size_t k = n < room ? n : room;
+        kmemcpy(out->buf + out->len, s, k);
+        out->len += k;
+        s += k;
+        n -= k;
+    }
+}
+
+static void out_fill(kformat_out_t *out, char c, size_t n) {
+    while (n) {
+        size_t room = out->size - out->len;
+        if (!room) {
+            if (!out->flush) return;
+            out->flush(out);
+            room = out->size - out->len;
+        }
+        size_t k = n < room ? n : room;
+        kmemset(out->buf + out->len, c, k);
+        out->len += k;
+        n -= k;
+    }
+}
+
+// digits of v in base 8, 10 or 16, written backwards from end; returns the
+// first digit. the decimal case divides by a constant, which compiles to a
+// multiply
+static char *format_digits(char *end, uint64_t v, unsigned base, bool upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *p = end;
+    if (base == 10) {
+        while (v >= 10) {
+            *--p = (char) ('0' + v % 10);
+            v /= 10;
+        }
+        *--p = (char) ('0' + v);
+    } else if (base == 16) {
+        do {
+            *--p = digits[v & 15];
+            v >>= 4;
+        } while (v);
+    } else {
+        do {
+            *--p = (char) ('0' + (v & 7));
+            v >>= 3;
+        } while (v);
+    }
+    return p;
+}
+
+// emit a converted field: prefix (sign or 0x), precision zeros, body, with
+// the width padding on the side the flags ask for. returns characters emitted
+static size_t emit_field(kformat_out_t *out, const char *prefix, size_t prefix_len, size_t zeros,
+                         const char *body, size_t body_len, int flags, size_t width) {
+    size_t len = prefix_len + zeros + body_len;
+    size_t pad = width > len ? width - len : 0;
+    if (!(flags & FLAG_LEFT) && !(flags & FLAG_ZERO)) out_fill(out, ' ', pad);
+    out_write(out, prefix, prefix_len);
+    if (!(flags & FLAG_LEFT) && (flags & FLAG_ZERO)) out_fill(out, '0', pad);
+    out_fill(out, '0', zeros);
+    out_write(out, body, body_len);
+    if (flags & FLAG_LEFT) out_fill(out, ' ', pad);
+    return len + pad;
+}
+
+size_t kformat(kformat_out_t *out, const char *format, va_list args) {
+    size_t total = 0;
+    const char *p = format;
+    while (*p) {
+        // literal text up to the next conversion in one write
+        const char *start = p;
+        while (*p && *p != '%') p++;
+        if (p != start) {
+            out_write(out, start, (size_t) (p - start));
+            total += (size_t) (p - start);
+        }
+        if (!*p) break;
+        const char *spec = p++;
+
+        int flags = 0;
+        for (;; p++) {
+            if (*p == '-') flags |= FLAG_LEFT;
+            else if (*p == '0') flags |= FLAG_ZERO;
+            else if (*p == '+') flags |= FLAG_PLUS;
+            else if (*p == ' ') flags |= FLAG_SPACE;
+            else if (*p == '#') flags |= FLAG_ALT;
+            else break;
+        }
+
+        size_t width = 0;
+        if (*p == '*') {
+            int w = va_arg(args, int);
+            if (w < 0) {
+                flags |= FLAG_LEFT;
+                w = -w;
+            }
+            width = (size_t) w;
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9') width = width * 10 + (size_t) (*p++ - '0');
+        }
+
+        int precision = -1;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                precision = va_arg(args, int);
+                if (precision < 0) precision = -1;
+                p++;
+            } else {
+                precision = 0;
+                while (*p >= '0' && *p <= '9') precision = precision * 10 + (*p++ - '0');
+            }
+        }
+
+        // size of the argument in bytes
+        int size = 4;
+        if (*p == 'h') {
+            p++;
+            size = 2;
+            if (*p == 'h') {
+                p++;
+                size = 1;
+            }
+        } else if (*p == 'l') {
+            p++;
+            size = 8;
+            if (*p == 'l') p++;
+        } else if (*p == 'z' || *p == 't' || *p == 'j') {
+            p++;
+            size = 8;
+        }
+
+        char conv = *p;
+        if (conv) p++;
+        char buf[24];
+        char *end = buf + sizeof(buf);
+
+        switch (conv) {
+            case '%':
+                out_write(out, "%", 1);
+                total++;
+                break;
+            case 'c': {
+                char c = (char) va_arg(args, int);
+                total += emit_field(out, nullptr, 0, 0, &c, 1, flags & ~FLAG_ZERO, width);
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(args, const char *);
+                if (!s) s = "(null)";
+                size_t len = 0;
+                while (s[len] && (precision < 0 || len < (size_t) precision)) len++;
+                total += emit_field(out, nullptr, 0, 0, s, len, flags & ~FLAG_ZERO, width);
+                break;
+            }
+            case 'd':
+            case 'i': {
+                int64_t v;
+                if (size == 8) v = va_arg(args, int64_t);
+                else v = va_arg(args, int);
+                if (size == 2) v = (int16_t) v;
+                else if (size == 1) v = (int8_t) v;
+                uint64_t mag = v < 0 ? 0 - (uint64_t) v : (uint64_t) v;
+
+                const char *sign = v < 0 ? "-" : (flags & FLAG_PLUS) ? "+" : (flags & FLAG_SPACE) ? " " : "";
+                char *digits = (precision == 0 && !mag) ? end : format_digits(end, mag, 10, false);
+                size_t ndigits = (size_t) (end - digits);
+                size_t zeros = precision > 0 && (size_t) precision > ndigits ? (size_t) precision - ndigits : 0;
+                if (precision >= 0) flags &= ~FLAG_ZERO;
+                total += emit_field(out, sign, *sign ? 1 : 0, zeros, digits, ndigits, flags, width);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'p': {
+                uint64_t v;
+                if (conv == 'p') v = (uint64_t) (uintptr_t) va_arg(args, void *);
+                else if (size == 8) v = va_arg(args, uint64_t);
+                else v = va_arg(args, unsigned int);
+                if (size == 2) v = (uint16_t) v;
+                else if (size == 1) v = (uint8_t) v;
+
+                unsigned base = conv == 'u' ? 10 : conv == 'o' ? 8 : 16;
+                char *digits = (precision == 0 && !v) ? end : format_digits(end, v, base, conv == 'X');
+                size_t ndigits = (size_t) (end - digits);
+                size_t zeros = precision > 0 && (size_t) precision > ndigits ? (size_t) precision - ndigits : 0;
+
+                const char *prefix = "";
+                if (conv == 'p') prefix = "0x";
+                else if ((flags & FLAG_ALT) && v && conv == 'x') prefix = "0x";
+                else if ((flags & FLAG_ALT) && v && conv == 'X') prefix = "0X";
+                else if ((flags & FLAG_ALT) && conv == 'o' && !zeros && (ndigits == 0 || *digits != '0')) zeros = 1;
+
+                if (precision >= 0) flags &= ~FLAG_ZERO;
+                size_t prefix_len = prefix[0] ? 2 : 0;
+                total += emit_field(out, prefix, prefix_len, zeros, digits, ndigits, flags, width);
+                break;
+            }
+            default:
+                // unknown conversion: print it as written
+                out_write(out, spec, (size_t) (p - spec));
+                total += (size_t) (p - spec);
+                break;
+        }
+    }
+    return total;
+}
+
+int kvsnprintf(char *buf, size_t size, const char *format, va_list args) {
+    kformat_out_t out = {buf, size ? size - 1 : 0, 0, nullptr, nullptr};
+    size_t total = kformat(&out, format, args);
+    if (size) buf[out.len] = 0;
+    return (int) total;
+}
+
+int ksnprintf(char *buf, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = kvsnprintf(buf, size, format, args);
+    va_end(args);
+    return len;
+}
@@ -0,0 +1,41 @@
+#ifndef KFORMAT_H
+#define KFORMAT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// printf-style formatting for the kernel, in one pass over the format.
+// conversions: %d %i %u %x %X %o %c %s %p %%, with the flags - 0 + space #,
+// width and precision (both may be *), and the length modifiers hh h l ll z
+// t j. %p prints 0x and the address in hex. no floating point
+
+// formatted output goes to buf; when it fills up, flush is called to empty
+// it (and must reset len). with no flush the rest of the output is dropped
+typedef struct kformat_out {
+    char *buf;
+    size_t size;
+    size_t len;
+    void (*flush)(struct kformat_out *out);
+    void *ctx; // for flush
+} kformat_out_t;
+
+// format into out; returns the number of characters produced, including any
+// that were dropped
+size_t kformat(kformat_out_t *out, const char *format, va_list args);
+
+// like vsnprintf: at most size - 1 characters and a terminating NUL go to
+// buf (nothing when size is 0). returns the full length of the output
+int kvsnprintf(char *buf, size_t size, const char *format, va_list args);
+
+int ksnprintf(char *buf, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KFORMAT_H
@@ -0,0 +1,188 @@
+#include "klog.h"
+#include "console.h"
+#include "cpu.h"
+#include "kstring.h"
+#include "time.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// 1024 slots of 128 bytes: 128 KiB of log, up to ~110 KiB of text
+#define KLOG_SLOTS 1024
+#define KLOG_SLOT_SIZE 128
+#define KLOG_SLOT_TEXT (KLOG_SLOT_SIZE - 19)
+
+// a slot holds one message or a piece of a longer one. seq is the slot's
+// sequence number + 1 once the writer is done and 0 while it writes, so a
+// reader can tell a finished slot from one being filled or overwritten
+typedef struct {
+    volatile uint64_t seq;
+    uint64_t tsc;
+    uint8_t level;
+    uint8_t len;
+    uint8_t reserved;
+    char text[KLOG_SLOT_TEXT];
+} klog_slot_t;
+
+static_assert(sizeof(klog_slot_t) == KLOG_SLOT_SIZE, "klog slot size");
+
+static klog_slot_t slots[KLOG_SLOTS];
+// next sequence number to hand out
+static uint64_t klog_next = 0;
+// next sequence number the console has not seen
+static uint64_t render_next = 0;
+static uint32_t render_busy = 0;
+static uint32_t render_pending = 0;
+static klog_level_t console_level = KLOG_INFO;
+
+void klog_write(klog_level_t level, const char *s, size_t len) {
+    if (!len) return;
+    uint64_t tsc = cpu_rdtsc();
+    uint64_t count = (len + KLOG_SLOT_TEXT - 1) / KLOG_SLOT_TEXT;
+    uint64_t seq = __atomic_fetch_add(&klog_next, count, __ATOMIC_RELAXED);
+
+    for (uint64_t i = 0; i < count; i++, seq++) {
+        klog_slot_t *slot = &slots[seq % KLOG_SLOTS];
+        size_t n = len < KLOG_SLOT_TEXT ? len : KLOG_SLOT_TEXT;
+        __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        slot->tsc = tsc;
+        slot->level = (uint8_t) level;
+        slot->len = (uint8_t) n;
+        kmemcpy(slot->text, s, n);
+        __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+        s += n;
+        len -= n;
+    }
+}
+
+// copy slot seq out; false if it is not written yet or was overwritten
+static bool klog_read(uint64_t seq, klog_slot_t *out) {
+    const klog_slot_t *slot = &slots[seq % KLOG_SLOTS];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq + 1) return false;
+    out->tsc = slot->tsc;
+    out->level = slot->level;
+    out->len = slot->len;
+    kmemcpy(out->text, slot->text, out->len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq + 1;
+}
+
+// whether slot seq is still being written by someone who reserved it
+static bool klog_in_flight(uint64_t seq) {
+    return seq < __atomic_load_n(&klog_next, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&slots[seq % KLOG_SLOTS].seq, __ATOMIC_ACQUIRE) == 0;
+}
+
+static void klog_report_lost(uint64_t lost) {
+    char msg[48] = "[klog: ";
+    size_t len = 7;
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char) ('0' + lost % 10);
+        lost /= 10;
+    } while (lost);
+    while (n--) msg[len++] = digits[n];
+    const char *tail = " messages lost]\n";
+    while (*tail) msg[len++] = *tail++;
+    console_write(msg, len);
+}
+
+void klog_render(void) {
+    __atomic_store_n(&render_pending, 1, __ATOMIC_RELEASE);
+    // only one renderer at a time. a nested caller, say an interrupt logging
+    // during a render, leaves its messages pending for the running one, which
+    // loops until nothing is pending
+    while (__atomic_exchange_n(&render_pending, 0, __ATOMIC_ACQ_REL)) {
+        if (__atomic_exchange_n(&render_busy, 1, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&render_pending, 1, __ATOMIC_SEQ_CST);
+            // the renderer may have checked for pending work before the
+            // store; if it is gone, render here instead
+            if (__atomic_load_n(&render_busy, __ATOMIC_SEQ_CST)) return;
+            continue;
+        }
+
+        klog_slot_t slot;
+        uint64_t end = __atomic_load_n(&klog_next, __ATOMIC_ACQUIRE);
+        while (render_next < end) {
+            if (end - render_next > KLOG_SLOTS) {
+                klog_report_lost(end - KLOG_SLOTS - render_next);
+                render_next = end - KLOG_SLOTS;
+            }
+            if (!klog_read(render_next, &slot)) {
+                // reserved but not written: the writer was interrupted, and
+                // renders again when it is done
+                if (klog_in_flight(render_next)) break;
+                render_next++;
+                continue;
+            }
+            if (slot.level <= console_level) console_write(slot.text, slot.len);
+            render_next++;
+        }
+
+        __atomic_store_n(&render_busy, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+void klog_set_console_level(klog_level_t level) {
+    console_level = level;
+}
+
+klog_level_t klog_console_level(void) {
+    return console_level;
+}
+
+// "[seconds.micros] L " before each line of the dump
+static size_t klog_prefix(char *buf, uint64_t tsc, uint8_t level) {
+    static const char level_chars[] = "EWID";
+    // undivided cycles for messages logged before time_init()
+    uint64_t hz = time_tsc_hz();
+    uint64_t us = hz ? tsc / (hz / 1000000) : tsc;
+    uint64_t sec = us / 1000000;
+    uint64_t frac = us % 1000000;
+
+    size_t len = 0;
+    buf[len++] = '[';
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char) ('0' + sec % 10);
+        sec /= 10;
+    } while (sec);
+    while (n < 5) digits[n++] = ' ';
+    while (n--) buf[len++] = digits[n];
+    buf[len++] = '.';
+    for (uint64_t div = 100000; div; div /= 10) buf[len++] = (char) ('0' + frac / div % 10);
+    buf[len++] = ']';
+    buf[len++] = ' ';
+    buf[len++] = level < 4 ? level_chars[level] : '?';
+    buf[len++] = ' ';
+    return len;
+}
+
+void klog_dump(void) {
+    console_write("---- klog dump ----\n", 20);
+
+    uint64_t end = __atomic_load_n(&klog_next, __ATOMIC_ACQUIRE);
+    uint64_t seq = end > KLOG_SLOTS ? end - KLOG_SLOTS : 0;
+    bool line_start = true;
+    klog_slot_t slot;
+    char prefix[40];
+
+    for (; seq < end; seq++) {
+        if (!klog_read(seq, &slot)) continue;
+        // the prefix goes before every line start inside the slot
+        size_t from = 0;
+        for (size_t i = 0; i < slot.len; i++) {
+            if (line_start) {
+                console_write(slot.text + from, i - from);
+                console_write(prefix, klog_prefix(prefix, slot.tsc, slot.level));
+                from = i;
+            }
+            line_start = slot.text[i] == '\n';
+        }
+        console_write(slot.text + from, slot.len - from);
+    }
+    if (!line_start) console_write("\n", 1);
+    console_write("---- end of klog ----\n", 22);
+}
@@ -0,0 +1,47 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// kernel log: every message lands in a fixed ring of slots with its level
+// and TSC timestamp. appending is lock-free (one atomic add reserves the
+// slots) and safe from interrupt handlers. the console shows messages at or
+// above the console level, rendered from the ring after the append; lower
+// levels only cost the copy into the ring
+
+typedef enum {
+    KLOG_ERR = 0,
+    KLOG_WARN = 1,
+    KLOG_INFO = 2, // kprintf
+    KLOG_DEBUG = 3,
+} klog_level_t;
+
+// format and log a message. like kprintf, messages are fragments: a line may
+// be built from several calls and ends at '\n'
+void klog(klog_level_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// append len bytes of text at level
+void klog_write(klog_level_t level, const char *s, size_t len);
+
+// send messages that are not shown yet to the console sinks. a call made
+// while another one is rendering (from an interrupt) leaves the work to it
+void klog_render(void);
+
+// most verbose level shown on the console (default KLOG_INFO)
+void klog_set_console_level(klog_level_t level);
+klog_level_t klog_console_level(void);
+
+// print every message still in the ring, all levels, with timestamps,
+// straight to the console sinks (e.g. after a panic)
+void klog_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KLOG_H
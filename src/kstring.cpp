@@ -0,0 +1,301 @@
+#include "kstring.h"
+#include "kstring_simd.h"
+#include "cpu.h"
+#include "console.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// this file must be built with -fno-tree-loop-distribute-patterns, or GCC
+// turns the loops below back into calls to memcpy/memset
+
+// sizes below KSTRING_SMALL take the overlapping-move paths, sizes below
+// KSTRING_INLINE a 32-byte word loop; rep movs/stos start up too slowly to
+// win there
+#define KSTRING_SMALL 64
+#define KSTRING_INLINE 256
+
+// vector variants only run from this size up, so the register state save
+// in kernel_fpu_begin() stays a small fraction of the copy. with ERMS, rep
+// movsb/stosb are as fast as the vector loops once that save is counted
+// and are used for every size
+#define KSTRING_SIMD_MIN 4096
+
+typedef uint64_t u64_unaligned __attribute__((aligned(1), may_alias));
+typedef uint32_t u32_unaligned __attribute__((aligned(1), may_alias));
+typedef uint16_t u16_unaligned __attribute__((aligned(1), may_alias));
+
+typedef void (*kstring_copy_fn)(void *dst, const void *src, size_t n);
+typedef void (*kstring_fill_fn)(void *dst, uint8_t c, size_t n);
+
+typedef struct {
+    const char *name;
+    kstring_copy_fn copy;
+    kstring_fill_fn fill;
+    bool vector; // needs kernel_fpu_begin()
+} kstring_variant_t;
+
+// --- small paths: every load happens before the first store, so these are
+// also correct for overlapping buffers ---
+
+static inline void copy_small(uint8_t *d, const uint8_t *s, size_t n) {
+    if (n >= 32) {
+        uint64_t a = *(const u64_unaligned *) s;
+        uint64_t b = *(const u64_unaligned *) (s + 8);
+        uint64_t c = *(const u64_unaligned *) (s + 16);
+        uint64_t e = *(const u64_unaligned *) (s + 24);
+        uint64_t w = *(const u64_unaligned *) (s + n - 32);
+        uint64_t x = *(const u64_unaligned *) (s + n - 24);
+        uint64_t y = *(const u64_unaligned *) (s + n - 16);
+        uint64_t z = *(const u64_unaligned *) (s + n - 8);
+        *(u64_unaligned *) d = a;
+        *(u64_unaligned *) (d + 8) = b;
+        *(u64_unaligned *) (d + 16) = c;
+        *(u64_unaligned *) (d + 24) = e;
+        *(u64_unaligned *) (d + n - 32) = w;
+        *(u64_unaligned *) (d + n - 24) = x;
+        *(u64_unaligned *) (d + n - 16) = y;
+        *(u64_unaligned *) (d + n - 8) = z;
+    } else if (n >= 16) {
+        uint64_t a = *(const u64_unaligned *) s;
+        uint64_t b = *(const u64_unaligned *) (s + 8);
+        uint64_t y = *(const u64_unaligned *) (s + n - 16);
+        uint64_t z = *(const u64_unaligned *) (s + n - 8);
+        *(u64_unaligned *) d = a;
+        *(u64_unaligned *) (d + 8) = b;
+        *(u64_unaligned *) (d + n - 16) = y;
+        *(u64_unaligned *) (d + n - 8) = z;
+    } else if (n >= 8) {
+        uint64_t a = *(const u64_unaligned *) s;
+        uint64_t z = *(const u64_unaligned *) (s + n - 8);
+        *(u64_unaligned *) d = a;
+        *(u64_unaligned *) (d + n - 8) = z;
+    } else if (n >= 4) {
+        uint32_t a = *(const u32_unaligned *) s;
+        uint32_t z = *(const u32_unaligned *) (s + n - 4);
+        *(u32_unaligned *) d = a;
+        *(u32_unaligned *) (d + n - 4) = z;
+    } else if (n >= 2) {
+        uint16_t a = *(const u16_unaligned *) s;
+        uint16_t z = *(const u16_unaligned *) (s + n - 2);
+        *(u16_unaligned *) d = a;
+        *(u16_unaligned *) (d + n - 2) = z;
+    } else if (n) {
+        *d = *s;
+    }
+}
+
+static inline void fill_small(uint8_t *d, uint64_t pattern, size_t n) {
+    if (n >= 32) {
+        *(u64_unaligned *) d = pattern;
+        *(u64_unaligned *) (d + 8) = pattern;
+        *(u64_unaligned *) (d + 16) = pattern;
+        *(u64_unaligned *) (d + 24) = pattern;
+        *(u64_unaligned *) (d + n - 32) = pattern;
+        *(u64_unaligned *) (d + n - 24) = pattern;
+        *(u64_unaligned *) (d + n - 16) = pattern;
+        *(u64_unaligned *) (d + n - 8) = pattern;
+    } else if (n >= 16) {
+        *(u64_unaligned *) d = pattern;
+        *(u64_unaligned *) (d + 8) = pattern;
+        *(u64_unaligned *) (d + n - 16) = pattern;
+        *(u64_unaligned *) (d + n - 8) = pattern;
+    } else if (n >= 8) {
+        *(u64_unaligned *) d = pattern;
+        *(u64_unaligned *) (d + n - 8) = pattern;
+    } else if (n >= 4) {
+        *(u32_unaligned *) d = (uint32_t) pattern;
+        *(u32_unaligned *) (d + n - 4) = (uint32_t) pattern;
+    } else if (n >= 2) {
+        *(u16_unaligned *) d = (uint16_t) pattern;
+        *(u16_unaligned *) (d + n - 2) = (uint16_t) pattern;
+    } else if (n) {
+        *d = (uint8_t) pattern;
+    }
+}
+
+// KSTRING_SMALL <= n < KSTRING_INLINE, buffers must not overlap
+static inline void copy_medium(uint8_t *d, const uint8_t *s, size_t n) {
+    for (size_t i = 0; i + 32 <= n; i += 32) {
+        uint64_t a = *(const u64_unaligned *) (s + i);
+        uint64_t b = *(const u64_unaligned *) (s + i + 8);
+        uint64_t c = *(const u64_unaligned *) (s + i + 16);
+        uint64_t e = *(const u64_unaligned *) (s + i + 24);
+        *(u64_unaligned *) (d + i) = a;
+        *(u64_unaligned *) (d + i + 8) = b;
+        *(u64_unaligned *) (d + i + 16) = c;
+        *(u64_unaligned *) (d + i + 24) = e;
+    }
+    copy_small(d + n - 32, s + n - 32, 32);
+}
+
+static inline void fill_medium(uint8_t *d, uint64_t pattern, size_t n) {
+    for (size_t i = 0; i + 32 <= n; i += 32) {
+        *(u64_unaligned *) (d + i) = pattern;
+        *(u64_unaligned *) (d + i + 8) = pattern;
+        *(u64_unaligned *) (d + i + 16) = pattern;
+        *(u64_unaligned *) (d + i + 24) = pattern;
+    }
+    fill_small(d + n - 32, pattern, 32);
+}
+
+// --- large variants, n >= KSTRING_INLINE ---
+
+static void copy_movsb(void *dst, const void *src, size_t n) {
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+static void fill_stosb(void *dst, uint8_t c, size_t n) {
+    asm volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(c) : "memory");
+}
+
+// rep movsq for the bulk, then the last 8 bytes with one overlapping move
+static void copy_movsq(void *dst, const void *src, size_t n) {
+    uint64_t last = *(const u64_unaligned *) ((const uint8_t *) src + n - 8);
+    uint8_t *end = (uint8_t *) dst + n - 8;
+    size_t qwords = n / 8;
+    asm volatile("rep movsq" : "+D"(dst), "+S"(src), "+c"(qwords) : : "memory");
+    *(u64_unaligned *) end = last;
+}
+
+static void fill_stosq(void *dst, uint8_t c, size_t n) {
+    uint64_t pattern = 0x0101010101010101ULL * c;
+    uint8_t *end = (uint8_t *) dst + n - 8;
+    size_t qwords = n / 8;
+    asm volatile("rep stosq" : "+D"(dst), "+c"(qwords) : "a"(pattern) : "memory");
+    *(u64_unaligned *) end = pattern;
+}
+
+static const kstring_variant_t kstring_generic = {"rep movsq", copy_movsq, fill_stosq, false};
+static const kstring_variant_t kstring_erms = {"rep movsb", copy_movsb, fill_stosb, false};
+static const kstring_variant_t kstring_sse2 = {"sse2", kstring_copy_sse2, kstring_fill_sse2, true};
+static const kstring_variant_t kstring_avx2 = {"avx2", kstring_copy_avx2, kstring_fill_avx2, true};
+
+// rep movs/stos for mid sizes, where a vector loop would not amortize the
+// state save, and for everything when ERMS makes them fast at any size
+static const kstring_variant_t *kstring_mid = &kstring_generic;
+// variant for n >= KSTRING_SIMD_MIN
+static const kstring_variant_t *kstring_large = &kstring_generic;
+
+void kstring_init(void) {
+    kstring_mid = g_cpu_features.erms ? &kstring_erms : &kstring_generic;
+    kstring_large = kstring_mid;
+    if (!g_cpu_features.erms) {
+        if (g_cpu_features.avx2) {
+            kstring_large = &kstring_avx2;
+        } else if (g_cpu_features.sse2) {
+            kstring_large = &kstring_sse2;
+        }
+    }
+    kprintf("kstring_init: %s below %u bytes, %s above\n", kstring_mid->name, KSTRING_SIMD_MIN,
+            kstring_large->name);
+}
+
+static inline const kstring_variant_t *kstring_pick(size_t n) {
+    return n >= KSTRING_SIMD_MIN ? kstring_large : kstring_mid;
+}
+
+void *kmemcpy(void *dst, const void *src, size_t n) {
+    if (n < KSTRING_SMALL) {
+        copy_small((uint8_t *) dst, (const uint8_t *) src, n);
+        return dst;
+    }
+    if (n < KSTRING_INLINE) {
+        copy_medium((uint8_t *) dst, (const uint8_t *) src, n);
+        return dst;
+    }
+    const kstring_variant_t *v = kstring_pick(n);
+    if (v->vector) {
+        kernel_fpu_begin();
+        v->copy(dst, src, n);
+        kernel_fpu_end();
+    } else {
+        v->copy(dst, src, n);
+    }
+    return dst;
+}
+
+void *kmemset(void *dst, int c, size_t n) {
+    uint64_t pattern = 0x0101010101010101ULL * (uint8_t) c;
+    if (n < KSTRING_SMALL) {
+        fill_small((uint8_t *) dst, pattern, n);
+        return dst;
+    }
+    if (n < KSTRING_INLINE) {
+        fill_medium((uint8_t *) dst, pattern, n);
+        return dst;
+    }
+    const kstring_variant_t *v = kstring_pick(n);
+    if (v->vector) {
+        kernel_fpu_begin();
+        v->fill(dst, (uint8_t) c, n);
+        kernel_fpu_end();
+    } else {
+        v->fill(dst, (uint8_t) c, n);
+    }
+    return dst;
+}
+
+void *kmemmove(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *) dst;
+    const uint8_t *s = (const uint8_t *) src;
+    if (n < KSTRING_SMALL) {
+        copy_small(d, s, n);
+        return dst;
+    }
+    if (d == s) return dst;
+
+    // disjoint buffers can take the fast paths
+    if (d + n <= s || s + n <= d) return kmemcpy(dst, src, n);
+
+    if (d < s) {
+        // rep movsb copies strictly byte by byte upwards, so a forward
+        // overlap is safe; with ERMS it is also the fastest loop
+        copy_movsb(d, s, n);
+        return dst;
+    }
+
+    // overlap with dst above src: copy words from the end downwards, each
+    // loaded before it is stored over
+    size_t i = n;
+    while (i >= 8) {
+        i -= 8;
+        *(u64_unaligned *) (d + i) = *(const u64_unaligned *) (s + i);
+    }
+    while (i) {
+        i--;
+        d[i] = s[i];
+    }
+    return dst;
+}
+
+int kmemcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *pa = (const uint8_t *) a;
+    const uint8_t *pb = (const uint8_t *) b;
+
+    // compare a word at a time; byte-swapping the first differing words
+    // makes their numeric order match the byte order
+    while (n >= 8) {
+        uint64_t wa = *(const u64_unaligned *) pa;
+        uint64_t wb = *(const u64_unaligned *) pb;
+        if (wa != wb) {
+            wa = __builtin_bswap64(wa);
+            wb = __builtin_bswap64(wb);
+            return wa < wb ? -1 : 1;
+        }
+        pa += 8;
+        pb += 8;
+        n -= 8;
+    }
+    for (; n; n--, pa++, pb++) {
+        if (*pa != *pb) return *pa < *pb ? -1 : 1;
+    }
+    return 0;
+}
+
+#ifndef XGOS_HOSTED
+// the compiler emits calls to these for struct copies and zeroing
+extern "C" void *memcpy(void *dst, const void *src, size_t n) __attribute__((alias("kmemcpy")));
+extern "C" void *memset(void *dst, int c, size_t n) __attribute__((alias("kmemset")));
+extern "C" void *memmove(void *dst, const void *src, size_t n) __attribute__((alias("kmemmove")));
+extern "C" int memcmp(const void *a, const void *b, size_t n) __attribute__((alias("kmemcmp")));
+#endif
@@ -0,0 +1,33 @@
+#ifndef KSTRING_H
+#define KSTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// kernel memory routines. sizes below 64 bytes take an inline path with a
+// few overlapping loads and stores; larger ones go to the variant
+// kstring_init() picked for the CPU (rep movsb/stosb with ERMS, SSE2/AVX2
+// loops otherwise). the kernel build also exports them as memcpy, memset,
+// memmove and memcmp for calls emitted by the compiler.
+
+// pick the variants from g_cpu_features; call after cpu_init(). until then
+// a generic rep movsq/stosq variant is used
+void kstring_init(void);
+
+void *kmemcpy(void *dst, const void *src, size_t n);
+
+void *kmemset(void *dst, int c, size_t n);
+
+void *kmemmove(void *dst, const void *src, size_t n);
+
+int kmemcmp(const void *a, const void *b, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSTRING_H
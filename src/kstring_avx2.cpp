@@ -0,0 +1,70 @@
+#include "kstring_simd.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// compiled with -mavx2; see kstring_simd.h for the calling rules
+
+typedef uint8_t kvec_t __attribute__((vector_size(32)));
+typedef uint8_t kvec_unaligned_t __attribute__((vector_size(32), aligned(1)));
+
+#define KVEC 32
+
+void kstring_copy_avx2(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *) dst;
+    const uint8_t *s = (const uint8_t *) src;
+
+    // the first and last vectors are copied unaligned up front; the loop
+    // then covers the aligned middle and may overlap them
+    kvec_unaligned_t head = *(const kvec_unaligned_t *) s;
+    kvec_unaligned_t tail = *(const kvec_unaligned_t *) (s + n - KVEC);
+    *(kvec_unaligned_t *) d = head;
+    *(kvec_unaligned_t *) (d + n - KVEC) = tail;
+
+    size_t skew = KVEC - ((uintptr_t) d & (KVEC - 1));
+    d += skew;
+    s += skew;
+    n -= skew;
+
+    kvec_t *vd = (kvec_t *) d;
+    const kvec_unaligned_t *vs = (const kvec_unaligned_t *) s;
+    size_t vectors = n / KVEC;
+    size_t i = 0;
+    for (; i + 4 <= vectors; i += 4) {
+        kvec_t a = vs[i];
+        kvec_t b = vs[i + 1];
+        kvec_t c = vs[i + 2];
+        kvec_t e = vs[i + 3];
+        vd[i] = a;
+        vd[i + 1] = b;
+        vd[i + 2] = c;
+        vd[i + 3] = e;
+    }
+    for (; i < vectors; i++) {
+        vd[i] = vs[i];
+    }
+}
+
+void kstring_fill_avx2(void *dst, uint8_t c, size_t n) {
+    uint8_t *d = (uint8_t *) dst;
+    kvec_t pattern = (kvec_t) {} + c;
+
+    *(kvec_unaligned_t *) d = pattern;
+    *(kvec_unaligned_t *) (d + n - KVEC) = pattern;
+
+    size_t skew = KVEC - ((uintptr_t) d & (KVEC - 1));
+    d += skew;
+    n -= skew;
+
+    kvec_t *vd = (kvec_t *) d;
+    size_t vectors = n / KVEC;
+    size_t i = 0;
+    for (; i + 4 <= vectors; i += 4) {
+        vd[i] = pattern;
+        vd[i + 1] = pattern;
+        vd[i + 2] = pattern;
+        vd[i + 3] = pattern;
+    }
+    for (; i < vectors; i++) {
+        vd[i] = pattern;
+    }
+}
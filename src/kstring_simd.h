@@ -0,0 +1,26 @@
+#ifndef KSTRING_SIMD_H
+#define KSTRING_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// vector copy and fill loops for n >= 64, each built in its own translation
+// unit with the matching -m flag. callers check g_cpu_features and hold
+// kernel_fpu_begin() around them; the buffers must not overlap
+void kstring_copy_sse2(void *dst, const void *src, size_t n);
+
+void kstring_fill_sse2(void *dst, uint8_t c, size_t n);
+
+void kstring_copy_avx2(void *dst, const void *src, size_t n);
+
+void kstring_fill_avx2(void *dst, uint8_t c, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KSTRING_SIMD_H
@@ -9,7 +9,7 @@ int32_t math_sin(int32_t angle_degrees) {
     // quick and dirty handling of special cases
     if (angle_degrees == 0) return 0; // sin(0°) = 0
     if (angle_degrees == 90) return 1000; // sin(90°) = 1
-    if (angle_degrees == 30) return 1 / 2; // sin(30°) = 1/2
+    if (angle_degrees == 30) return 500; // sin(30°) = 1/2
     if (angle_degrees == 60) return 866; // sin(60°) = sqrt(3)/2 ≈ 0.866
     if (angle_degrees == 45) return 707; // sin(45°) = 1/sqrt(2) ≈ 0.707
 
@@ -1,22 +1,208 @@
 #include "memory.h"
+#include "boot_trace.h"
 #include "console.h"
+#include "klog.h"
+#include "cpu.h"
+#include "kstring.h"
 #include <stdint.h>
 #include <stddef.h>
 
 extern "C" uint64_t __bss_end;
 
+uintptr_t g_physmap_offset = 0;
+
 // multiboot framebuffer flag bit
+#define MULTIBOOT_INFO_CMDLINE 0x4
+#define MULTIBOOT_INFO_MODS 0x8
+#define MULTIBOOT_INFO_MEM_MAP 0x40
 #define MULTIBOOT_INFO_FRAMEBUFFER_INFO 0x800
 
-static uint8_t *frame_bitmap = nullptr;
+// frame bitmap: one bit per 4 KiB frame, bit set = frame in use or reserved.
+// frames are tracked 64 at a time so a whole word can be tested per step.
+// frame_summary has one bit per bitmap word that still has a free frame and
+// frame_summary_top has one bit per summary word that is non-zero, so
+// finding the next word with a free frame never walks fully used memory.
+static uint64_t *frame_bitmap = nullptr;
+static uint64_t *frame_summary = nullptr;
+static uint64_t *frame_summary_top = nullptr;
 static uint64_t nframes = 0;
-static uint64_t bitmap_size = 0; // bytes
+static uint64_t frame_words = 0;
+static uint64_t summary_words = 0;
+static uint64_t free_frames = 0;
+// next-fit hint: bitmap word of the last successful allocation
+static uint64_t frame_hint = 0;
+// usable RAM ranges from the Multiboot map, kept for paging_init()
+#define MEMORY_MAX_RANGES 64
+static memory_range_t usable_ranges[MEMORY_MAX_RANGES];
+static uint32_t usable_range_count = 0;
+// first byte past the allocator metadata carved out by memory_init()
+static uintptr_t metadata_end = 0;
+
+// memory_init() runs before paging_init(), so its metadata has to sit in
+// the first 1 GiB that boot.asm identity-maps
+#ifndef XGOS_HOSTED
+#define BOOT_IDENTITY_LIMIT 0x40000000ULL
+#else
+// host tests map their fake RAM above 1 GiB, all of it reachable
+#define BOOT_IDENTITY_LIMIT (~0ULL)
+#endif
 
+typedef struct {
+    uint32_t mod_start, mod_end, string, reserved;
+} multiboot_module_t;
 
-// frame bitmap helpers (mark/test frames)
-static inline void frame_set(uint64_t idx) { frame_bitmap[idx / 8] |= (uint8_t) (1 << (idx % 8)); }
-static inline void frame_clear(uint64_t idx) { frame_bitmap[idx / 8] &= (uint8_t) ~(1 << (idx % 8)); }
-static inline bool frame_test(uint64_t idx) { return frame_bitmap[idx / 8] & (uint8_t) (1 << (idx % 8)); }
+#define FRAME_WORD_FULL (~0ULL)
+#define FRAME_NONE (~0ULL)
+
+// refresh the summary bits covering bitmap word w
+static inline void frame_word_update(uint64_t w) {
+    uint64_t s = w / 64;
+    if (frame_bitmap[w] != FRAME_WORD_FULL) frame_summary[s] |= 1ULL << (w % 64);
+    else frame_summary[s] &= ~(1ULL << (w % 64));
+    if (frame_summary[s]) frame_summary_top[s / 64] |= 1ULL << (s % 64);
+    else frame_summary_top[s / 64] &= ~(1ULL << (s % 64));
+}
+
+// mark [first, first + count) frames as used or free, a word at a time
+static void frame_mark_range(uint64_t first, uint64_t count, bool used) {
+    uint64_t end = first + count;
+    if (end > nframes) end = nframes;
+    while (first < end) {
+        uint64_t w = first / 64;
+        uint64_t bit = first % 64;
+        uint64_t n = 64 - bit;
+        if (n > end - first) n = end - first;
+        uint64_t mask = (n == 64) ? FRAME_WORD_FULL : (((1ULL << n) - 1) << bit);
+        if (used) frame_bitmap[w] |= mask;
+        else frame_bitmap[w] &= ~mask;
+        frame_word_update(w);
+        first += n;
+    }
+}
+
+// count set bits without relying on libgcc's __popcountdi2
+static inline uint64_t popcount64(uint64_t v) {
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (v * 0x0101010101010101ULL) >> 56;
+}
+
+// find the first bitmap word >= start that has a free frame, or FRAME_NONE
+static uint64_t frame_summary_find(uint64_t start) {
+    if (start >= frame_words) return FRAME_NONE;
+
+    uint64_t s = start / 64;
+    uint64_t bits = frame_summary[s] & (FRAME_WORD_FULL << (start % 64));
+    if (bits) return s * 64 + __builtin_ctzll(bits);
+
+    // walk the top level for the next non-empty summary word
+    for (uint64_t t = s + 1; t < summary_words; t = (t / 64 + 1) * 64) {
+        uint64_t top = frame_summary_top[t / 64] & (FRAME_WORD_FULL << (t % 64));
+        if (top) {
+            uint64_t sw = (t / 64) * 64 + __builtin_ctzll(top);
+            return sw * 64 + __builtin_ctzll(frame_summary[sw]);
+        }
+    }
+    return FRAME_NONE;
+}
+
+// find the first frame >= f whose bit equals used, or nframes
+static uint64_t frame_find_next(uint64_t f, bool used) {
+    while (f < nframes) {
+        uint64_t w = f / 64;
+        uint64_t bits = (used ? frame_bitmap[w] : ~frame_bitmap[w]) & (FRAME_WORD_FULL << (f % 64));
+        if (bits) {
+            uint64_t r = w * 64 + __builtin_ctzll(bits);
+            return r < nframes ? r : nframes;
+        }
+        f = (w + 1) * 64;
+    }
+    return nframes;
+}
+
+// true if every frame in [first, first + count) is clear in the bitmap
+static bool frame_range_is_free(uint64_t first, uint64_t count) {
+    return frame_find_next(first, true) >= first + count;
+}
+
+// --- buddy allocator for naturally aligned 2^order frame blocks ---
+// the bitmap stays the single record of which frames are in use; the buddy
+// free lists are an index of candidate blocks on top of it. frame_alloc()
+// may take frames out of a listed block, so blocks are re-checked against
+// the bitmap when popped and stale ones are split back down.
+// list links live in per-frame arrays rather than in the free frames
+// themselves because frames above the boot identity map are not accessible.
+#define BUDDY_NIL 0xFFFFFFFFu
+#define BUDDY_NOT_LISTED 0xFF
+
+static uint32_t *buddy_next = nullptr;
+static uint32_t *buddy_prev = nullptr;
+// order of the listed block headed by each frame, or BUDDY_NOT_LISTED
+static uint8_t *buddy_order = nullptr;
+static uint32_t buddy_head[FRAME_MAX_ORDER + 1];
+static uint64_t buddy_count[FRAME_MAX_ORDER + 1];
+
+static void buddy_unlink(uint64_t f) {
+    uint8_t order = buddy_order[f];
+    if (buddy_prev[f] != BUDDY_NIL) buddy_next[buddy_prev[f]] = buddy_next[f];
+    else buddy_head[order] = buddy_next[f];
+    if (buddy_next[f] != BUDDY_NIL) buddy_prev[buddy_next[f]] = buddy_prev[f];
+    buddy_order[f] = BUDDY_NOT_LISTED;
+    buddy_count[order]--;
+}
+
+static void buddy_push(uint64_t f, unsigned int order) {
+    if (buddy_order[f] != BUDDY_NOT_LISTED) {
+        // a listed block at this head already covers this one
+        if (buddy_order[f] >= order) return;
+        buddy_unlink(f);
+    }
+    buddy_order[f] = (uint8_t) order;
+    buddy_prev[f] = BUDDY_NIL;
+    buddy_next[f] = buddy_head[order];
+    if (buddy_head[order] != BUDDY_NIL) buddy_prev[buddy_head[order]] = (uint32_t) f;
+    buddy_head[order] = (uint32_t) f;
+    buddy_count[order]++;
+}
+
+// merge a free block with its free buddies as far as possible, then list it
+static void buddy_release(uint64_t f, unsigned int order) {
+    while (order < FRAME_MAX_ORDER) {
+        uint64_t size = 1ULL << order;
+        uint64_t buddy = f ^ size;
+        if (buddy + size > nframes || buddy_order[buddy] != order ||
+            !frame_range_is_free(buddy, size)) {
+            break;
+        }
+        buddy_unlink(buddy);
+        if (buddy < f) f = buddy;
+        order++;
+    }
+    buddy_push(f, order);
+}
+
+// list every free run of the bitmap as maximal naturally aligned blocks
+static void buddy_seed(void) {
+    for (unsigned int o = 0; o <= FRAME_MAX_ORDER; ++o) {
+        buddy_head[o] = BUDDY_NIL;
+        buddy_count[o] = 0;
+    }
+    kmemset(buddy_order, BUDDY_NOT_LISTED, nframes);
+
+    uint64_t f = frame_find_next(0, false);
+    while (f < nframes) {
+        uint64_t end = frame_find_next(f, true);
+        while (f < end) {
+            unsigned int order = f ? __builtin_ctzll(f) : FRAME_MAX_ORDER;
+            if (order > FRAME_MAX_ORDER) order = FRAME_MAX_ORDER;
+            while ((1ULL << order) > end - f) order--;
+            buddy_push(f, order);
+            f += 1ULL << order;
+        }
+        f = frame_find_next(end, false);
+    }
+}
 
 // dump raw memory map entries for debugging (E820)
 void memory_dump_map(uint32_t mbi_addr) {
@@ -32,11 +218,71 @@ void memory_dump_map(uint32_t mbi_addr) {
         uint64_t base = *(uint64_t *) (uintptr_t) (cur + 4);
         uint64_t len = *(uint64_t *) (uintptr_t) (cur + 12);
         uint32_t type = *(uint32_t *) (uintptr_t) (cur + 20);
-        kprintf("  [%u] base=0x%x len=0x%x type=%u\n", idx++, (uint32_t) base, (uint32_t) len, type);
+        kprintf("  [%2u] base=0x%016lx len=0x%016lx type=%u\n", idx++, base, len, type);
         cur += sz + 4;
     }
 }
 
+// one past the terminating NUL of the boot loader string at addr
+static uint64_t boot_string_end(uint64_t addr) {
+    const char *p = (const char *) (uintptr_t) addr;
+    while (*p) p++;
+    return (uintptr_t) p + 1;
+}
+
+// end of the first boot loader structure overlapping [start, end), or 0 if
+// none does; memory_init() must not build its metadata over any of them
+static uint64_t boot_data_conflict(const multiboot_info_t *mbi, uint64_t start, uint64_t end) {
+    uint64_t b = (uintptr_t) mbi;
+    uint64_t e = b + sizeof(*mbi);
+    if (b < end && e > start) return e;
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+        b = mbi->mmap_addr;
+        e = b + mbi->mmap_length;
+        if (b < end && e > start) return e;
+    }
+    if ((mbi->flags & MULTIBOOT_INFO_CMDLINE) && mbi->cmdline) {
+        b = mbi->cmdline;
+        e = boot_string_end(b);
+        if (b < end && e > start) return e;
+    }
+    if (mbi->flags & MULTIBOOT_INFO_MODS) {
+        const multiboot_module_t *mods = (const multiboot_module_t *) (uintptr_t) mbi->mods_addr;
+        b = mbi->mods_addr;
+        e = b + mbi->mods_count * sizeof(multiboot_module_t);
+        if (b < end && e > start) return e;
+        for (uint32_t i = 0; i < mbi->mods_count; ++i) {
+            b = mods[i].mod_start;
+            e = mods[i].mod_end;
+            if (b < end && e > start) return e;
+            if (mods[i].string) {
+                b = mods[i].string;
+                e = boot_string_end(b);
+                if (b < end && e > start) return e;
+            }
+        }
+    }
+    return 0;
+}
+
+// lowest page-aligned address at or above from where size bytes fit inside
+// one usable range below the boot identity map without touching any boot
+// loader data; 0 if there is no such place
+static uint64_t metadata_place(const multiboot_info_t *mbi, uint64_t from, uint64_t size) {
+    for (uint32_t i = 0; i < usable_range_count; ++i) {
+        uint64_t base = usable_ranges[i].base > from ? usable_ranges[i].base : from;
+        uint64_t top = usable_ranges[i].base + usable_ranges[i].len;
+        if (top > BOOT_IDENTITY_LIMIT) top = BOOT_IDENTITY_LIMIT;
+        base = (base + 4095) & ~4095ULL;
+        while (base < top && size <= top - base) {
+            uint64_t skip = boot_data_conflict(mbi, base, base + size);
+            if (!skip) return base;
+            base = (skip + 4095) & ~4095ULL;
+        }
+    }
+    return 0;
+}
+
 void memory_init(uint32_t mbi_addr) {
     multiboot_info_t *mbi = (multiboot_info_t *) (uintptr_t) mbi_addr;
     bool has_map = mbi->flags & (1 << 6);
@@ -59,30 +305,58 @@ void memory_init(uint32_t mbi_addr) {
             uint64_t base = *(uint64_t *) (uintptr_t) (cur + 4);
             uint64_t len = *(uint64_t *) (uintptr_t) (cur + 12);
             uint32_t type = *(uint32_t *) (uintptr_t) (cur + 20);
+            klog(KLOG_DEBUG, "memory_init: range 0x%lx+0x%lx type %u\n", base, len, type);
             if (type == 1) {
                 uint64_t top = base + len;
                 if (top > max_addr) max_addr = top;
+                if (usable_range_count < MEMORY_MAX_RANGES) {
+                    usable_ranges[usable_range_count].base = base;
+                    usable_ranges[usable_range_count].len = len;
+                    usable_range_count++;
+                }
             }
             cur += sz + 4;
         }
     } else {
         // mem_upper is KB above 1 MiB
         max_addr = (uint64_t) mbi->mem_upper * 1024 + 0x100000;
+        usable_ranges[0].base = 0x100000;
+        usable_ranges[0].len = max_addr - 0x100000;
+        usable_range_count = 1;
     }
+    boot_trace("memory_init.scan_map");
     // total frames available
     nframes = max_addr / 4096;
-    bitmap_size = (nframes + 7) / 8;
-
-    // place frame bitmap after end of BSS
-    frame_bitmap = (uint8_t *) (uintptr_t) &__bss_end;
-    // mark all frames as used
-    for (uint64_t i = 0; i < bitmap_size; ++i) frame_bitmap[i] = 0xFF;
-    // reserve frames occupied by the bitmap itself
-    {
-        uint64_t start = ((uintptr_t) frame_bitmap) / 4096;
-        uint64_t end = (((uintptr_t) frame_bitmap + bitmap_size) + 4095) / 4096;
-        for (uint64_t f = start; f < end; ++f) frame_set(f);
+    frame_words = (nframes + 63) / 64;
+    summary_words = (frame_words + 63) / 64;
+    uint64_t top_words = (summary_words + 63) / 64;
+
+    // carve the frame bitmap, its summaries and the buddy lists out of
+    // usable RAM after the kernel image, about 9 bytes per frame
+    uint64_t kernel_end = ((uintptr_t) &__bss_end + 4095) & ~4095ULL;
+    uint64_t metadata_size = (frame_words + summary_words + top_words) * sizeof(uint64_t) +
+                             nframes * (2 * sizeof(uint32_t) + sizeof(uint8_t));
+    uint64_t metadata_base = metadata_place(mbi, kernel_end, metadata_size);
+    if (!metadata_base) {
+        kprintf("memory_init: no room for %lu bytes of frame metadata below 0x%llx\n", metadata_size,
+                BOOT_IDENTITY_LIMIT);
+        panic("memory_init: frame metadata does not fit");
     }
+    frame_bitmap = (uint64_t *) (uintptr_t) metadata_base;
+    frame_summary = frame_bitmap + frame_words;
+    frame_summary_top = frame_summary + summary_words;
+    buddy_next = (uint32_t *) (frame_summary_top + top_words);
+    buddy_prev = buddy_next + nframes;
+    buddy_order = (uint8_t *) (buddy_prev + nframes);
+    metadata_end = (uintptr_t) (buddy_order + nframes);
+    klog(KLOG_DEBUG, "memory_init: %lu frames, metadata 0x%lx-0x%lx\n", nframes,
+         (uint64_t) (uintptr_t) frame_bitmap, (uint64_t) metadata_end);
+    // mark all frames as used; an all-used bitmap has empty summaries
+    kmemset(frame_bitmap, 0xFF, frame_words * sizeof(uint64_t));
+    kmemset(frame_summary, 0, summary_words * sizeof(uint64_t));
+    kmemset(frame_summary_top, 0, top_words * sizeof(uint64_t));
+    boot_trace("memory_init.clear_bitmap");
+
     // free frames using the map or fallback
     if (has_map) {
         uint8_t *cur = (uint8_t *) (uintptr_t) mbi->mmap_addr;
@@ -93,29 +367,28 @@ void memory_init(uint32_t mbi_addr) {
             uint64_t len = *(uint64_t *) (uintptr_t) (cur + 12);
             uint32_t type = *(uint32_t *) (uintptr_t) (cur + 20);
             if (type == 1) {
-                uint64_t addr_end = base + len;
-                for (uint64_t p = base; p + 4096 <= addr_end; p += 4096) {
-                    frame_clear(p / 4096);
-                }
+                // only whole frames inside the range are usable
+                uint64_t first = (base + 4095) / 4096;
+                uint64_t last = (base + len) / 4096;
+                if (last > first) frame_mark_range(first, last - first, false);
+                klog(KLOG_DEBUG, "memory_init: free frames %lu-%lu\n", first, last);
             }
             cur += sz + 4;
         }
     } else {
         // free frames above 1 MiB
         uint64_t first = 0x100000 / 4096;
-        for (uint64_t i = first; i < nframes; ++i) frame_clear(i);
+        frame_mark_range(first, nframes - first, false);
     }
+    boot_trace("memory_init.free_ranges");
 
-    // reserve frames for kernel (up to end of BSS)
-    uint64_t bss_end = (uint64_t) (uintptr_t) &__bss_end;
-    uint64_t kernel_end = (bss_end + 4095) & ~4095ULL;
-    for (uint64_t p = 0; p < kernel_end; p += 4096) frame_set(p / 4096);
+    // reserve frames for kernel (up to end of BSS) and the allocator metadata
+    frame_mark_range(0, kernel_end / 4096, true);
+    klog(KLOG_DEBUG, "memory_init: reserved kernel frames 0-%lu\n", kernel_end / 4096);
+    frame_mark_range(metadata_base / 4096, (metadata_end + 4095) / 4096 - metadata_base / 4096, true);
     // reserve frames for loaded modules, if any
-    if (mbi->flags & (1 << 3)) {
-        typedef struct {
-            uint32_t mod_start, mod_end, string, reserved;
-        } module_t;
-        module_t *mods = (module_t *) (uintptr_t) mbi->mods_addr;
+    if (mbi->flags & MULTIBOOT_INFO_MODS) {
+        multiboot_module_t *mods = (multiboot_module_t *) (uintptr_t) mbi->mods_addr;
         kprintf("Modules (%u):\n", mbi->mods_count);
         for (uint32_t i = 0; i < mbi->mods_count; ++i) {
             uint64_t ms = mods[i].mod_start;
@@ -123,65 +396,162 @@ void memory_init(uint32_t mbi_addr) {
             const char *name = (const char *) (uintptr_t) mods[i].string;
             kprintf("  [%u] 0x%lx-0x%lx '%s'\n", i, ms, me, name);
             // reserve the frames spanned by this module
-            uint64_t start = ms & ~4095ULL;
-            uint64_t end = (me + 4095) & ~4095ULL;
-            for (uint64_t p = start; p < end; p += 4096) frame_set(p / 4096);
+            uint64_t start = ms / 4096;
+            uint64_t end = (me + 4095) / 4096;
+            frame_mark_range(start, end - start, true);
         }
     }
 
+    boot_trace("memory_init.reserve");
+
     // count free frames
-    uint64_t free_frames = 0;
-    for (uint64_t i = 0; i < nframes; ++i) {
-        uint64_t byte = i / 8;
-        uint8_t bit = (uint8_t) (1 << (i % 8));
-        if (!(frame_bitmap[byte] & bit)) {
-            free_frames++;
-        }
+    free_frames = 0;
+    for (uint64_t i = 0; i < frame_words; ++i) {
+        free_frames += 64 - popcount64(frame_bitmap[i]);
     }
+    frame_hint = 0;
     kprintf("frames total=%lu free=%lu reserved=%lu\n", nframes, free_frames, nframes - free_frames);
+    boot_trace("memory_init.count");
+
+    buddy_seed();
+    kprintf("buddy: free blocks per order:");
+    for (unsigned int o = 0; o <= FRAME_MAX_ORDER; ++o) kprintf(" %lu", buddy_count[o]);
+    kprintf("\n");
+    boot_trace("memory_init.buddy");
 }
 
 // allocate a 4 KiB physical frame; returns physical address or 0 on failure
 uint64_t frame_alloc() {
-    for (uint64_t i = 0; i < nframes; ++i) {
-        if (!frame_test(i)) {
-            frame_set(i);
-            return i * 4096;
-        }
+    uint64_t w = frame_hint;
+    if (w >= frame_words || frame_bitmap[w] == FRAME_WORD_FULL) {
+        // next fit: continue after the hint, then wrap around once
+        w = frame_summary_find(w + 1);
+        if (w == FRAME_NONE) w = frame_summary_find(0);
+        if (w == FRAME_NONE) return 0; // no free frames
     }
-    return 0; // no free frames
+
+    uint64_t bit = __builtin_ctzll(~frame_bitmap[w]);
+    frame_bitmap[w] |= 1ULL << bit;
+    if (frame_bitmap[w] == FRAME_WORD_FULL) frame_word_update(w);
+    frame_hint = w;
+    free_frames--;
+    return (w * 64 + bit) * 4096;
 }
 
 // free a previously allocated 4 KiB physical frame
 void frame_free(uint64_t paddr) {
     if (paddr % 4096 != 0) return;
     uint64_t idx = paddr / 4096;
-    if (idx < nframes) {
-        frame_clear(idx);
+    if (idx >= nframes) return;
+
+    uint64_t w = idx / 64;
+    uint64_t mask = 1ULL << (idx % 64);
+    if (!(frame_bitmap[w] & mask)) return; // already free
+
+    bool was_full = frame_bitmap[w] == FRAME_WORD_FULL;
+    frame_bitmap[w] &= ~mask;
+    if (was_full) frame_word_update(w);
+    free_frames++;
+    buddy_release(idx, 0);
+}
+
+// allocate 2^order contiguous frames aligned to their size
+uint64_t frames_alloc(unsigned int order) {
+    if (order > FRAME_MAX_ORDER) return 0;
+
+    for (;;) {
+        unsigned int o = order;
+        while (o <= FRAME_MAX_ORDER && buddy_head[o] == BUDDY_NIL) o++;
+        if (o > FRAME_MAX_ORDER) return 0; // nothing large enough
+
+        uint64_t f = buddy_head[o];
+        buddy_unlink(f);
+
+        if (!frame_range_is_free(f, 1ULL << o)) {
+            // stale: single frames were handed out of this block since it was
+            // listed. keep only the halves that still have free frames.
+            if (o == 0) continue;
+            uint64_t half = 1ULL << (o - 1);
+            if (frame_find_next(f, false) < f + half) buddy_push(f, o - 1);
+            if (frame_find_next(f + half, false) < f + 2 * half) buddy_push(f + half, o - 1);
+            continue;
+        }
+
+        // split down to the requested order, listing the upper halves
+        while (o > order) {
+            o--;
+            buddy_push(f + (1ULL << o), o);
+        }
+        frame_mark_range(f, 1ULL << order, true);
+        free_frames -= 1ULL << order;
+        return f * 4096;
     }
 }
 
-// --- simple kernel heap (bump allocator) ---
-static uintptr_t heap_ptr = 0;
+// free 2^order frames previously returned by frames_alloc(order)
+void frames_free(uint64_t paddr, unsigned int order) {
+    if (order > FRAME_MAX_ORDER || paddr % (4096ULL << order) != 0) return;
+    uint64_t f = paddr / 4096;
+    uint64_t count = 1ULL << order;
+    if (f + count > nframes) return;
+    // every frame of the block must be in use, otherwise this is a bad free
+    if (frame_find_next(f, false) < f + count) return;
+
+    frame_mark_range(f, count, false);
+    free_frames += count;
+    buddy_release(f, order);
+}
+
+// --- frame allocator self-benchmark ---
+#define MEMORY_BENCH_OPS (1u << 20)
+#define MEMORY_BENCH_BATCH 4096
+
+static uint64_t bench_frames[MEMORY_BENCH_BATCH];
 
-// allocate size bytes from the kernel heap; no freeing. reserves underlying frames.
-void *kmalloc(size_t size) {
-    if (!heap_ptr) {
-        // heap starts just after the frame bitmap
-        heap_ptr = ((uintptr_t) frame_bitmap + bitmap_size + 7) & ~7ULL;
+// reference implementation: the original first-fit scan, one bit per step from frame 0
+static uint64_t frame_alloc_linear() {
+    for (uint64_t i = 0; i < nframes; ++i) {
+        if (!(frame_bitmap[i / 64] & (1ULL << (i % 64)))) {
+            frame_mark_range(i, 1, true);
+            free_frames--;
+            return i * 4096;
+        }
     }
-    // align size to 8 bytes
-    size = (size + 7) & ~7ULL;
-    uintptr_t old = heap_ptr;
-    uintptr_t new_ptr = heap_ptr + size;
-    // reserve any frames spanned by this allocation
-    uintptr_t start_page = old & ~4095ULL;
-    uintptr_t end_page = (new_ptr + 4095) & ~4095ULL;
-    for (uintptr_t p = start_page; p < end_page; p += 4096) {
-        frame_set(p / 4096);
+    return 0;
+}
+
+// run ops alloc/free pairs in batches and report average cycles per operation
+static void memory_bench_run(const char *name, uint64_t (*alloc)(), uint64_t ops) {
+    uint64_t batch = MEMORY_BENCH_BATCH;
+    if (batch > free_frames / 2) batch = free_frames / 2;
+    if (!batch) return;
+
+    uint64_t alloc_cycles = 0;
+    uint64_t free_cycles = 0;
+    uint64_t done = 0;
+    while (done < ops) {
+        uint64_t n = ops - done < batch ? ops - done : batch;
+        uint64_t t0 = cpu_rdtsc();
+        for (uint64_t i = 0; i < n; ++i) bench_frames[i] = alloc();
+        uint64_t t1 = cpu_rdtsc();
+        for (uint64_t i = 0; i < n; ++i) frame_free(bench_frames[i]);
+        uint64_t t2 = cpu_rdtsc();
+        alloc_cycles += t1 - t0;
+        free_cycles += t2 - t1;
+        done += n;
     }
-    heap_ptr = new_ptr;
-    return (void *) (uintptr_t) old;
+    kprintf("  %s: %lu ops, alloc %lu cycles/op, free %lu cycles/op\n",
+            name, done, alloc_cycles / done, free_cycles / done);
+}
+
+// compare the original linear scan against the word-at-a-time allocator.
+// the linear scan is quadratic in the batch size, so it runs 1/16 of the ops.
+void memory_benchmark(void) {
+    kprintf("memory_benchmark: frame allocator, batch %u\n", MEMORY_BENCH_BATCH);
+    uint64_t saved_hint = frame_hint;
+    memory_bench_run("linear scan", frame_alloc_linear, MEMORY_BENCH_OPS >> 4);
+    memory_bench_run("word scan  ", frame_alloc, MEMORY_BENCH_OPS);
+    frame_hint = saved_hint;
 }
 
 // return number of physical frames detected
@@ -189,6 +559,24 @@ uint64_t memory_get_nframes(void) {
     return nframes;
 }
 
+// usable RAM ranges recorded by memory_init()
+uint32_t memory_usable_ranges(const memory_range_t **ranges) {
+    *ranges = usable_ranges;
+    return usable_range_count;
+}
+
+// return number of physical frames currently free
+uint64_t memory_get_free_frames(void) {
+    return free_frames;
+}
+
+// kernel command line passed by the boot loader, "" if there is none
+const char *multiboot_cmdline(uint32_t mbi_addr) {
+    multiboot_info_t *mbi = (multiboot_info_t *) (uintptr_t) mbi_addr;
+    if (!(mbi->flags & MULTIBOOT_INFO_CMDLINE) || !mbi->cmdline) return "";
+    return (const char *) (uintptr_t) mbi->cmdline;
+}
+
 // framebuffer detection and setup
 // returns 1 if framebuffer is available, 0 otherwise
 int framebuffer_detect(uint32_t mbi_addr) {
@@ -213,8 +601,7 @@ int framebuffer_detect(uint32_t mbi_addr) {
         return 0;
     }
 
-    kprintf("framebuffer_detect: found framebuffer at 0x%x\n",
-            (uint32_t) mbi->framebuffer_addr);
+    kprintf("framebuffer_detect: found framebuffer at 0x%lx\n", mbi->framebuffer_addr);
     kprintf("  dimensions: %ux%u, bpp: %u, pitch: %u\n",
             mbi->framebuffer_width, mbi->framebuffer_height,
             mbi->framebuffer_bpp, mbi->framebuffer_pitch);
@@ -233,3 +620,14 @@ void framebuffer_get_info(uint32_t mbi_addr, uint64_t *addr, uint32_t *width,
     if (pitch) *pitch = mbi->framebuffer_pitch;
     if (bpp) *bpp = mbi->framebuffer_bpp;
 }
+
+void framebuffer_get_channels(uint32_t mbi_addr, uint8_t position[3], uint8_t size[3]) {
+    multiboot_info_t *mbi = (multiboot_info_t *) (uintptr_t) mbi_addr;
+
+    position[0] = mbi->framebuffer_red_field_position;
+    size[0] = mbi->framebuffer_red_mask_size;
+    position[1] = mbi->framebuffer_green_field_position;
+    size[1] = mbi->framebuffer_green_mask_size;
+    position[2] = mbi->framebuffer_blue_field_position;
+    size[2] = mbi->framebuffer_blue_mask_size;
+}
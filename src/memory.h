@@ -34,8 +34,9 @@ typedef struct {
     uint8_t framebuffer_bpp;
     uint8_t framebuffer_type;
 
-    union {
-        struct {
+    // color info starts at offset 110, so neither part may be padded to align it
+    union __attribute__((packed)) {
+        struct __attribute__((packed)) {
             uint32_t framebuffer_palette_addr;
             uint16_t framebuffer_palette_num_colors;
         };
@@ -59,6 +60,31 @@ typedef struct __attribute__((packed)) {
     uint32_t type;
 } memory_map_entry_t;
 
+// range of usable physical memory
+typedef struct {
+    uint64_t base;
+    uint64_t len;
+} memory_range_t;
+
+// higher-half direct map of all usable physical memory, built by paging_init()
+#define PHYSMAP_BASE 0xFFFF800000000000ULL
+
+// offset from physical to direct-mapped virtual addresses; 0 until
+// paging_init() switches over, when only the boot identity map exists
+extern uintptr_t g_physmap_offset;
+
+// pointer through which a physical address can be accessed
+static inline void *phys_to_virt(uint64_t paddr) {
+    return (void *) (uintptr_t) (paddr + g_physmap_offset);
+}
+
+// physical address of a direct-mapped or identity-mapped (kernel image) pointer
+static inline uint64_t virt_to_phys(const void *vaddr) {
+    uintptr_t v = (uintptr_t) vaddr;
+    if (g_physmap_offset && v >= g_physmap_offset) return v - g_physmap_offset;
+    return v;
+}
+
 // memory manager/physical frame allocator
 // mbi_addr: address of multiboot info structure
 void memory_init(uint32_t mbi_addr);
@@ -66,6 +92,9 @@ void memory_init(uint32_t mbi_addr);
 // debug: dump the raw memory map as provided by Multiboot
 void memory_dump_map(uint32_t mbi_addr);
 
+// kernel command line passed by the boot loader, "" if there is none
+const char *multiboot_cmdline(uint32_t mbi_addr);
+
 // framebuffer detection and setup
 // returns 1 if framebuffer is available, 0 otherwise
 int framebuffer_detect(uint32_t mbi_addr);
@@ -74,17 +103,86 @@ int framebuffer_detect(uint32_t mbi_addr);
 void framebuffer_get_info(uint32_t mbi_addr, uint64_t *addr, uint32_t *width,
                           uint32_t *height, uint32_t *pitch, uint8_t *bpp);
 
+// bit position and size of the red, green and blue fields of a direct RGB
+// framebuffer, in that order
+void framebuffer_get_channels(uint32_t mbi_addr, uint8_t position[3], uint8_t size[3]);
+
 // allocate a 4 KiB physical frame; returns physical address or 0 on failure
 uint64_t frame_alloc();
 
 // free a previously allocated 4 KiB physical frame
 void frame_free(uint64_t paddr);
 
-// simple kernel heap allocator (bump allocator)
-// size: number of bytes to allocate
+// boot-time self-benchmark: cycles per frame_alloc()/frame_free() for the
+// original linear scan and the word-at-a-time allocator
+void memory_benchmark(void);
+
+// largest buddy order: 2^18 frames = 1 GiB
+#define FRAME_MAX_ORDER 18
+// buddy order of a 2 MiB block
+#define FRAME_ORDER_2M 9
+
+// allocate 2^order physically contiguous 4 KiB frames, aligned to the block
+// size (order 0-FRAME_MAX_ORDER); returns physical address or 0 on failure.
+// not O(log n) once frame_alloc() has been used: every listed block is
+// re-checked against the bitmap before use, 64 frames per word (up to 4096
+// words for a 1 GiB block), and blocks that frame_alloc() took frames from
+// are split and checked again, so one call can walk the bitmap of several
+// large blocks
+uint64_t frames_alloc(unsigned int order);
+
+// free a block previously returned by frames_alloc() with the same order
+void frames_free(uint64_t paddr, unsigned int order);
+
+// kernel heap (size-class slabs up to 2 KiB, whole frames above), usable
+// once paging_init() has built the direct map
+// size: number of bytes to allocate; returns nullptr on failure
 void *kmalloc(size_t size);
 
+// free memory returned by kmalloc, kcalloc or krealloc (nullptr is ignored)
+void kfree(void *ptr);
+
+// resize an allocation; may move it. krealloc(nullptr, n) == kmalloc(n)
+void *krealloc(void *ptr, size_t size);
+
+// allocate zeroed memory for count objects of size bytes
+void *kcalloc(size_t count, size_t size);
+
+// debug: dump heap live bytes, per-class occupancy and fragmentation
+void heap_dump_stats(void);
+
+// typed object caches for hot fixed-size kernel objects
+#define KMEM_CACHE_LINE 64
+
+typedef struct kmem_cache kmem_cache_t;
+
+// object constructor, run once per object when its slab is created.
+// objects must be returned to the cache in their constructed state.
+typedef void (*kmem_ctor_t)(void *obj, size_t size);
+
+// create a cache of size-byte objects; align 0 means KMEM_CACHE_LINE.
+// ctor may be nullptr, or kmem_ctor_zero for pre-zeroed objects
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align, kmem_ctor_t ctor);
+
+// allocate one object from a cache; returns nullptr on failure
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+// return an object to the cache it came from
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+// constructor that zeroes each object
+void kmem_ctor_zero(void *obj, size_t size);
+
+// debug: dump per-cache occupancy and hit/miss statistics
+void kmem_cache_dump_stats(void);
+
 // return number of physical frames detected
 uint64_t memory_get_nframes(void);
 
+// usable RAM ranges from the Multiboot map; returns the number of ranges
+uint32_t memory_usable_ranges(const memory_range_t **ranges);
+
+// return number of physical frames currently free
+uint64_t memory_get_free_frames(void);
+
 #endif // MEMORY_H
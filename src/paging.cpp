@@ -1,181 +1,477 @@
 #include "paging.h"
 #include "memory.h"
 #include "console.h"
+#include "klog.h"
+#include "cpu.h"
+#include "kstring.h"
 #include <stdint.h>
 
-// 64-bit page table entry flags
-#define PAGE_PRESENT    0x001
-#define PAGE_RW         0x002
-#define PAGE_USER       0x004
-#define PAGE_WRITETHROUGH 0x008
-#define PAGE_CACHE_DISABLE 0x010
-#define PAGE_ACCESSED   0x020
-#define PAGE_DIRTY      0x040
-#define PAGE_HUGE       0x080
-#define PAGE_GLOBAL     0x100
-#define PAGE_NO_EXECUTE 0x8000000000000000ULL
-
 // structure for 64-bit page table entries
 typedef uint64_t page_entry_t;
 
 // global pointer to PML4 table
 static page_entry_t *pml4_table = nullptr;
 
-// get a page table entry pointer
-// static page_entry_t* get_page_entry(page_entry_t* table, int index) {
-//     return &table[index];
-// }
+// page tables come pre-zeroed from a dedicated cache; tables handed back to
+// it must be empty again
+static kmem_cache_t *page_table_cache = nullptr;
+
+// whether the CPU supports 1 GiB pages
+static bool paging_gb_pages = false;
+
+// boot.asm identity-maps the first 1 GiB with 2 MiB pages; page tables
+// needed before the direct map exists must come from there
+#define BOOT_IDENTITY_LIMIT 0x40000000ULL
+#define PAGE_SIZE_2M 0x200000ULL
+#define PAGE_SIZE_1G 0x40000000ULL
+
+// the PAT bit sits in bit 7 of a 4 KiB entry and in bit 12 of a huge one
+#define PAGE_PAT_4K   0x80ULL
+#define PAGE_PAT_HUGE 0x1000ULL
+
+// IA32_PAT layout. entries 0-3 keep their power-on types so PWT/PCD alone
+// mean the same with or without PAT; entry 5 (PAT + PWT) is write-combining.
+#define MSR_IA32_PAT 0x277
+#define PAT_TYPE_UC  0x00ULL
+#define PAT_TYPE_WC  0x01ULL
+#define PAT_TYPE_WT  0x04ULL
+#define PAT_TYPE_WB  0x06ULL
+#define PAT_TYPE_UCM 0x07ULL // UC-, overridable by MTRRs
+#define PAT_VALUE (PAT_TYPE_WB | PAT_TYPE_WT << 8 | PAT_TYPE_UCM << 16 | PAT_TYPE_UC << 24 | \
+                   PAT_TYPE_WB << 32 | PAT_TYPE_WC << 40 | PAT_TYPE_UCM << 48 | PAT_TYPE_UC << 56)
+
+// whether IA32_PAT was programmed with PAT_VALUE
+static bool paging_pat = false;
 
 // get physical address from page entry
 static uint64_t get_phys_addr(page_entry_t entry) {
     return entry & 0x000FFFFFFFFFF000ULL;
 }
 
-// allocate and zero a page table
+// get physical address from a 1 GiB or 2 MiB entry, dropping the PAT bit
+static uint64_t get_huge_phys_addr(page_entry_t entry, uint64_t size) {
+    return get_phys_addr(entry) & ~(size - 1);
+}
+
+// caching bits selecting mem_type for a 4 KiB or a huge entry. without PAT
+// write-combining degrades to uncached
+static uint64_t mem_type_bits(page_mem_type_t mem_type, bool huge) {
+    switch (mem_type) {
+    case PAGE_MEM_WT:
+        return PAGE_WRITETHROUGH;
+    case PAGE_MEM_WC:
+        if (!paging_pat) return PAGE_CACHE_DISABLE | PAGE_WRITETHROUGH;
+        return (huge ? PAGE_PAT_HUGE : PAGE_PAT_4K) | PAGE_WRITETHROUGH;
+    case PAGE_MEM_UC:
+        return PAGE_CACHE_DISABLE | PAGE_WRITETHROUGH;
+    default:
+        return 0;
+    }
+}
+
+// program IA32_PAT if the CPU has it. nothing maps with the PAT bit set yet,
+// so only the caches and TLB need flushing for the new types to take effect
+static void pat_init(void) {
+    uint32_t regs[4];
+    cpu_cpuid(1, 0, regs);
+    if (!(regs[3] & (1u << 16))) {
+        kprintf("paging_init: no PAT, write-combining falls back to uncached\n");
+        return;
+    }
+
+    asm volatile("wbinvd" : : : "memory");
+    cpu_wrmsr(MSR_IA32_PAT, PAT_VALUE);
+    asm volatile("wbinvd" : : : "memory");
+
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    paging_pat = true;
+}
+
+// table indices of a virtual address
+static inline int pml4_index(uint64_t virt) { return (virt >> 39) & 0x1FF; }
+static inline int pdpt_index(uint64_t virt) { return (virt >> 30) & 0x1FF; }
+static inline int pd_index(uint64_t virt) { return (virt >> 21) & 0x1FF; }
+static inline int pt_index(uint64_t virt) { return (virt >> 12) & 0x1FF; }
+
+// allocate a zeroed page table
 static page_entry_t *alloc_page_table() {
-    uint64_t frame = frame_alloc();
-    if (!frame) {
-        kprintf("paging: failed to allocate page table frame\n");
+    page_entry_t *table = (page_entry_t *) kmem_cache_alloc(page_table_cache);
+    if (!table) {
+        kprintf("paging: failed to allocate page table\n");
         return nullptr;
     }
+    return table;
+}
+
+// allocate a zeroed page table from the boot identity map, used while
+// building the direct map
+static page_entry_t *alloc_boot_page_table() {
+    uint64_t frame = frame_alloc();
+    if (!frame || frame + 4096 > BOOT_IDENTITY_LIMIT) {
+        panic("paging: no identity-mapped frame for page tables");
+    }
+    page_entry_t *table = (page_entry_t *) phys_to_virt(frame);
+    kmemset(table, 0, 4096);
+    return table;
+}
 
-    page_entry_t *table = (page_entry_t *) frame;
-    // zero the table
+// return an empty page table to the cache
+static void free_page_table(page_entry_t *table) {
+    kmem_cache_free(page_table_cache, table);
+}
+
+static bool table_is_empty(const page_entry_t *table) {
     for (int i = 0; i < 512; i++) {
-        table[i] = 0;
+        if (table[i]) return false;
     }
+    return true;
+}
 
+// TLB invalidations collected over one range operation. past the threshold
+// a single CR3 reload is cheaper than individual invlpg instructions.
+#define PAGING_FLUSH_THRESHOLD 32
+
+typedef struct {
+    uint64_t addrs[PAGING_FLUSH_THRESHOLD];
+    uint32_t count;
+    bool full;
+} tlb_batch_t;
+
+static void tlb_batch_add(tlb_batch_t *batch, uint64_t virt) {
+    if (batch->full) return;
+    if (batch->count == PAGING_FLUSH_THRESHOLD) {
+        batch->full = true;
+        return;
+    }
+    batch->addrs[batch->count++] = virt;
+}
+
+static void tlb_batch_flush(tlb_batch_t *batch) {
+#ifndef XGOS_HOSTED
+    if (batch->full) {
+        uint64_t cr3;
+        asm volatile("mov %%cr3, %0" : "=r"(cr3));
+        asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+        return;
+    }
+    for (uint32_t i = 0; i < batch->count; i++) {
+        asm volatile("invlpg (%0)" : : "r"(batch->addrs[i]) : "memory");
+    }
+#else
+    (void) batch; // host tests only build tables; there is no TLB to flush
+#endif
+}
+
+// replace a huge page entry with a table of 512 entries one level down that
+// map the same memory with the same flags and memory type. level 3 splits a
+// 1 GiB page into 2 MiB pages, level 2 splits a 2 MiB page into 4 KiB pages.
+static page_entry_t *split_huge_page(page_entry_t *entry, int level, page_entry_t *(*alloc)(),
+                                     tlb_batch_t *batch, uint64_t virt) {
+    page_entry_t *table = alloc();
+    if (!table) return nullptr;
+
+    uint64_t size = (level == 3) ? PAGE_SIZE_1G : PAGE_SIZE_2M;
+    uint64_t step = size / 512;
+    uint64_t base = get_huge_phys_addr(*entry, size);
+    uint64_t flags = *entry & ~(0x000FFFFFFFFFF000ULL);
+    // bit 7 is PAGE_HUGE here but the PAT bit in a 4 KiB entry, so clear it
+    // before the PAT bit moves down into it
+    if (level == 2) flags &= ~PAGE_HUGE;
+    if (*entry & PAGE_PAT_HUGE) {
+        flags |= (level == 2) ? PAGE_PAT_4K : PAGE_PAT_HUGE;
+    }
+
+    for (int i = 0; i < 512; i++) {
+        table[i] = (base + i * step) | flags;
+    }
+    *entry = virt_to_phys(table) | PAGE_PRESENT | PAGE_RW;
+    tlb_batch_add(batch, virt & ~(size - 1));
     return table;
 }
 
+// get the table an entry points to, creating it with alloc if missing and
+// splitting a huge page at that entry. returns nullptr if allocation fails
+static page_entry_t *get_next_table(page_entry_t *entry, int level, page_entry_t *(*alloc)(),
+                                    tlb_batch_t *batch, uint64_t virt) {
+    if (!(*entry & PAGE_PRESENT)) {
+        page_entry_t *table = alloc();
+        if (!table) return nullptr;
+        *entry = virt_to_phys(table) | PAGE_PRESENT | PAGE_RW;
+        return table;
+    }
+    if (*entry & PAGE_HUGE) return split_huge_page(entry, level, alloc, batch, virt);
+    return (page_entry_t *) phys_to_virt(get_phys_addr(*entry));
+}
+
+// whether a page of the given size can map virt -> phys within [virt, end)
+static inline bool page_fits(uint64_t virt, uint64_t phys, uint64_t end, uint64_t size) {
+    return !((virt | phys) & (size - 1)) && end - virt >= size;
+}
+
+// use a huge page at entry unless a lower-level table already lives there
+static inline bool entry_takes_huge(page_entry_t entry) {
+    return !(entry & PAGE_PRESENT) || (entry & PAGE_HUGE);
+}
+
+// large pages used by map_range, for statistics
+typedef struct {
+    uint64_t pages_1g;
+    uint64_t pages_2m;
+    uint64_t pages_4k;
+} map_stats_t;
+
+// map [virt, virt + len) to phys with the largest page size each chunk allows.
+// virt, phys and len must be 4 KiB aligned
+static int map_range(uint64_t virt, uint64_t phys, uint64_t len, uint64_t flags,
+                     page_mem_type_t mem_type, page_entry_t *(*alloc)(), map_stats_t *stats) {
+    tlb_batch_t batch;
+    batch.count = 0;
+    batch.full = false;
+    int result = 0;
+    uint64_t end = virt + len;
+    flags &= ~(PAGE_HUGE | PAGE_WRITETHROUGH | PAGE_CACHE_DISABLE);
+    uint64_t huge_flags = flags | PAGE_HUGE | mem_type_bits(mem_type, true);
+    flags |= mem_type_bits(mem_type, false);
+
+    while (virt < end) {
+        page_entry_t *pdpt = get_next_table(&pml4_table[pml4_index(virt)], 4, alloc, &batch, virt);
+        if (!pdpt) {
+            result = -1;
+            break;
+        }
+        page_entry_t *pdpt_entry = &pdpt[pdpt_index(virt)];
+        if (paging_gb_pages && page_fits(virt, phys, end, PAGE_SIZE_1G) && entry_takes_huge(*pdpt_entry)) {
+            if (*pdpt_entry & PAGE_PRESENT) tlb_batch_add(&batch, virt);
+            *pdpt_entry = phys | huge_flags;
+            stats->pages_1g++;
+            virt += PAGE_SIZE_1G;
+            phys += PAGE_SIZE_1G;
+            continue;
+        }
+
+        page_entry_t *pd = get_next_table(pdpt_entry, 3, alloc, &batch, virt);
+        if (!pd) {
+            result = -1;
+            break;
+        }
+        page_entry_t *pd_entry = &pd[pd_index(virt)];
+        if (page_fits(virt, phys, end, PAGE_SIZE_2M) && entry_takes_huge(*pd_entry)) {
+            if (*pd_entry & PAGE_PRESENT) tlb_batch_add(&batch, virt);
+            *pd_entry = phys | huge_flags;
+            stats->pages_2m++;
+            virt += PAGE_SIZE_2M;
+            phys += PAGE_SIZE_2M;
+            continue;
+        }
+
+        page_entry_t *pt = get_next_table(pd_entry, 2, alloc, &batch, virt);
+        if (!pt) {
+            result = -1;
+            break;
+        }
+        // fill the rest of this page table in one go
+        for (int i = pt_index(virt); i < 512 && virt < end; i++) {
+            if (pt[i] & PAGE_PRESENT) tlb_batch_add(&batch, virt);
+            pt[i] = phys | flags;
+            stats->pages_4k++;
+            virt += 4096;
+            phys += 4096;
+        }
+    }
+
+    tlb_batch_flush(&batch);
+    return result;
+}
+
 extern "C" void paging_init(void) {
     kprintf("paging_init: setting up 64-bit paging structures\n");
 
     // get current PML4 table (set up in boot.asm)
     uint64_t cr3_value;
     asm volatile("mov %%cr3, %0" : "=r"(cr3_value));
-    pml4_table = (page_entry_t *) cr3_value;
+    pml4_table = (page_entry_t *) phys_to_virt(get_phys_addr(cr3_value));
+
+    kprintf("paging_init: using PML4 at 0x%lx\n", get_phys_addr(cr3_value));
+
+    uint32_t regs[4] = {0, 0, 0, 0};
+    if (cpu_cpuid_max_ext() >= 0x80000001) cpu_cpuid(0x80000001, 0, regs);
+    paging_gb_pages = regs[3] & (1u << 26);
+
+    pat_init();
+
+    // the basic identity mapping is already set up in boot.asm using 2MB pages;
+    // map every usable RAM range into the higher half so every frame is
+    // reachable. ranges are widened to 2 MiB boundaries.
+    const memory_range_t *ranges;
+    uint32_t count = memory_usable_ranges(&ranges);
+    map_stats_t stats = {0, 0, 0};
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t start = ranges[i].base & ~(PAGE_SIZE_2M - 1);
+        uint64_t end = (ranges[i].base + ranges[i].len + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1);
+        map_range(PHYSMAP_BASE + start, start, end - start, PAGE_PRESENT | PAGE_RW, PAGE_MEM_WB,
+                  alloc_boot_page_table, &stats);
+    }
+    kprintf("paging_init: direct map at 0x%llx: %lu 1G pages, %lu 2M pages\n",
+            PHYSMAP_BASE, stats.pages_1g, stats.pages_2m);
 
-    kprintf("paging_init: using PML4 at 0x%lx\n", (uint64_t) pml4_table);
+    // switch physical accesses over to the direct map
+    g_physmap_offset = PHYSMAP_BASE;
+    pml4_table = (page_entry_t *) phys_to_virt(get_phys_addr(cr3_value));
 
-    // the basic identity mapping is already set up in boot.asm using 2MB pages
+    page_table_cache = kmem_cache_create("page_table", 4096, 4096, kmem_ctor_zero);
+    if (!page_table_cache) {
+        panic("paging_init: cannot create page table cache");
+    }
 
     uint64_t total_frames = memory_get_nframes();
     kprintf("paging_init: managing %lu frames of memory\n", total_frames);
 
-    // map additional memory regions if needed
-    // for rn 2MB identity mapping from boot should be sufficient
-
     kprintf("paging_init: 64-bit paging initialized\n");
 }
 
-// map a virtual address to a physical address with given flags
-void paging_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
-    if (!pml4_table) {
-        kprintf("paging_map_page: PML4 not initialized\n");
-        return;
+#ifdef XGOS_HOSTED
+uint64_t *paging_init_hosted(void) {
+    page_table_cache = kmem_cache_create("page_table", 4096, 4096, kmem_ctor_zero);
+    if (!page_table_cache) panic("paging_init_hosted: cannot create page table cache");
+    pml4_table = alloc_page_table();
+    paging_gb_pages = true;
+    paging_pat = true;
+    return pml4_table;
+}
+#endif
+
+// map a virtual range to a physical range using the largest page sizes that
+// fit, flushing the TLB once at the end
+int paging_map_range(uint64_t virt_addr, uint64_t phys_addr, uint64_t len, uint64_t flags,
+                     page_mem_type_t mem_type) {
+    if (!pml4_table || !page_table_cache) {
+        kprintf("paging_map_range: paging not initialized\n");
+        return -1;
     }
-
-    // extract indices for 4-level paging
-    int pml4_index = (virt_addr >> 39) & 0x1FF;
-    int pdpt_index = (virt_addr >> 30) & 0x1FF;
-    int pd_index = (virt_addr >> 21) & 0x1FF;
-    int pt_index = (virt_addr >> 12) & 0x1FF;
-
-    // get or create PDPT
-    page_entry_t *pdpt_table;
-    if (!(pml4_table[pml4_index] & PAGE_PRESENT)) {
-        pdpt_table = alloc_page_table();
-        if (!pdpt_table) return;
-        pml4_table[pml4_index] = (uint64_t) pdpt_table | PAGE_PRESENT | PAGE_RW;
-    } else {
-        pdpt_table = (page_entry_t *) get_phys_addr(pml4_table[pml4_index]);
+    if ((virt_addr ^ phys_addr) & 0xFFF) {
+        kprintf("paging_map_range: 0x%lx and 0x%lx differ in page offset\n", virt_addr, phys_addr);
+        return -1;
     }
 
-    // get or create PD
-    page_entry_t *pd_table;
-    if (!(pdpt_table[pdpt_index] & PAGE_PRESENT)) {
-        pd_table = alloc_page_table();
-        if (!pd_table) return;
-        pdpt_table[pdpt_index] = (uint64_t) pd_table | PAGE_PRESENT | PAGE_RW;
-    } else {
-        pd_table = (page_entry_t *) get_phys_addr(pdpt_table[pdpt_index]);
-    }
+    uint64_t offset = virt_addr & 0xFFF;
+    len = (len + offset + 4095) & ~4095ULL;
+    map_stats_t stats = {0, 0, 0};
+    return map_range(virt_addr - offset, phys_addr - offset, len, flags, mem_type,
+                     alloc_page_table, &stats);
+}
 
-    // get or create PT
-    page_entry_t *pt_table;
-    if (!(pd_table[pd_index] & PAGE_PRESENT)) {
-        pt_table = alloc_page_table();
-        if (!pt_table) return;
-        pd_table[pd_index] = (uint64_t) pt_table | PAGE_PRESENT | PAGE_RW;
-    } else {
-        pt_table = (page_entry_t *) get_phys_addr(pd_table[pd_index]);
+// unmap a virtual range, splitting huge pages that are only partly covered
+// and releasing page tables that become empty
+void paging_unmap_range(uint64_t virt_addr, uint64_t len) {
+    if (!pml4_table || !page_table_cache) return;
+
+    tlb_batch_t batch;
+    batch.count = 0;
+    batch.full = false;
+    uint64_t virt = virt_addr & ~4095ULL;
+    uint64_t end = (virt_addr + len + 4095) & ~4095ULL;
+
+    while (virt < end) {
+        page_entry_t *pml4_entry = &pml4_table[pml4_index(virt)];
+        if (!(*pml4_entry & PAGE_PRESENT)) {
+            virt = (virt + (1ULL << 39)) & ~((1ULL << 39) - 1);
+            continue;
+        }
+        page_entry_t *pdpt = (page_entry_t *) phys_to_virt(get_phys_addr(*pml4_entry));
+
+        page_entry_t *pdpt_entry = &pdpt[pdpt_index(virt)];
+        if (!(*pdpt_entry & PAGE_PRESENT)) {
+            virt = (virt + PAGE_SIZE_1G) & ~(PAGE_SIZE_1G - 1);
+            continue;
+        }
+        if ((*pdpt_entry & PAGE_HUGE) && page_fits(virt, 0, end, PAGE_SIZE_1G)) {
+            *pdpt_entry = 0;
+            tlb_batch_add(&batch, virt);
+            virt += PAGE_SIZE_1G;
+            continue;
+        }
+        page_entry_t *pd = get_next_table(pdpt_entry, 3, alloc_page_table, &batch, virt);
+        if (!pd) break;
+
+        page_entry_t *pd_entry = &pd[pd_index(virt)];
+        if (!(*pd_entry & PAGE_PRESENT)) {
+            virt = (virt + PAGE_SIZE_2M) & ~(PAGE_SIZE_2M - 1);
+            continue;
+        }
+        if ((*pd_entry & PAGE_HUGE) && page_fits(virt, 0, end, PAGE_SIZE_2M)) {
+            *pd_entry = 0;
+            tlb_batch_add(&batch, virt);
+            virt += PAGE_SIZE_2M;
+        } else {
+            page_entry_t *pt = get_next_table(pd_entry, 2, alloc_page_table, &batch, virt);
+            if (!pt) break;
+            for (int i = pt_index(virt); i < 512 && virt < end; i++) {
+                if (pt[i] & PAGE_PRESENT) tlb_batch_add(&batch, virt);
+                pt[i] = 0;
+                virt += 4096;
+            }
+            // page tables always come from the cache (boot.asm and the
+            // direct map only use huge pages), so empty ones can go back
+            if (table_is_empty(pt)) {
+                *pd_entry = 0;
+                tlb_batch_add(&batch, virt - 4096);
+                free_page_table(pt);
+            }
+        }
     }
 
-    // set the final page table entry
-    pt_table[pt_index] = (phys_addr & 0x000FFFFFFFFFF000ULL) | flags;
+    tlb_batch_flush(&batch);
+}
 
-    // invalidate TLB for this page
-    asm volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+// map a virtual address to a physical address with given flags
+void paging_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
+    page_mem_type_t mem_type = PAGE_MEM_WB;
+    if (flags & PAGE_CACHE_DISABLE) {
+        mem_type = PAGE_MEM_UC;
+    } else if (flags & PAGE_WRITETHROUGH) {
+        mem_type = PAGE_MEM_WT;
+    }
+    klog(KLOG_DEBUG, "paging: map 0x%lx -> 0x%lx flags 0x%lx\n", virt_addr, phys_addr, flags);
+    paging_map_range(virt_addr, phys_addr, 4096, flags, mem_type);
 }
 
 // unmap a virtual address
 void paging_unmap_page(uint64_t virt_addr) {
-    if (!pml4_table) return;
-
-    int pml4_index = (virt_addr >> 39) & 0x1FF;
-    int pdpt_index = (virt_addr >> 30) & 0x1FF;
-    int pd_index = (virt_addr >> 21) & 0x1FF;
-    int pt_index = (virt_addr >> 12) & 0x1FF;
-
-    if (!(pml4_table[pml4_index] & PAGE_PRESENT)) return;
-    page_entry_t *pdpt_table = (page_entry_t *) get_phys_addr(pml4_table[pml4_index]);
-
-    if (!(pdpt_table[pdpt_index] & PAGE_PRESENT)) return;
-    page_entry_t *pd_table = (page_entry_t *) get_phys_addr(pdpt_table[pdpt_index]);
-
-    if (!(pd_table[pd_index] & PAGE_PRESENT)) return;
-    page_entry_t *pt_table = (page_entry_t *) get_phys_addr(pd_table[pd_index]);
-
-    // clear the page table entry
-    pt_table[pt_index] = 0;
-
-    // invalidate TLB for this page
-    asm volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+    paging_unmap_range(virt_addr, 4096);
 }
 
 // get physical address for a virtual address (page table walk)
 uint64_t paging_get_physical(uint64_t virt_addr) {
     if (!pml4_table) return 0;
 
-    int pml4_index = (virt_addr >> 39) & 0x1FF;
-    int pdpt_index = (virt_addr >> 30) & 0x1FF;
-    int pd_index = (virt_addr >> 21) & 0x1FF;
-    int pt_index = (virt_addr >> 12) & 0x1FF;
-
-    if (!(pml4_table[pml4_index] & PAGE_PRESENT)) return 0;
-    page_entry_t *pdpt_table = (page_entry_t *) get_phys_addr(pml4_table[pml4_index]);
+    page_entry_t entry = pml4_table[pml4_index(virt_addr)];
+    if (!(entry & PAGE_PRESENT)) return 0;
+    page_entry_t *pdpt_table = (page_entry_t *) phys_to_virt(get_phys_addr(entry));
 
-    if (!(pdpt_table[pdpt_index] & PAGE_PRESENT)) return 0;
-    page_entry_t *pd_table = (page_entry_t *) get_phys_addr(pdpt_table[pdpt_index]);
+    entry = pdpt_table[pdpt_index(virt_addr)];
+    if (!(entry & PAGE_PRESENT)) return 0;
 
     // check for 1GB pages
-    if (pdpt_table[pdpt_index] & PAGE_HUGE) {
-        return get_phys_addr(pdpt_table[pdpt_index]) + (virt_addr & 0x3FFFFFFF);
+    if (entry & PAGE_HUGE) {
+        return get_huge_phys_addr(entry, PAGE_SIZE_1G) + (virt_addr & 0x3FFFFFFF);
     }
+    page_entry_t *pd_table = (page_entry_t *) phys_to_virt(get_phys_addr(entry));
 
-    if (!(pd_table[pd_index] & PAGE_PRESENT)) return 0;
+    entry = pd_table[pd_index(virt_addr)];
+    if (!(entry & PAGE_PRESENT)) return 0;
 
     // check for 2MB pages
-    if (pd_table[pd_index] & PAGE_HUGE) {
-        return get_phys_addr(pd_table[pd_index]) + (virt_addr & 0x1FFFFF);
+    if (entry & PAGE_HUGE) {
+        return get_huge_phys_addr(entry, PAGE_SIZE_2M) + (virt_addr & 0x1FFFFF);
     }
+    page_entry_t *pt_table = (page_entry_t *) phys_to_virt(get_phys_addr(entry));
 
-    page_entry_t *pt_table = (page_entry_t *) get_phys_addr(pd_table[pd_index]);
-
-    if (!(pt_table[pt_index] & PAGE_PRESENT)) return 0;
+    entry = pt_table[pt_index(virt_addr)];
+    if (!(entry & PAGE_PRESENT)) return 0;
 
-    return get_phys_addr(pt_table[pt_index]) + (virt_addr & 0xFFF);
+    return get_phys_addr(entry) + (virt_addr & 0xFFF);
 }
 
 // map framebuffer memory region to virtual memory with proper flags
@@ -188,16 +484,30 @@ int paging_map_framebuffer(uint64_t phys_addr, uint64_t size) {
     // round size up to page boundary
     size = (size + 4095) & ~4095ULL;
 
-    // map framebuffer with identity mapping (virtual = physical)
-    uint64_t flags = PAGE_PRESENT | PAGE_RW | PAGE_CACHE_DISABLE;
+    // map framebuffer with identity mapping (virtual = physical). write-combining
+    // lets the CPU merge pixel stores into full bus bursts
+    uint64_t flags = PAGE_PRESENT | PAGE_RW;
 
-    kprintf("paging: mapping framebuffer 0x%lx size 0x%lx\n", phys_addr, size);
+    kprintf("paging: mapping framebuffer 0x%lx size 0x%lx (%s)\n", phys_addr, size,
+            paging_pat ? "write-combining" : "uncached");
 
-    for (uint64_t offset = 0; offset < size; offset += 4096) {
-        uint64_t addr = phys_addr + offset;
-        paging_map_page(addr, addr, flags);
+    if (paging_map_range(phys_addr, phys_addr, size, flags, PAGE_MEM_WC) != 0) {
+        kprintf("paging: framebuffer mapping failed\n");
+        return -1;
     }
 
     kprintf("paging: framebuffer mapping complete\n");
     return 0;
 }
+
+// map device registers with identity mapping, uncached
+int paging_map_mmio(uint64_t phys_addr, uint64_t size) {
+    if (!pml4_table) {
+        kprintf("paging_map_mmio: PML4 not initialized\n");
+        return -1;
+    }
+
+    uint64_t start = phys_addr & ~4095ULL;
+    uint64_t end = (phys_addr + size + 4095) & ~4095ULL;
+    return paging_map_range(start, start, end - start, PAGE_PRESENT | PAGE_RW, PAGE_MEM_UC);
+}
@@ -7,22 +7,62 @@
 extern "C" {
 #endif
 
+// 64-bit page table entry flags
+#define PAGE_PRESENT    0x001
+#define PAGE_RW         0x002
+#define PAGE_USER       0x004
+#define PAGE_WRITETHROUGH 0x008
+#define PAGE_CACHE_DISABLE 0x010
+#define PAGE_ACCESSED   0x020
+#define PAGE_DIRTY      0x040
+#define PAGE_HUGE       0x080
+#define PAGE_GLOBAL     0x100
+#define PAGE_NO_EXECUTE 0x8000000000000000ULL
+
+// memory types selectable through the PAT programmed by paging_init()
+typedef enum {
+    PAGE_MEM_WB = 0, // write-back, normal RAM
+    PAGE_MEM_WT = 1, // write-through
+    PAGE_MEM_WC = 2, // write-combining, for framebuffers
+    PAGE_MEM_UC = 3  // uncached, for MMIO registers
+} page_mem_type_t;
+
 // basic paging is already enabled in boot.asm
 // set 4-level page tables
 void paging_init(void);
 
-// map a virtual address to a physical address with given flags
+// map a virtual address to a physical address with given flags.
+// PAGE_CACHE_DISABLE maps it uncached, PAGE_WRITETHROUGH write-through
 void paging_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags);
 
 // unmap a virtual address
 void paging_unmap_page(uint64_t virt_addr);
 
+// map [virt_addr, virt_addr + len) to phys_addr using 1 GiB/2 MiB pages
+// wherever both addresses are aligned, 4 KiB pages elsewhere; the TLB is
+// flushed once at the end. the caching bits of flags are replaced by the
+// encoding of mem_type. returns 0 on success, -1 on failure
+int paging_map_range(uint64_t virt_addr, uint64_t phys_addr, uint64_t len, uint64_t flags,
+                     page_mem_type_t mem_type);
+
+// unmap a virtual range, splitting huge pages that are only partly covered
+void paging_unmap_range(uint64_t virt_addr, uint64_t len);
+
 // get physical address for a virtual address (page table walk)
 uint64_t paging_get_physical(uint64_t virt_addr);
 
 // map framebuffer memory region to virtual memory
 int paging_map_framebuffer(uint64_t phys_addr, uint64_t size);
 
+// identity-map device registers uncached; returns 0 on success, -1 on failure
+int paging_map_mmio(uint64_t phys_addr, uint64_t size);
+
+#ifdef XGOS_HOSTED
+// host tests: an empty PML4 of tables in RAM that is never loaded, with 1 GiB
+// pages and PAT assumed present. returns the PML4 for tests to walk
+uint64_t *paging_init_hosted(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,129 @@
+#include "serial.h"
+#include "console.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "io.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define COM1 0x3F8
+
+// 16550 registers, as offsets from the base port
+#define UART_DATA 0 // DLAB=0: rx/tx buffer; DLAB=1: divisor low
+#define UART_IER 1  // DLAB=0: interrupt enable; DLAB=1: divisor high
+#define UART_IIR 2  // read: interrupt identification
+#define UART_FCR 2  // write: FIFO control
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+
+#define UART_LCR_DLAB 0x80
+#define UART_LCR_8N1 0x03
+#define UART_LSR_THRE 0x20 // transmit holding register empty
+#define UART_IER_THRE 0x02 // interrupt when the transmitter empties
+#define UART_IIR_NONE 0x01 // no interrupt pending
+#define UART_MCR_OUT2 0x08 // gates the UART interrupt onto the bus
+#define UART_FIFO_SIZE 16
+
+// power of two, so indices wrap with a mask
+#define SERIAL_RING_SIZE 16384
+
+static char ring[SERIAL_RING_SIZE];
+// head is advanced by writers, tail by the transmitter; both only with
+// interrupts disabled, and free-running so full and empty differ
+static volatile uint32_t ring_head = 0;
+static volatile uint32_t ring_tail = 0;
+
+static bool serial_ready = false;
+static bool serial_irq = false;
+static uint8_t serial_ier = 0;
+
+static console_sink_t serial_sink = {"serial", serial_write, serial_flush, nullptr};
+
+int serial_init(void) {
+    outb(COM1 + UART_IER, 0x00); // no interrupts until serial_enable_irq()
+    outb(COM1 + UART_LCR, UART_LCR_DLAB);
+    outb(COM1 + UART_DATA, 1); // divisor 1: 115200 baud
+    outb(COM1 + UART_IER, 0);
+    outb(COM1 + UART_LCR, UART_LCR_8N1);
+    outb(COM1 + UART_FCR, 0xC7); // enable and clear FIFOs, 14 byte threshold
+
+    // loopback self-test: a missing UART reads back 0xFF
+    outb(COM1 + UART_MCR, 0x1E);
+    outb(COM1 + UART_DATA, 0xAE);
+    if (inb(COM1 + UART_DATA) != 0xAE) return -1;
+
+    outb(COM1 + UART_MCR, 0x0B); // normal operation, DTR/RTS/OUT2
+    serial_ready = true;
+    console_register_sink(&serial_sink);
+    return 0;
+}
+
+// move up to one FIFO's worth from the ring to the UART; the caller has seen
+// THRE, so the whole FIFO is free. called with interrupts disabled
+static void serial_fill_fifo(void) {
+    for (int i = 0; i < UART_FIFO_SIZE && ring_tail != ring_head; i++) {
+        outb(COM1 + UART_DATA, (uint8_t) ring[ring_tail & (SERIAL_RING_SIZE - 1)]);
+        ring_tail = ring_tail + 1;
+    }
+}
+
+// send until the ring is empty, polling THRE. called with interrupts disabled
+static void serial_drain_polled(void) {
+    while (ring_tail != ring_head) {
+        while (!(inb(COM1 + UART_LSR) & UART_LSR_THRE)) {
+        }
+        serial_fill_fifo();
+    }
+}
+
+static void serial_irq_handler(interrupt_frame_t *) {
+    if (inb(COM1 + UART_IIR) & UART_IIR_NONE) return;
+    if (inb(COM1 + UART_LSR) & UART_LSR_THRE) serial_fill_fifo();
+    // nothing left to send: stop THRE interrupts until the next write
+    if (ring_tail == ring_head && (serial_ier & UART_IER_THRE)) {
+        serial_ier &= ~UART_IER_THRE;
+        outb(COM1 + UART_IER, serial_ier);
+    }
+}
+
+void serial_enable_irq(void) {
+    if (!serial_ready) return;
+    irq_set_handler(IRQ_COM1, serial_irq_handler);
+    serial_irq = true;
+}
+
+static void serial_push(char c) {
+    if (ring_head - ring_tail == SERIAL_RING_SIZE) {
+        // full: make room the slow way rather than lose output
+        serial_drain_polled();
+    }
+    ring[ring_head & (SERIAL_RING_SIZE - 1)] = c;
+    ring_head = ring_head + 1;
+}
+
+void serial_write(const char *s, size_t len) {
+    if (!serial_ready) return;
+
+    uint64_t flags = cpu_irq_save();
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\n') serial_push('\r');
+        serial_push(s[i]);
+    }
+
+    if (!serial_irq) {
+        serial_drain_polled();
+    } else if (!(serial_ier & UART_IER_THRE)) {
+        // enabling the interrupt with the transmitter empty raises it at once
+        serial_ier |= UART_IER_THRE;
+        outb(COM1 + UART_IER, serial_ier);
+    }
+    cpu_irq_restore(flags);
+}
+
+void serial_flush(void) {
+    if (!serial_ready) return;
+    uint64_t flags = cpu_irq_save();
+    serial_drain_polled();
+    cpu_irq_restore(flags);
+}
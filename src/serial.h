@@ -0,0 +1,32 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// COM1 16550 UART console sink. output is queued in a ring buffer and sent
+// by polling until serial_enable_irq(), then from THR-empty interrupts, so
+// writers only wait on the port when the ring is full
+
+// program COM1 for 115200 8N1 and register it as a console sink; returns 0
+// on success, -1 if no UART answers
+int serial_init(void);
+
+// drain through IRQ 4 from now on; needs interrupts_init()
+void serial_enable_irq(void);
+
+// queue len bytes, '\n' as "\r\n"; dropped before serial_init()
+void serial_write(const char *s, size_t len);
+
+// send everything queued by polling, with interrupts disabled
+void serial_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERIAL_H
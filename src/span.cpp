@@ -0,0 +1,307 @@
+#include "span.h"
+#include "console.h"
+#include "cpu.h"
+#include "kstring.h"
+#include "span_simd.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// spans shorter than this use plain stores; rep stos has a startup cost of
+// a few dozen cycles that only pays off on longer runs
+#define SPAN_SMALL 32
+
+// fills of at least this many bytes use non-temporal stores on CPUs without
+// ERMS. they are larger than the caches anyway, so going around them avoids
+// evicting everything else and skips the read-for-ownership of every line.
+// with ERMS, rep stos already switches to streaming stores for long runs
+// and beats movnti at every size
+#define SPAN_NT_BYTES (256 * 1024)
+
+// rectangles of at least this many rows use vector stores. they save a few
+// cycles per row over rep stos, which only pays for the register state save
+// in kernel_fpu_begin() once enough rows share it
+#define SPAN_WIDE_ROWS 32
+
+// copies of at least this many pixels use the vector key and blend loops,
+// which are several times faster per pixel than the scalar ones and soon
+// make up for the register state save
+#define SPAN_COPY_VECTOR 64
+
+// overlapping rows that must be copied back to front go through a buffer
+// this many pixels at a time
+#define SPAN_COPY_CHUNK 64
+
+typedef void (*span_fill_fn)(uint32_t *dst, uint32_t value, size_t count);
+
+// one row of a keyed or blended copy; blends ignore key
+typedef void (*span_copy_fn)(uint32_t *dst, const uint32_t *src, size_t count, uint32_t key);
+
+// movnti only needs SSE2 support, not SSE register state
+static bool span_have_movnti = false;
+static bool span_use_movnti = false;
+// widest vector fill the CPU and the enabled register state allow
+static span_fill_fn span_fill_wide = nullptr;
+static span_copy_fn span_key_wide = nullptr;
+static span_copy_fn span_blend_wide = nullptr;
+
+static void key_scalar(uint32_t *dst, const uint32_t *src, size_t count, uint32_t key) {
+    for (size_t i = 0; i < count; i++) {
+        if (src[i] != key) dst[i] = src[i];
+    }
+}
+
+static void blend_scalar(uint32_t *dst, const uint32_t *src, size_t count, uint32_t) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t s = src[i];
+        uint32_t alpha = s >> 24;
+        if (alpha == 255) dst[i] = s;
+        else if (s) dst[i] = span_blend_pixel(dst[i], s);
+    }
+}
+
+static void blend_sse2(uint32_t *dst, const uint32_t *src, size_t count, uint32_t) {
+    span_blend_sse2(dst, src, count);
+}
+
+static void blend_avx2(uint32_t *dst, const uint32_t *src, size_t count, uint32_t) {
+    span_blend_avx2(dst, src, count);
+}
+
+void span_init(void) {
+    uint32_t regs[4];
+    cpu_cpuid(1, 0, regs);
+    span_have_movnti = regs[3] & (1u << 26);
+    span_use_movnti = span_have_movnti && !g_cpu_features.erms;
+
+    span_fill_wide = nullptr;
+    span_key_wide = nullptr;
+    span_blend_wide = nullptr;
+    if (g_cpu_features.avx2) {
+        span_fill_wide = span_fill_avx2;
+        span_key_wide = span_key_avx2;
+        span_blend_wide = blend_avx2;
+    } else if (g_cpu_features.sse2) {
+        span_fill_wide = span_fill_sse2;
+        span_key_wide = span_key_sse2;
+        span_blend_wide = blend_sse2;
+    }
+}
+
+static void fill_scalar(uint32_t *dst, uint32_t value, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = value;
+    }
+}
+
+// rep stosq after aligning dst to 8 bytes; count must be non-zero
+static void fill_stos(uint32_t *dst, uint32_t value, size_t count) {
+    if ((uintptr_t) dst & 4) {
+        *dst++ = value;
+        count--;
+    }
+    uint64_t pattern = ((uint64_t) value << 32) | value;
+    size_t qwords = count / 2;
+    asm volatile("rep stosq" : "+D"(dst), "+c"(qwords) : "a"(pattern) : "memory");
+    if (count & 1) *dst = value;
+}
+
+// movnti after aligning dst to 8 bytes; count must be non-zero. the caller
+// issues the sfence once the whole fill is done
+static void fill_nt(uint32_t *dst, uint32_t value, size_t count) {
+    if ((uintptr_t) dst & 4) {
+        *dst++ = value;
+        count--;
+    }
+    uint64_t pattern = ((uint64_t) value << 32) | value;
+    uint64_t *q = (uint64_t *) dst;
+    size_t qwords = count / 2;
+    size_t i = 0;
+    for (; i + 4 <= qwords; i += 4) {
+        asm volatile("movnti %1, 0(%0)\n\t"
+                     "movnti %1, 8(%0)\n\t"
+                     "movnti %1, 16(%0)\n\t"
+                     "movnti %1, 24(%0)"
+                     : : "r"(q + i), "r"(pattern) : "memory");
+    }
+    for (; i < qwords; i++) {
+        asm volatile("movnti %1, (%0)" : : "r"(q + i), "r"(pattern) : "memory");
+    }
+    if (count & 1) dst[count - 1] = value;
+}
+
+static inline void span_sfence(void) {
+    asm volatile("sfence" : : : "memory");
+}
+
+// store strategy for height runs of width pixels totalling bytes
+static span_fill_fn span_pick(size_t width, size_t height, uint64_t bytes) {
+    if (width < SPAN_SMALL) return fill_scalar;
+    if (span_use_movnti && bytes >= SPAN_NT_BYTES) return fill_nt;
+    if (span_fill_wide && height >= SPAN_WIDE_ROWS) return span_fill_wide;
+    return fill_stos;
+}
+
+static inline bool span_is_vector(span_fill_fn fill) {
+    return fill == span_fill_sse2 || fill == span_fill_avx2;
+}
+
+static void fill_rows(span_fill_fn fill, uint32_t *dst, size_t stride, size_t width, size_t height,
+                      uint32_t value) {
+    if (width == stride) {
+        fill(dst, value, width * height);
+        return;
+    }
+    for (size_t row = 0; row < height; row++) {
+        fill(dst, value, width);
+        dst += stride;
+    }
+}
+
+void span_fill(uint32_t *dst, uint32_t value, size_t count) {
+    if (!count) return;
+    span_fill_fn fill = span_pick(count, 1, (uint64_t) count * 4);
+    fill(dst, value, count);
+    if (fill == fill_nt) span_sfence();
+}
+
+void span_fill_rect(uint32_t *dst, size_t stride, size_t width, size_t height, uint32_t value) {
+    if (!width || !height) return;
+    // contiguous rows make one long span, so pick by the total length
+    bool contiguous = width == stride;
+    span_fill_fn fill = span_pick(contiguous ? width * height : width, contiguous ? 1 : height,
+                                  (uint64_t) width * height * 4);
+
+    bool vector = span_is_vector(fill);
+    if (vector) kernel_fpu_begin();
+    fill_rows(fill, dst, stride, width, height, value);
+    if (vector) kernel_fpu_end();
+    if (fill == fill_nt) span_sfence();
+}
+
+// whether the pixels of two rectangles share memory, with dst's after src's
+static bool copy_backwards(uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, size_t width,
+                           size_t height) {
+    uintptr_t d = (uintptr_t) dst, s = (uintptr_t) src;
+    uintptr_t d_end = (uintptr_t) (dst + (height - 1) * dst_stride + width);
+    uintptr_t s_end = (uintptr_t) (src + (height - 1) * src_stride + width);
+    return d > s && d < s_end && s < d_end;
+}
+
+// run copy over every row. when dst overlaps src from behind, rows go bottom
+// up, and a row that overlaps its own source goes back to front through a
+// small buffer, so no source pixel is overwritten before it is read
+static void copy_rows(span_copy_fn copy, uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride,
+                      size_t width, size_t height, uint32_t key) {
+    if (!copy_backwards(dst, dst_stride, src, src_stride, width, height)) {
+        for (size_t row = 0; row < height; row++) copy(dst + row * dst_stride, src + row * src_stride, width, key);
+        return;
+    }
+
+    uint32_t chunk[SPAN_COPY_CHUNK];
+    for (size_t row = height; row--;) {
+        uint32_t *d = dst + row * dst_stride;
+        const uint32_t *s = src + row * src_stride;
+        if (d <= s || d >= s + width) {
+            copy(d, s, width, key);
+            continue;
+        }
+        for (size_t end = width; end;) {
+            size_t n = end < SPAN_COPY_CHUNK ? end : SPAN_COPY_CHUNK;
+            end -= n;
+            kmemcpy(chunk, s + end, n * 4);
+            copy(d + end, chunk, n, key);
+        }
+    }
+}
+
+static void copy_rect(span_copy_fn scalar, span_copy_fn wide, uint32_t *dst, size_t dst_stride, const uint32_t *src,
+                      size_t src_stride, size_t width, size_t height, uint32_t key) {
+    if (!width || !height) return;
+    if (width == dst_stride && width == src_stride) {
+        width *= height;
+        height = 1;
+    }
+    if (!wide || width * height < SPAN_COPY_VECTOR) {
+        copy_rows(scalar, dst, dst_stride, src, src_stride, width, height, key);
+        return;
+    }
+    kernel_fpu_begin();
+    copy_rows(wide, dst, dst_stride, src, src_stride, width, height, key);
+    kernel_fpu_end();
+}
+
+void span_copy_rect(uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, size_t width,
+                    size_t height) {
+    if (!width || !height) return;
+    if (width == dst_stride && width == src_stride) {
+        kmemmove(dst, src, width * height * 4);
+        return;
+    }
+    // kmemmove() handles a row overlapping its own source; the row order
+    // handles the rest
+    if (copy_backwards(dst, dst_stride, src, src_stride, width, height)) {
+        for (size_t row = height; row--;) kmemmove(dst + row * dst_stride, src + row * src_stride, width * 4);
+    } else {
+        for (size_t row = 0; row < height; row++) kmemmove(dst + row * dst_stride, src + row * src_stride, width * 4);
+    }
+}
+
+void span_key_rect(uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, size_t width,
+                   size_t height, uint32_t key) {
+    copy_rect(key_scalar, span_key_wide, dst, dst_stride, src, src_stride, width, height, key);
+}
+
+void span_blend_rect(uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, size_t width,
+                     size_t height) {
+    copy_rect(blend_scalar, span_blend_wide, dst, dst_stride, src, src_stride, width, height, 0);
+}
+
+// --- fill self-benchmark ---
+#define SPAN_BENCH_BYTES (32ULL << 20)
+
+// fill a width x height rectangle repeatedly and report throughput
+static void span_bench_run(const char *name, span_fill_fn fill, uint32_t *buffer, size_t stride,
+                           size_t width, size_t height, uint64_t tsc_hz) {
+    uint64_t bytes = (uint64_t) width * height * 4;
+    uint64_t reps = SPAN_BENCH_BYTES / bytes;
+    if (!reps) reps = 1;
+
+    bool vector = span_is_vector(fill);
+    uint64_t start = cpu_rdtsc();
+    for (uint64_t i = 0; i < reps; i++) {
+        // pay for the state save on every fill, as span_fill_rect() does
+        if (vector) kernel_fpu_begin();
+        fill_rows(fill, buffer, stride, width, height, (uint32_t) i);
+        if (vector) kernel_fpu_end();
+    }
+    if (fill == fill_nt) span_sfence();
+    uint64_t cycles = cpu_rdtsc() - start;
+    if (!cycles) cycles = 1;
+
+    if (tsc_hz) {
+        kprintf(" %s %lu MB/s", name, bytes * reps * (tsc_hz / 1000) / cycles / 1000);
+    } else {
+        kprintf(" %s %lu B/kcycle", name, bytes * reps * 1000 / cycles);
+    }
+}
+
+void span_benchmark(uint32_t *buffer, size_t stride, uint32_t width, uint32_t height) {
+    static const uint32_t sizes[] = {16, 64, 256, 0};
+    uint64_t tsc_hz = cpu_tsc_hz();
+
+    kprintf("span_benchmark: solid fills, %s\n", tsc_hz ? "MB/s" : "bytes per 1000 TSC cycles");
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        // size 0 stands for a full clear of the buffer
+        size_t w = sizes[i] ? sizes[i] : width;
+        size_t h = sizes[i] ? sizes[i] : height;
+        if (w > width || h > height) continue;
+
+        kprintf("  %lux%lu:", w, h);
+        span_bench_run("scalar", fill_scalar, buffer, stride, w, h, tsc_hz);
+        span_bench_run("rep stos", fill_stos, buffer, stride, w, h, tsc_hz);
+        if (span_have_movnti) span_bench_run("movnti", fill_nt, buffer, stride, w, h, tsc_hz);
+        if (g_cpu_features.sse2) span_bench_run("sse2", span_fill_sse2, buffer, stride, w, h, tsc_hz);
+        if (g_cpu_features.avx2) span_bench_run("avx2", span_fill_avx2, buffer, stride, w, h, tsc_hz);
+        kprintf("\n");
+    }
+}
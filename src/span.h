@@ -0,0 +1,49 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// solid fills and copies of 32-bit pixel spans. every solid-fill graphics
+// primitive and every blit goes through these so the store strategy is
+// chosen in one place
+
+// pick store strategies from g_cpu_features (call once after cpu_init())
+void span_init(void);
+
+// fill count pixels starting at dst with value
+void span_fill(uint32_t *dst, uint32_t value, size_t count);
+
+// fill height rows of width pixels, rows stride pixels apart. rows that are
+// contiguous (width == stride) are filled as a single span
+void span_fill_rect(uint32_t *dst, size_t stride, size_t width, size_t height, uint32_t value);
+
+// pixel copies between rectangles of width x height, rows stride pixels
+// apart. the two may overlap, as when scrolling within one bitmap
+
+// plain copy
+void span_copy_rect(uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, size_t width,
+                    size_t height);
+
+// copy the source pixels not equal to key
+void span_key_rect(uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, size_t width,
+                   size_t height, uint32_t key);
+
+// premultiplied source-over: each byte of dst becomes the source byte plus
+// the dst byte scaled by 255 minus the source alpha in bits 24-31
+void span_blend_rect(uint32_t *dst, size_t dst_stride, const uint32_t *src, size_t src_stride, size_t width,
+                     size_t height);
+
+// report fill throughput for several rectangle sizes inside a width x height
+// buffer, per store strategy
+void span_benchmark(uint32_t *buffer, size_t stride, uint32_t width, uint32_t height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPAN_H
@@ -0,0 +1,47 @@
+#ifndef SPAN_SIMD_H
+#define SPAN_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// vector span fills, each built in its own translation unit with the
+// matching -m flag. callers check g_cpu_features and hold
+// kernel_fpu_begin() around them
+void span_fill_sse2(uint32_t *dst, uint32_t value, size_t count);
+
+void span_fill_avx2(uint32_t *dst, uint32_t value, size_t count);
+
+// per-pixel loops behind span_key_rect() and span_blend_rect(). they run
+// front to back, which is safe for overlapping spans with dst before src
+void span_key_sse2(uint32_t *dst, const uint32_t *src, size_t count, uint32_t key);
+
+void span_blend_sse2(uint32_t *dst, const uint32_t *src, size_t count);
+
+void span_key_avx2(uint32_t *dst, const uint32_t *src, size_t count, uint32_t key);
+
+void span_blend_avx2(uint32_t *dst, const uint32_t *src, size_t count);
+
+// premultiplied source-over of one pixel: each byte of dst scaled by 255
+// minus the source alpha (bits 24-31), rounded, plus the source byte. the
+// vector loops compute exactly this, including bytes that wrap when src is
+// not properly premultiplied
+static inline uint32_t span_blend_pixel(uint32_t dst, uint32_t src) {
+    uint32_t inv = 255 - (src >> 24);
+    // two channels at a time in 16-bit lanes; x / 255 rounded is
+    // (t + (t >> 8)) >> 8 with t = x + 128
+    uint32_t rb = (dst & 0x00FF00FF) * inv + 0x00800080;
+    uint32_t ag = ((dst >> 8) & 0x00FF00FF) * inv + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    ag = ((ag + ((ag >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    return (((src & 0x00FF00FF) + rb) & 0x00FF00FF) | (((src & 0xFF00FF00) + (ag << 8)) & 0xFF00FF00);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPAN_SIMD_H
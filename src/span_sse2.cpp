@@ -0,0 +1,100 @@
+#include "span_simd.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// compiled with -msse2; see span_simd.h for the calling rules
+
+typedef uint32_t span_vec_t __attribute__((vector_size(16)));
+typedef uint32_t span_vec_unaligned_t __attribute__((vector_size(16), aligned(1)));
+typedef int32_t span_mask_t __attribute__((vector_size(16)));
+typedef uint16_t span_vec16_t __attribute__((vector_size(16)));
+typedef uint8_t span_vec8_t __attribute__((vector_size(16)));
+typedef char span_bytes_t __attribute__((vector_size(16)));
+
+void span_fill_sse2(uint32_t *dst, uint32_t value, size_t count) {
+    // align the destination to the vector size
+    while (count && ((uintptr_t) dst & 15)) {
+        *dst++ = value;
+        count--;
+    }
+
+    span_vec_t pattern = {value, value, value, value};
+    span_vec_t *vdst = (span_vec_t *) dst;
+    size_t vectors = count / 4;
+    size_t i = 0;
+    for (; i + 4 <= vectors; i += 4) {
+        vdst[i] = pattern;
+        vdst[i + 1] = pattern;
+        vdst[i + 2] = pattern;
+        vdst[i + 3] = pattern;
+    }
+    for (; i < vectors; i++) {
+        vdst[i] = pattern;
+    }
+
+    dst += vectors * 4;
+    for (count %= 4; count; count--) {
+        *dst++ = value;
+    }
+}
+
+// one bit per byte of a comparison result
+static inline int mask_bits(span_mask_t mask) {
+    return __builtin_ia32_pmovmskb128((span_bytes_t) mask);
+}
+
+static inline bool all_set(span_mask_t mask) {
+    return mask_bits(mask) == 0xFFFF;
+}
+
+static inline bool any_set(span_mask_t mask) {
+    return mask_bits(mask) != 0;
+}
+
+void span_key_sse2(uint32_t *dst, const uint32_t *src, size_t count, uint32_t key) {
+    const span_vec_unaligned_t *vs = (const span_vec_unaligned_t *) src;
+    span_vec_unaligned_t *vd = (span_vec_unaligned_t *) dst;
+    span_vec_t k = (span_vec_t) {} + key;
+    size_t vectors = count / 4;
+    for (size_t i = 0; i < vectors; i++) {
+        span_vec_t s = vs[i];
+        span_mask_t keyed = s == k;
+        if (!any_set(keyed)) {
+            vd[i] = s;
+        } else if (!all_set(keyed)) {
+            span_vec_t m = (span_vec_t) keyed;
+            vd[i] = (vd[i] & m) | (s & ~m);
+        }
+    }
+    for (size_t i = vectors * 4; i < count; i++) {
+        if (src[i] != key) dst[i] = src[i];
+    }
+}
+
+void span_blend_sse2(uint32_t *dst, const uint32_t *src, size_t count) {
+    const span_vec_unaligned_t *vs = (const span_vec_unaligned_t *) src;
+    span_vec_unaligned_t *vd = (span_vec_unaligned_t *) dst;
+    size_t vectors = count / 4;
+    for (size_t i = 0; i < vectors; i++) {
+        span_vec_t s = vs[i];
+        span_vec_t alpha = s >> 24;
+        // sprites are mostly opaque or clear; both leave one side untouched
+        if (all_set(alpha == 255)) {
+            vd[i] = s;
+            continue;
+        }
+        if (!any_set(s != 0)) continue;
+
+        // the scalar formula in 16-bit lanes, the inverse alpha in both
+        // lanes of each pixel
+        span_vec_t inv = 255 - alpha;
+        span_vec16_t inv16 = (span_vec16_t) (inv | (inv << 16));
+        span_vec16_t d = (span_vec16_t) vd[i];
+        span_vec16_t rb = (d & 0xFF) * inv16 + 128;
+        span_vec16_t ag = (d >> 8) * inv16 + 128;
+        rb = (rb + (rb >> 8)) >> 8;
+        ag = (ag + (ag >> 8)) >> 8;
+        vd[i] = (span_vec_t) ((span_vec8_t) s + (span_vec8_t) (rb | (ag << 8)));
+    }
+    for (size_t i = vectors * 4; i < count; i++) dst[i] = span_blend_pixel(dst[i], src[i]);
+}
@@ -0,0 +1,138 @@
+#include "time.h"
+#include "acpi.h"
+#include "console.h"
+#include "cpu.h"
+#include "io.h"
+#include "paging.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// each calibration run measures this long; the shortest of a few runs wins,
+// since interrupts and SMIs only ever make a run longer
+#define TIME_CALIBRATE_MS 10
+#define TIME_CALIBRATE_RUNS 3
+
+// PIT channel 2, gated through port 0x61
+#define PIT_HZ 1193182
+#define PIT_CH2 0x42
+#define PIT_CMD 0x43
+#define PIT_GATE 0x61
+
+// HPET registers, as offsets from the base in the ACPI HPET table
+#define HPET_GCAP_ID 0x000 // bits 63:32: counter period in femtoseconds
+#define HPET_GEN_CONF 0x010
+#define HPET_MAIN_COUNTER 0x0F0
+#define HPET_ENABLE 0x1
+
+typedef struct __attribute__((packed)) {
+    acpi_sdt_header_t header;
+    uint32_t event_timer_block_id;
+    uint8_t address_space; // generic address structure; 0 = memory
+    uint8_t register_bit_width;
+    uint8_t register_bit_offset;
+    uint8_t reserved;
+    uint64_t address;
+    uint8_t hpet_number;
+    uint16_t minimum_tick;
+    uint8_t page_protection;
+} acpi_hpet_t;
+
+static uint64_t tsc_hz = 0;
+static uint64_t tsc_base = 0;
+// ns = (cycles * ns_mult) >> 32
+static uint64_t ns_mult = 0;
+static bool tsc_invariant = false;
+
+static volatile uint64_t *hpet_regs = nullptr;
+static uint64_t hpet_period_fs = 0;
+
+static inline uint64_t hpet_read(uint32_t reg) {
+    return hpet_regs[reg / 8];
+}
+
+static bool hpet_init(void) {
+    const acpi_hpet_t *table = (const acpi_hpet_t *) acpi_find_table("HPET");
+    if (!table || table->address_space != 0 || !table->address) return false;
+    if (paging_map_mmio(table->address, 1024) != 0) return false;
+
+    hpet_regs = (volatile uint64_t *) (uintptr_t) table->address;
+    hpet_period_fs = hpet_read(HPET_GCAP_ID) >> 32;
+    // the spec caps the period at 100 ns
+    if (!hpet_period_fs || hpet_period_fs > 100000000ULL) {
+        hpet_regs = nullptr;
+        return false;
+    }
+    hpet_regs[HPET_GEN_CONF / 8] = hpet_read(HPET_GEN_CONF) | HPET_ENABLE;
+    return true;
+}
+
+// TSC ticks during TIME_CALIBRATE_MS of the HPET main counter
+static uint64_t hpet_calibrate(void) {
+    uint64_t ticks = (uint64_t) TIME_CALIBRATE_MS * 1000000000000ULL / hpet_period_fs;
+    uint64_t start = hpet_read(HPET_MAIN_COUNTER);
+    uint64_t tsc0 = cpu_rdtsc();
+    while (hpet_read(HPET_MAIN_COUNTER) - start < ticks) {
+    }
+    uint64_t tsc1 = cpu_rdtsc();
+    uint64_t elapsed = hpet_read(HPET_MAIN_COUNTER) - start;
+    // scale by the counter ticks actually seen
+    return (tsc1 - tsc0) * ticks / elapsed;
+}
+
+// TSC ticks during TIME_CALIBRATE_MS of PIT channel 2 in one-shot mode
+static uint64_t pit_calibrate(void) {
+    const uint16_t count = PIT_HZ * TIME_CALIBRATE_MS / 1000;
+    outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01); // gate on, speaker off
+    outb(PIT_CMD, 0xB0); // channel 2, lobyte/hibyte, mode 0
+    outb(PIT_CH2, count & 0xFF);
+    outb(PIT_CH2, count >> 8);
+    uint64_t start = cpu_rdtsc();
+    while (!(inb(PIT_GATE) & 0x20)) {
+    }
+    return cpu_rdtsc() - start;
+}
+
+void time_init(void) {
+    uint32_t regs[4];
+    if (cpu_cpuid_max_ext() >= 0x80000007) {
+        cpu_cpuid(0x80000007, 0, regs);
+        tsc_invariant = regs[3] & (1u << 8);
+    }
+
+    bool hpet = hpet_init();
+    uint64_t best = ~0ULL;
+    for (int i = 0; i < TIME_CALIBRATE_RUNS; i++) {
+        uint64_t ticks = hpet ? hpet_calibrate() : pit_calibrate();
+        if (ticks < best) best = ticks;
+    }
+    tsc_hz = best * (1000 / TIME_CALIBRATE_MS);
+    ns_mult = (1000000000ULL << 32) / tsc_hz;
+    tsc_base = cpu_rdtsc();
+
+    uint64_t cpuid_hz = cpu_tsc_hz();
+    kprintf("time: TSC %lu kHz against the %s, %s", tsc_hz / 1000, hpet ? "HPET" : "PIT",
+            tsc_invariant ? "invariant" : "not invariant");
+    if (cpuid_hz) kprintf(", CPUID reports %lu kHz", cpuid_hz / 1000);
+    kprintf("\n");
+}
+
+uint64_t time_now_ns(void) {
+    if (!tsc_hz) return 0;
+    return (uint64_t) (((unsigned __int128) (cpu_rdtsc() - tsc_base) * ns_mult) >> 32);
+}
+
+void time_sleep_us(uint64_t us) {
+    if (!tsc_hz) return;
+    uint64_t end = cpu_rdtsc() + us * (tsc_hz / 1000) / 1000;
+    while ((int64_t) (cpu_rdtsc() - end) < 0) {
+        asm volatile("pause");
+    }
+}
+
+uint64_t time_tsc_hz(void) {
+    return tsc_hz;
+}
+
+bool time_tsc_invariant(void) {
+    return tsc_invariant;
+}
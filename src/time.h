@@ -0,0 +1,33 @@
+#ifndef TIME_H
+#define TIME_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// monotonic time from the TSC, calibrated against the HPET when ACPI lists
+// one and against PIT channel 2 otherwise
+
+// calibrate the TSC (needs paging_init() for the HPET registers)
+void time_init(void);
+
+// nanoseconds since time_init(); 0 before it
+uint64_t time_now_ns(void);
+
+// busy-wait for at least us microseconds; returns at once before time_init()
+void time_sleep_us(uint64_t us);
+
+// calibrated TSC frequency in Hz, 0 before time_init()
+uint64_t time_tsc_hz(void);
+
+// whether the TSC runs at a constant rate in all power states
+// (CPUID 0x80000007 EDX bit 8), so it can be trusted as a clock
+bool time_tsc_invariant(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIME_H
@@ -0,0 +1,175 @@
+// stand-ins for the kernel services the host-built modules call
+#include "host_shims.h"
+#include "boot_trace.h"
+#include "console.h"
+#include "cpu.h"
+#include "graphics.h"
+#include "klog.h"
+#include "memory.h"
+#include "time.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+cpu_features_t g_cpu_features;
+bool g_host_quiet = false;
+
+char g_host_console[HOST_CONSOLE_SIZE];
+size_t g_host_console_len = 0;
+
+// kernel messages skip the log ring and go straight to stdout; only the
+// ring's own tests render through console_write()
+void kprintf(const char *format, ...) {
+    if (g_host_quiet) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void klog(klog_level_t level, const char *format, ...) {
+    if (g_host_quiet || level > KLOG_INFO) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static console_sink_t *host_sinks = nullptr;
+
+void console_register_sink(console_sink_t *sink) {
+    sink->next = host_sinks;
+    host_sinks = sink;
+}
+
+// captured for the tests, then passed to the sinks registered on the host
+void console_write(const char *s, size_t len) {
+    for (console_sink_t *sink = host_sinks; sink; sink = sink->next) sink->write(s, len);
+    if (len > HOST_CONSOLE_SIZE - g_host_console_len) len = HOST_CONSOLE_SIZE - g_host_console_len;
+    memcpy(g_host_console + g_host_console_len, s, len);
+    g_host_console_len += len;
+}
+
+void console_flush(void) {
+    for (console_sink_t *sink = host_sinks; sink; sink = sink->next) {
+        if (sink->flush) sink->flush();
+    }
+}
+
+void panic(const char *msg) {
+    fprintf(stderr, "PANIC: %s\n", msg);
+    abort();
+}
+
+// user space cannot cli, and nothing else uses the vector registers
+void kernel_fpu_begin(void) {
+}
+
+void kernel_fpu_end(void) {
+}
+
+// boot phases are not traced on the host
+void boot_trace(const char *) {
+}
+
+// the host's monotonic clock stands in for the calibrated TSC
+uint64_t time_now_ns(void) {
+    return host_now_ns();
+}
+
+// the TSC rate is not known on the host; klog timestamps stay in cycles
+uint64_t time_tsc_hz(void) {
+    return 0;
+}
+
+void time_sleep_us(uint64_t us) {
+    struct timespec ts = {(time_t) (us / 1000000), (long) (us % 1000000) * 1000};
+    nanosleep(&ts, nullptr);
+}
+
+// report what the host CPU supports, as cpu_init() would on hardware
+void host_detect_cpu(void) {
+    __builtin_cpu_init();
+    g_cpu_features.sse2 = __builtin_cpu_supports("sse2");
+    g_cpu_features.sse41 = __builtin_cpu_supports("sse4.1");
+    g_cpu_features.avx = __builtin_cpu_supports("avx");
+    g_cpu_features.avx2 = __builtin_cpu_supports("avx2");
+
+    uint32_t regs[4];
+    cpu_cpuid(0, 0, regs);
+    if (regs[0] >= 7) {
+        cpu_cpuid(7, 0, regs);
+        g_cpu_features.erms = regs[1] & (1u << 9);
+        g_cpu_features.fsrm = regs[3] & (1u << 4);
+    }
+}
+
+void host_boot_memory(void) {
+    void *ram = mmap((void *) HOST_RAM_BASE, HOST_RAM_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+    if (ram != (void *) HOST_RAM_BASE) {
+        perror("host_boot_memory: cannot map fake RAM");
+        exit(1);
+    }
+    // metadata placed in the gap faults instead of going unnoticed
+    if (mprotect(ram, HOST_RAM_GAP_SIZE, PROT_NONE) != 0) {
+        perror("host_boot_memory: cannot protect the reserved gap");
+        exit(1);
+    }
+
+    // memory_init() takes a 32-bit Multiboot pointer
+    uint8_t *low = (uint8_t *) mmap(nullptr, 2 * 4096, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (low == MAP_FAILED) {
+        perror("host_boot_memory: cannot map Multiboot info");
+        exit(1);
+    }
+
+    struct mmap_entry {
+        uint32_t size;
+        uint64_t addr;
+        uint64_t len;
+        uint32_t type;
+    } __attribute__((packed));
+    const mmap_entry entries[] = {
+        {20, HOST_RAM_BASE, HOST_RAM_GAP_SIZE, 2},
+        {20, HOST_RAM_BASE + HOST_RAM_GAP_SIZE, HOST_RAM_HOLE_BASE - HOST_RAM_BASE - HOST_RAM_GAP_SIZE, 1},
+        {20, HOST_RAM_HOLE_BASE, HOST_RAM_HOLE_SIZE, 2},
+        {20, HOST_RAM_HOLE_BASE + HOST_RAM_HOLE_SIZE,
+         HOST_RAM_BASE + HOST_RAM_SIZE - HOST_RAM_HOLE_BASE - HOST_RAM_HOLE_SIZE, 1},
+    };
+
+    multiboot_info_t *mbi = (multiboot_info_t *) low;
+    memset(mbi, 0, sizeof(*mbi));
+    mbi->flags = 1 << 6;
+    mbi->mmap_addr = (uint32_t) (uintptr_t) (low + 4096);
+    mbi->mmap_length = sizeof(entries);
+    memcpy(low + 4096, entries, sizeof(entries));
+
+    memory_init((uint32_t) (uintptr_t) mbi);
+}
+
+int host_graphics_init(host_framebuffer_t *fb, uint32_t width, uint32_t height) {
+    graphics_pixel_format_t format;
+    graphics_pixel_format_init(&format, 32, 16, 8, 8, 8, 0, 8);
+    return host_graphics_init_format(fb, width, height, &format);
+}
+
+int host_graphics_init_format(host_framebuffer_t *fb, uint32_t width, uint32_t height,
+                              const graphics_pixel_format_t *format) {
+    fb->width = width;
+    fb->height = height;
+    fb->pitch = width * format->bytes + 256;
+    fb->pixels = (uint32_t *) aligned_alloc(4096, ((size_t) fb->pitch * height + 4095) & ~(size_t) 4095);
+    if (!fb->pixels) return -1;
+    memset(fb->pixels, 0, (size_t) fb->pitch * height);
+    return graphics_init_simple(fb->pixels, width, height, fb->pitch, format);
+}
+
+void host_graphics_cleanup(host_framebuffer_t *fb) {
+    graphics_cleanup();
+    free(fb->pixels);
+    fb->pixels = nullptr;
+}
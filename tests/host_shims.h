@@ -0,0 +1,60 @@
+#ifndef HOST_SHIMS_H
+#define HOST_SHIMS_H
+
+#include "graphics.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// physical memory the host build hands to memory_init(). the test binaries
+// are linked with __bss_end at HOST_RAM_BASE, so the fake RAM starts right
+// after the kernel image
+#define HOST_RAM_BASE 0x40000000ULL
+#define HOST_RAM_SIZE (512ULL << 20)
+// reserved and inaccessible right after the kernel image; memory_init()
+// has to carve its metadata out of usable RAM past it
+#define HOST_RAM_GAP_SIZE (64ULL << 10)
+// reserved hole inside the fake RAM, so tests can check it is never handed out
+#define HOST_RAM_HOLE_BASE (HOST_RAM_BASE + (256ULL << 20))
+#define HOST_RAM_HOLE_SIZE (4ULL << 20)
+
+// when set, kprintf() output from the kernel modules is dropped
+extern bool g_host_quiet;
+
+// what the klog ring rendered through console_write(); tests reset the length
+#define HOST_CONSOLE_SIZE (256 * 1024)
+extern char g_host_console[HOST_CONSOLE_SIZE];
+extern size_t g_host_console_len;
+
+// fill g_cpu_features from the host CPU
+void host_detect_cpu(void);
+
+// map the fake RAM and run memory_init() on a Multiboot map describing it
+void host_boot_memory(void);
+
+// malloc'd stand-in for the linear framebuffer. rows are padded past the
+// visible width, as VRAM pitches often are
+typedef struct {
+    uint32_t *pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch; // bytes per row
+} host_framebuffer_t;
+
+// allocate an XRGB8888 framebuffer and run graphics_init_simple() on it;
+// needs host_boot_memory() first for the back buffer. returns 0 on success
+int host_graphics_init(host_framebuffer_t *fb, uint32_t width, uint32_t height);
+
+// the same for VRAM in any layout; pixels then holds format->bytes per pixel
+int host_graphics_init_format(host_framebuffer_t *fb, uint32_t width, uint32_t height,
+                              const graphics_pixel_format_t *format);
+
+void host_graphics_cleanup(host_framebuffer_t *fb);
+
+static inline uint64_t host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif // HOST_SHIMS_H
@@ -0,0 +1,33 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// failed checks so far, across all groups
+extern unsigned g_test_failures;
+
+// report a failed check but keep going, so one run shows every broken case
+#define CHECK(cond, ...)                                                                   \
+    do {                                                                                   \
+        if (!(cond)) {                                                                     \
+            if (g_test_failures++ < 20) {                                                  \
+                printf("  FAIL %s:%d: ", __FILE__, __LINE__);                              \
+                printf(__VA_ARGS__);                                                       \
+                printf("\n");                                                              \
+            }                                                                              \
+        }                                                                                  \
+    } while (0)
+
+// test groups, run in this order by xgos_tests. test_kstring, test_klog and
+// test_kformat do not need host_boot_memory(); the others run on the fake RAM it sets up
+void test_kstring(void);
+void test_klog(void);
+void test_kformat(void);
+void test_math(void);
+void test_memory(void);
+void test_heap(void);
+void test_paging(void);
+void test_graphics(void);
+void test_fbcon(void);
+
+#endif // TEST_H
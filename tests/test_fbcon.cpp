@@ -0,0 +1,81 @@
+// the framebuffer text console (src/fbcon.cpp), fed through console_write()
+// and checked in the malloc'd framebuffer after console_flush()
+#include "test.h"
+#include "host_shims.h"
+#include "console.h"
+#include "fbcon.h"
+#include "graphics.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_WIDTH 640
+#define TEST_HEIGHT 480
+#define COLS (TEST_WIDTH / 8)
+#define ROWS (TEST_HEIGHT / 8)
+
+static host_framebuffer_t fb;
+static uint32_t fg_pixel, bg_pixel;
+
+static void write_str(const char *s) {
+    console_write(s, strlen(s));
+}
+
+// whether text cell (col, row) of the framebuffer shows c
+static bool cell_shows(uint32_t col, uint32_t row, char c) {
+    const uint8_t *glyph = graphics_glyph(c);
+    for (uint32_t y = 0; y < 8; y++) {
+        const uint32_t *line = (const uint32_t *) ((uint8_t *) fb.pixels + (size_t) (row * 8 + y) * fb.pitch);
+        for (uint32_t x = 0; x < 8; x++) {
+            if (line[col * 8 + x] != ((glyph[y] >> x) & 1 ? fg_pixel : bg_pixel)) return false;
+        }
+    }
+    return true;
+}
+
+static void test_text(void) {
+    write_str("Hi\tx\n");
+    console_flush();
+    CHECK(cell_shows(0, 1, 'H') && cell_shows(1, 1, 'i'), "first line not drawn");
+    CHECK(cell_shows(2, 1, ' ') && cell_shows(8, 1, 'x'), "tab did not advance to column 8");
+
+    // a line longer than the screen wraps
+    char line[COLS + 3];
+    memset(line, 'w', COLS);
+    memcpy(line + COLS, "ab\n", 3);
+    console_write(line, sizeof(line));
+    console_flush();
+    CHECK(cell_shows(COLS - 1, 2, 'w') && cell_shows(0, 3, 'a') && cell_shows(1, 3, 'b'), "long line did not wrap");
+}
+
+static void test_scroll(void) {
+    // scroll far enough that the ring origin wraps around
+    char line[32];
+    for (int i = 0; i < 3 * ROWS; i++) {
+        snprintf(line, sizeof(line), "%c%d\n", 'A' + i % 26, i);
+        write_str(line);
+    }
+    console_flush();
+    // the cursor sits on an empty bottom row; the last line is above it
+    int last = 3 * ROWS - 1;
+    CHECK(cell_shows(0, ROWS - 2, (char) ('A' + last % 26)), "last line not on the second to last row");
+    int top = last - (ROWS - 2);
+    CHECK(cell_shows(0, 0, (char) ('A' + top % 26)), "top row does not show line %d", top);
+    CHECK(cell_shows(0, ROWS - 1, ' ') && cell_shows(5, ROWS - 1, ' '), "bottom row not cleared");
+}
+
+void test_fbcon(void) {
+    CHECK(host_graphics_init(&fb, TEST_WIDTH, TEST_HEIGHT) == 0, "graphics_init_simple failed");
+    CHECK(fbcon_init() == 0, "fbcon_init failed");
+    fg_pixel = graphics_color_to_pixel(COLOR_GRAY);
+    bg_pixel = graphics_color_to_pixel(COLOR_BLACK);
+    // fbcon_init() starts with a blank screen; with host kprintf its banner
+    // did not reach the console
+    CHECK(cell_shows(0, 0, ' '), "screen not cleared");
+    write_str("\n");
+
+    test_text();
+    test_scroll();
+
+    fbcon_release();
+    host_graphics_cleanup(&fb);
+}
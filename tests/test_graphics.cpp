@@ -0,0 +1,775 @@
+// graphics primitives (src/graphics.cpp) drawing into the back buffer over a
+// malloc'd framebuffer, checked against a plain reference image, plus the
+// dirty-rectangle swap that must leave the framebuffer equal to it. clipped
+// and off-screen drawing goes through surfaces. VRAM in the other pixel
+// layouts must receive the back buffer converted
+#include "test.h"
+#include "host_shims.h"
+#include "cpu.h"
+#include "graphics.h"
+#include "span.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_WIDTH 640
+#define TEST_HEIGHT 480
+
+static uint32_t ref[TEST_HEIGHT][TEST_WIDTH];
+
+// the part of ref the reference drawing changes: the whole image unless a
+// test pushes a clip rectangle
+static graphics_rect_t ref_clip = {0, 0, TEST_WIDTH, TEST_HEIGHT};
+
+static bool ref_visible(int64_t x, int64_t y) {
+    return x >= ref_clip.x0 && x < ref_clip.x1 && y >= ref_clip.y0 && y < ref_clip.y1;
+}
+
+static void ref_fill(int64_t x, int64_t y, int64_t w, int64_t h, uint32_t pixel) {
+    for (int64_t j = y > ref_clip.y0 ? y : ref_clip.y0; j < y + h && j < ref_clip.y1; j++) {
+        for (int64_t i = x > ref_clip.x0 ? x : ref_clip.x0; i < x + w && i < ref_clip.x1; i++) ref[j][i] = pixel;
+    }
+}
+
+static color_t random_color(void) {
+    return {(uint8_t) rand(), (uint8_t) rand(), (uint8_t) rand(), 255};
+}
+
+static bool surface_matches(const surface_t *surface) {
+    for (uint32_t y = 0; y < TEST_HEIGHT; y++) {
+        if (memcmp(surface->pixels + (size_t) y * surface->stride, ref[y], sizeof(ref[y]))) return false;
+    }
+    return true;
+}
+
+// compare the drawing surface (back buffer, or VRAM without one) to ref
+static bool draw_matches(void) {
+    return surface_matches(graphics_screen());
+}
+
+static bool framebuffer_matches(const host_framebuffer_t *fb) {
+    for (uint32_t y = 0; y < TEST_HEIGHT; y++) {
+        if (memcmp((uint8_t *) fb->pixels + (size_t) y * fb->pitch, ref[y], sizeof(ref[y]))) return false;
+    }
+    return true;
+}
+
+static void test_colors(void) {
+    color_t c = {0x12, 0x34, 0x56, 255};
+    uint32_t pixel = graphics_color_to_pixel(c);
+    CHECK(pixel == 0x123456, "color_to_pixel gave 0x%x", pixel);
+    color_t back = graphics_pixel_to_color(pixel);
+    CHECK(back.red == c.red && back.green == c.green && back.blue == c.blue, "pixel_to_color round trip");
+
+    graphics_put_pixel(3, 4, c);
+    color_t got = graphics_get_pixel(3, 4);
+    CHECK(got.red == c.red && got.green == c.green && got.blue == c.blue, "get_pixel after put_pixel");
+    ref[4][3] = pixel;
+    // off-screen writes are dropped
+    graphics_put_pixel(TEST_WIDTH, 0, c);
+    graphics_put_pixel(0, TEST_HEIGHT, c);
+}
+
+static void test_fills(const host_framebuffer_t *fb) {
+    srand(3);
+    unsigned int draw_bad = 0;
+    unsigned int swap_bad = 0;
+
+    for (int frame = 0; frame < 500; frame++) {
+        for (int op = 0; op < 1 + rand() % 20; op++) {
+            // sizes reach past the right and bottom edges to exercise clipping
+            uint32_t x = (uint32_t) rand() % (TEST_WIDTH + 16);
+            uint32_t y = (uint32_t) rand() % (TEST_HEIGHT + 16);
+            uint32_t w = (uint32_t) rand() % (rand() % 4 ? 80 : TEST_WIDTH);
+            uint32_t h = (uint32_t) rand() % (rand() % 4 ? 80 : TEST_HEIGHT);
+            color_t color = random_color();
+            uint32_t pixel = graphics_color_to_pixel(color);
+
+            switch (rand() % 8) {
+            case 0:
+                graphics_draw_horizontal_line(x, y, w, color);
+                if (x < TEST_WIDTH && y < TEST_HEIGHT) ref_fill(x, y, w, 1, pixel);
+                break;
+            case 1:
+                graphics_draw_vertical_line(x, y, h, color);
+                if (x < TEST_WIDTH && y < TEST_HEIGHT) ref_fill(x, y, 1, h, pixel);
+                break;
+            case 2:
+                graphics_draw_rect(x, y, w, h, color);
+                if (w && h && x < TEST_WIDTH && y < TEST_HEIGHT) {
+                    ref_fill(x, y, w, 1, pixel);
+                    ref_fill(x, y, 1, h, pixel);
+                    if ((int64_t) y + h - 1 < TEST_HEIGHT) ref_fill(x, y + h - 1, w, 1, pixel);
+                    if ((int64_t) x + w - 1 < TEST_WIDTH) ref_fill(x + w - 1, y, 1, h, pixel);
+                }
+                break;
+            case 3:
+                if (frame % 50 == 0) {
+                    graphics_clear_screen(color);
+                    ref_fill(0, 0, TEST_WIDTH, TEST_HEIGHT, pixel);
+                    break;
+                }
+                [[fallthrough]];
+            default:
+                graphics_fill_rect(x, y, w, h, color);
+                if (x < TEST_WIDTH && y < TEST_HEIGHT) ref_fill(x, y, w, h, pixel);
+                break;
+            }
+        }
+        if (!draw_matches()) draw_bad++;
+        graphics_swap_buffers();
+        if (!framebuffer_matches(fb)) swap_bad++;
+    }
+    CHECK(draw_bad == 0, "%u frames drew differently from the reference", draw_bad);
+    CHECK(swap_bad == 0, "%u frames left the framebuffer out of date after swap", swap_bad);
+}
+
+// per-pixel reference for graphics_draw_string*()
+static void ref_text(int64_t x, int64_t y, const char *str, uint32_t fg, uint32_t bg, bool transparent) {
+    int64_t pos = x;
+    for (; *str; str++) {
+        if (*str == '\n') {
+            pos = x;
+            y += 8;
+            continue;
+        }
+        const uint8_t *glyph = graphics_glyph(*str);
+        for (int row = 0; glyph && row < 8; row++) {
+            for (int col = 0; col < 8; col++) {
+                int64_t px = pos + col, py = y + row;
+                if (!ref_visible(px, py)) continue;
+                if ((glyph[row] >> col) & 1) ref[py][px] = fg;
+                else if (!transparent) ref[py][px] = bg;
+            }
+        }
+        pos += 8;
+    }
+}
+
+static void test_text(const host_framebuffer_t *fb) {
+    static const char *const strings[] = {
+        "Hello, world!", "two\nlines", "tab\tand \x01 unprintable", "~{|}~ 0123456789 @#$%",
+    };
+    srand(5);
+    unsigned int bad = 0;
+    for (int i = 0; i < 400; i++) {
+        // positions reach past the right and bottom edges to exercise clipping
+        uint32_t x = (uint32_t) rand() % (TEST_WIDTH + 8);
+        uint32_t y = (uint32_t) rand() % (TEST_HEIGHT + 8);
+        if (i % 4 == 0) x = TEST_WIDTH - (uint32_t) rand() % 60;
+        const char *str = strings[rand() % 4];
+        color_t fg = random_color(), bg = random_color();
+        bool transparent = rand() % 2;
+        if (transparent) graphics_draw_string_transparent(x, y, str, fg);
+        else graphics_draw_string(x, y, str, fg, bg);
+        ref_text(x, y, str, graphics_color_to_pixel(fg), graphics_color_to_pixel(bg), transparent);
+        if (!draw_matches()) bad++;
+    }
+    CHECK(bad == 0, "%u strings drew differently from the reference", bad);
+
+    graphics_draw_char(TEST_WIDTH - 3, 10, 'W', COLOR_WHITE, COLOR_BLUE);
+    ref_text(TEST_WIDTH - 3, 10, "W", graphics_color_to_pixel(COLOR_WHITE), graphics_color_to_pixel(COLOR_BLUE), false);
+    CHECK(draw_matches(), "clipped draw_char differs");
+    graphics_swap_buffers();
+    CHECK(framebuffer_matches(fb), "framebuffer out of date after drawing text");
+}
+
+// reference: every pixel of the rectangle [x0, x1] x [y0, y1] whose offset
+// from the nearest point of the inner box [ix0, ix1] x [iy0, iy1] lies in the
+// ellipse with radii rx, ry
+static void ref_rounded(int64_t ix0, int64_t iy0, int64_t ix1, int64_t iy1, int64_t rx, int64_t ry, uint32_t pixel) {
+    for (int64_t y = iy0 - ry; y <= iy1 + ry; y++) {
+        for (int64_t x = ix0 - rx; x <= ix1 + rx; x++) {
+            if (!ref_visible(x, y)) continue;
+            int64_t dx = x < ix0 ? ix0 - x : x > ix1 ? x - ix1 : 0;
+            int64_t dy = y < iy0 ? iy0 - y : y > iy1 ? y - iy1 : 0;
+            if (dx * dx * ry * ry + dy * dy * rx * rx <= rx * rx * ry * ry) ref[y][x] = pixel;
+        }
+    }
+}
+
+static void test_shapes(const host_framebuffer_t *fb) {
+    srand(7);
+    unsigned int bad = 0;
+    for (int i = 0; i < 300; i++) {
+        // centers reach past the right and bottom edges to exercise clipping
+        uint32_t x = (uint32_t) rand() % (TEST_WIDTH + 40);
+        uint32_t y = (uint32_t) rand() % (TEST_HEIGHT + 40);
+        uint32_t a = (uint32_t) rand() % (rand() % 4 ? 40 : 400);
+        uint32_t b = (uint32_t) rand() % (rand() % 4 ? 40 : 400);
+        color_t color = random_color();
+        uint32_t pixel = graphics_color_to_pixel(color);
+        switch (i % 3) {
+        case 0:
+            graphics_fill_circle(x, y, a, color);
+            ref_rounded(x, y, x, y, a, a, pixel);
+            break;
+        case 1:
+            graphics_fill_ellipse(x, y, a, b, color);
+            ref_rounded(x, y, x, y, a, b, pixel);
+            break;
+        default: {
+            uint32_t w = a + 1, h = b + 1, r = (uint32_t) rand() % 30;
+            graphics_fill_rounded_rect(x, y, w, h, r, color);
+            if (r > (w - 1) / 2) r = (w - 1) / 2;
+            if (r > (h - 1) / 2) r = (h - 1) / 2;
+            ref_rounded(x + r, y + r, x + w - 1 - r, y + h - 1 - r, r, r, pixel);
+            break;
+        }
+        }
+        if (!draw_matches()) bad++;
+    }
+    CHECK(bad == 0, "%u shapes drew differently from the reference", bad);
+    graphics_swap_buffers();
+    CHECK(framebuffer_matches(fb), "framebuffer out of date after drawing shapes");
+}
+
+// reference line: every step of the major axis, minor offset rounded, with
+// clipped pixels dropped one by one
+static void ref_line(int64_t x0, int64_t y0, int64_t x1, int64_t y1, uint32_t pixel) {
+    int64_t dx = x1 - x0, dy = y1 - y0;
+    int64_t adx = dx < 0 ? -dx : dx, ady = dy < 0 ? -dy : dy;
+    int64_t steps = adx > ady ? adx : ady;
+    for (int64_t i = 0; i <= steps; i++) {
+        int64_t x, y;
+        if (adx >= ady) {
+            x = x0 + (dx < 0 ? -i : i);
+            int64_t k = steps ? (2 * i * ady + steps) / (2 * steps) : 0;
+            y = y0 + (dy < 0 ? -k : k);
+        } else {
+            y = y0 + (dy < 0 ? -i : i);
+            int64_t k = (2 * i * adx + steps) / (2 * steps);
+            x = x0 + (dx < 0 ? -k : k);
+        }
+        if (ref_visible(x, y)) ref[y][x] = pixel;
+    }
+}
+
+static int32_t random_coord(int32_t size) {
+    switch (rand() % 4) {
+    case 0: return rand() % (3 * size) - size; // near the screen
+    case 1: return rand() % 40000 - 20000; // far off screen
+    default: return rand() % size;
+    }
+}
+
+static void test_lines(const host_framebuffer_t *fb) {
+    srand(11);
+    unsigned int bad = 0;
+    for (int i = 0; i < 2000; i++) {
+        int32_t x0 = random_coord(TEST_WIDTH), y0 = random_coord(TEST_HEIGHT);
+        int32_t x1 = random_coord(TEST_WIDTH), y1 = random_coord(TEST_HEIGHT);
+        if (i % 10 == 0) y1 = y0; // horizontal
+        if (i % 10 == 1) x1 = x0; // vertical
+        color_t color = random_color();
+        graphics_draw_line(x0, y0, x1, y1, color);
+        ref_line(x0, y0, x1, y1, graphics_color_to_pixel(color));
+        if (!draw_matches()) bad++;
+    }
+    CHECK(bad == 0, "%u lines drew differently from the reference", bad);
+
+    // batched forms draw the same pixels as single lines
+    graphics_point_t points[64];
+    for (auto &pt : points) pt = {random_coord(TEST_WIDTH), random_coord(TEST_HEIGHT)};
+    uint32_t pixel = graphics_color_to_pixel(COLOR_YELLOW);
+    graphics_draw_polyline(points, 64, COLOR_YELLOW);
+    for (int i = 1; i < 64; i++) ref_line(points[i - 1].x, points[i - 1].y, points[i].x, points[i].y, pixel);
+    CHECK(draw_matches(), "polyline differs from its lines");
+    pixel = graphics_color_to_pixel(COLOR_CYAN);
+    graphics_draw_segments(points, 32, COLOR_CYAN);
+    for (int i = 0; i < 32; i++) ref_line(points[2 * i].x, points[2 * i].y, points[2 * i + 1].x, points[2 * i + 1].y, pixel);
+    CHECK(draw_matches(), "segments differ from their lines");
+
+    graphics_swap_buffers();
+    CHECK(framebuffer_matches(fb), "framebuffer out of date after drawing lines");
+}
+
+// one random primitive at a signed position around surface, drawn into
+// ref as well
+static void random_op(surface_t *surface) {
+    int32_t x = rand() % (TEST_WIDTH + 80) - 40, y = rand() % (TEST_HEIGHT + 80) - 40;
+    uint32_t a = (uint32_t) rand() % 60, b = (uint32_t) rand() % 60;
+    color_t color = random_color(), bg = random_color();
+    uint32_t pixel = graphics_color_to_pixel(color);
+
+    switch (rand() % 20) {
+    case 0:
+        surface_clear(surface, color);
+        ref_fill(0, 0, TEST_WIDTH, TEST_HEIGHT, pixel);
+        break;
+    case 1: case 2: case 3:
+        surface_fill_rect(surface, x, y, a, b, color);
+        ref_fill(x, y, a, b, pixel);
+        break;
+    case 4: case 5:
+        surface_draw_rect(surface, x, y, a, b, color);
+        if (a && b) {
+            ref_fill(x, y, a, 1, pixel);
+            ref_fill(x, y + b - 1, a, 1, pixel);
+            ref_fill(x, y, 1, b, pixel);
+            ref_fill(x + a - 1, y, 1, b, pixel);
+        }
+        break;
+    case 6: case 7: case 8: {
+        int32_t x1 = x + rand() % 400 - 200, y1 = y + rand() % 400 - 200;
+        surface_draw_line(surface, x, y, x1, y1, color);
+        ref_line(x, y, x1, y1, pixel);
+        break;
+    }
+    case 9: case 10:
+        surface_draw_string(surface, x, y, "clipped\ntext", color, bg);
+        ref_text(x, y, "clipped\ntext", pixel, graphics_color_to_pixel(bg), false);
+        break;
+    case 11: case 12:
+        surface_draw_string_transparent(surface, x, y, "see\nthrough", color);
+        ref_text(x, y, "see\nthrough", pixel, pixel, true);
+        break;
+    case 13: case 14:
+        surface_fill_circle(surface, x, y, a, color);
+        ref_rounded(x, y, x, y, a, a, pixel);
+        break;
+    case 15: case 16:
+        surface_fill_ellipse(surface, x, y, a, b, color);
+        ref_rounded(x, y, x, y, a, b, pixel);
+        break;
+    case 17: case 18: {
+        uint32_t w = a + 1, h = b + 1, r = (uint32_t) rand() % 30;
+        surface_fill_rounded_rect(surface, x, y, w, h, r, color);
+        if (r > (w - 1) / 2) r = (w - 1) / 2;
+        if (r > (h - 1) / 2) r = (h - 1) / 2;
+        ref_rounded(x + r, y + r, x + w - 1 - r, y + h - 1 - r, r, r, pixel);
+        break;
+    }
+    default:
+        surface_put_pixel(surface, x, y, color);
+        if (ref_visible(x, y)) ref[y][x] = pixel;
+        break;
+    }
+}
+
+// narrow ref_clip to a rectangle the way surface_push_clip() should
+static void ref_push_clip(int64_t x, int64_t y, int64_t w, int64_t h) {
+    graphics_rect_t *c = &ref_clip;
+    int64_t x0 = x > c->x0 ? x : c->x0, y0 = y > c->y0 ? y : c->y0;
+    int64_t x1 = x + w < c->x1 ? x + w : c->x1, y1 = y + h < c->y1 ? y + h : c->y1;
+    if (x0 >= x1 || y0 >= y1) *c = {0, 0, 0, 0};
+    else *c = {(uint32_t) x0, (uint32_t) y0, (uint32_t) x1, (uint32_t) y1};
+}
+
+static bool same_clip(const graphics_rect_t *a, const graphics_rect_t *b) {
+    bool a_empty = a->x0 >= a->x1 || a->y0 >= a->y1, b_empty = b->x0 >= b->x1 || b->y0 >= b->y1;
+    if (a_empty || b_empty) return a_empty && b_empty;
+    return a->x0 == b->x0 && a->y0 == b->y0 && a->x1 == b->x1 && a->y1 == b->y1;
+}
+
+// random nested clip rectangles with random drawing inside them
+static unsigned int draw_clipped(surface_t *surface, int rounds) {
+    unsigned int bad = 0;
+    for (int i = 0; i < rounds; i++) {
+        int depth = 1 + rand() % 3;
+        for (int d = 0; d < depth; d++) {
+            int32_t x = rand() % (TEST_WIDTH + 100) - 50, y = rand() % (TEST_HEIGHT + 100) - 50;
+            uint32_t w = (uint32_t) rand() % 400, h = (uint32_t) rand() % 300;
+            surface_push_clip(surface, x, y, w, h);
+            ref_push_clip(x, y, w, h);
+            if (!same_clip(&surface->clip, &ref_clip)) bad++;
+        }
+        for (int op = 0; op < 10; op++) random_op(surface);
+        if (!surface_matches(surface)) bad++;
+        while (surface->clip_depth) surface_pop_clip(surface);
+        ref_clip = {0, 0, TEST_WIDTH, TEST_HEIGHT};
+    }
+    return bad;
+}
+
+static void test_surfaces(const host_framebuffer_t *fb) {
+    surface_t *screen = graphics_screen();
+    srand(13);
+
+    // the graphics_* calls draw through the screen's clip too
+    CHECK(surface_push_clip(screen, 100, 50, 200, 100) == 0, "push_clip failed");
+    graphics_clear_screen(COLOR_RED);
+    graphics_draw_string(90, 45, "hello", COLOR_WHITE, COLOR_BLUE);
+    ref_clip = {100, 50, 300, 150};
+    ref_fill(0, 0, TEST_WIDTH, TEST_HEIGHT, graphics_color_to_pixel(COLOR_RED));
+    ref_text(90, 45, "hello", graphics_color_to_pixel(COLOR_WHITE), graphics_color_to_pixel(COLOR_BLUE), false);
+    ref_clip = {0, 0, TEST_WIDTH, TEST_HEIGHT};
+    surface_pop_clip(screen);
+    CHECK(draw_matches(), "drawing under a screen clip differs");
+
+    unsigned int bad = draw_clipped(screen, 300);
+    CHECK(bad == 0, "%u clipped screen draws differ from the reference", bad);
+    CHECK(screen->clip.x1 == TEST_WIDTH && screen->clip.y1 == TEST_HEIGHT, "popping did not restore the clip");
+    graphics_swap_buffers();
+    CHECK(framebuffer_matches(fb), "framebuffer out of date after clipped drawing");
+
+    // the stack is bounded, and an empty clip draws nothing
+    for (int i = 0; i < SURFACE_MAX_CLIP; i++) surface_push_clip(screen, i, i, TEST_WIDTH, TEST_HEIGHT);
+    CHECK(surface_push_clip(screen, 0, 0, 1, 1) == -1, "clip stack overflow not refused");
+    CHECK(screen->clip.x0 == SURFACE_MAX_CLIP - 1, "clip changed by a refused push");
+    while (screen->clip_depth) surface_pop_clip(screen);
+    surface_push_clip(screen, TEST_WIDTH + 5, 10, 10, 10);
+    graphics_fill_rect(0, 0, TEST_WIDTH, TEST_HEIGHT, COLOR_GREEN);
+    surface_draw_line(screen, -10, -10, TEST_WIDTH + 10, TEST_HEIGHT + 10, COLOR_GREEN);
+    surface_pop_clip(screen);
+    CHECK(draw_matches(), "drawing under an empty clip changed pixels");
+
+    // an off-screen surface with padded rows takes the same drawing and
+    // leaves the screen alone
+    static uint32_t screen_ref[TEST_HEIGHT][TEST_WIDTH];
+    memcpy(screen_ref, ref, sizeof(ref));
+    memset(ref, 0, sizeof(ref));
+    uint32_t stride = TEST_WIDTH + 24;
+    uint32_t *pixels = (uint32_t *) calloc((size_t) stride * TEST_HEIGHT, 4);
+    surface_t off;
+    surface_init(&off, pixels, TEST_WIDTH, TEST_HEIGHT, stride);
+    bad = draw_clipped(&off, 300);
+    CHECK(bad == 0, "%u clipped off-screen draws differ from the reference", bad);
+    bool padding_clean = true;
+    for (uint32_t y = 0; y < TEST_HEIGHT; y++) {
+        for (uint32_t x = TEST_WIDTH; x < stride; x++) padding_clean &= pixels[(size_t) y * stride + x] == 0;
+    }
+    CHECK(padding_clean, "drawing reached the row padding");
+    CHECK(graphics_get_context()->dirty_count == 0, "off-screen drawing marked the screen dirty");
+    free(pixels);
+    memcpy(ref, screen_ref, sizeof(ref));
+    CHECK(draw_matches(), "off-screen drawing changed the screen");
+
+    surface_t *created = surface_create(33, 17);
+    CHECK(created && created->stride == 33 && created->clip.x1 == 33 && created->clip.y1 == 17,
+          "surface_create gave a bad surface");
+    if (created) {
+        surface_fill_rect(created, -5, -5, 10, 10, COLOR_YELLOW);
+        color_t in = surface_get_pixel(created, 4, 4), out = surface_get_pixel(created, 5, 5);
+        CHECK(in.red == 0xFF && in.blue == 0 && out.red == 0, "surface_create pixels wrong");
+        surface_destroy(created);
+    }
+}
+
+// reference source-over, one channel at a time, x / 255 rounded half up;
+// bytes wrap when the source is not premultiplied, as in span_blend_pixel()
+static uint32_t ref_blend(uint32_t d, uint32_t s) {
+    uint32_t inv = 255 - (s >> 24), out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t x = ((d >> shift) & 0xFF) * inv;
+        out |= ((((s >> shift) & 0xFF) + (2 * x + 255) / 510) & 0xFF) << shift;
+    }
+    return out;
+}
+
+// per-pixel graphics_blit() into dst, reading from an untouched copy of the
+// source so overlapping blits have a plain meaning
+static void ref_blit(uint32_t *dst, size_t dst_stride, const graphics_rect_t &clip, int64_t dx, int64_t dy,
+                     const uint32_t *src, size_t src_stride, int64_t src_w, int64_t src_h, const graphics_rect_t *rect,
+                     graphics_blit_mode_t mode, uint32_t key) {
+    graphics_rect_t r = rect ? *rect : graphics_rect_t{0, 0, (uint32_t) src_w, (uint32_t) src_h};
+    for (int64_t y = r.y0; y < r.y1 && y < src_h; y++) {
+        for (int64_t x = r.x0; x < r.x1 && x < src_w; x++) {
+            int64_t tx = dx + x - r.x0, ty = dy + y - r.y0;
+            if (tx < clip.x0 || tx >= clip.x1 || ty < clip.y0 || ty >= clip.y1) continue;
+            uint32_t sp = src[y * src_stride + x], *dp = &dst[ty * dst_stride + tx];
+            if (mode == GRAPHICS_BLIT_COPY) *dp = sp;
+            else if (mode == GRAPHICS_BLIT_COLOR_KEY) *dp = sp == key ? *dp : sp;
+            else *dp = ref_blend(*dp, sp);
+        }
+    }
+}
+
+// runs of opaque, clear, translucent, keyed and non-premultiplied pixels,
+// so the fast paths and the general blend all get used
+static void random_sprite(uint32_t *pixels, size_t count, uint32_t key) {
+    for (size_t i = 0; i < count;) {
+        int kind = rand() % 5;
+        for (size_t run = 1 + rand() % 12; run && i < count; run--, i++) {
+            color_t c = random_color();
+            c.alpha = kind == 0 ? 255 : kind == 1 ? 0 : (uint8_t) rand();
+            pixels[i] = graphics_color_to_premultiplied(c);
+            if (kind == 3 && rand() % 2) pixels[i] = key;
+            if (kind == 4) pixels[i] = (uint32_t) rand() * 2654435761u;
+        }
+    }
+}
+
+#define BLIT_W 200
+#define BLIT_H 120
+#define BLIT_STRIDE (BLIT_W + 8)
+
+static const graphics_blit_mode_t blit_modes[] = {GRAPHICS_BLIT_COPY, GRAPHICS_BLIT_COLOR_KEY, GRAPHICS_BLIT_ALPHA};
+
+static graphics_rect_t random_src_rect(uint32_t w, uint32_t h) {
+    uint32_t x0 = (uint32_t) rand() % (w + 10), y0 = (uint32_t) rand() % (h + 10);
+    return {x0, y0, x0 + (uint32_t) rand() % (w + 20), y0 + (uint32_t) rand() % (h + 20)};
+}
+
+// random blits between two padded off-screen surfaces and within one, with
+// random clips, against ref_blit()
+static unsigned int blit_offscreen(void) {
+    static uint32_t dst_px[BLIT_H * BLIT_STRIDE], src_px[BLIT_H * BLIT_STRIDE];
+    static uint32_t expect[BLIT_H * BLIT_STRIDE], snapshot[BLIT_H * BLIT_STRIDE];
+    surface_t dst, src;
+    unsigned int bad = 0;
+
+    for (int i = 0; i < 600; i++) {
+        uint32_t sw = 1 + (uint32_t) rand() % BLIT_W, sh = 1 + (uint32_t) rand() % BLIT_H;
+        surface_init(&dst, dst_px, BLIT_W, BLIT_H, BLIT_STRIDE);
+        surface_init(&src, src_px, sw, sh, BLIT_STRIDE);
+        uint32_t key = graphics_color_to_premultiplied(random_color());
+        src.color_key = key;
+        random_sprite(dst_px, BLIT_H * BLIT_STRIDE, key);
+        random_sprite(src_px, BLIT_H * BLIT_STRIDE, key);
+
+        // one in four blits scrolls part of dst over itself, some of them
+        // sideways within the same rows
+        bool self = i % 4 == 0;
+        surface_t *from = self ? &dst : &src;
+        uint32_t fw = self ? BLIT_W : sw, fh = self ? BLIT_H : sh;
+        if (rand() % 2) surface_push_clip(&dst, rand() % BLIT_W - 20, rand() % BLIT_H - 20, rand() % 250, rand() % 150);
+        graphics_rect_t rect = random_src_rect(fw, fh);
+        const graphics_rect_t *r = rand() % 3 ? &rect : nullptr;
+        int32_t dx = self ? (int32_t) rect.x0 + rand() % 21 - 10 : rand() % (BLIT_W + 60) - 30;
+        int32_t dy = self ? (int32_t) rect.y0 + (i % 8 ? rand() % 21 - 10 : 0) : rand() % (BLIT_H + 60) - 30;
+        graphics_blit_mode_t mode = blit_modes[rand() % 3];
+        if (self) dst.color_key = key;
+
+        memcpy(expect, dst_px, sizeof(expect));
+        memcpy(snapshot, self ? dst_px : src_px, sizeof(snapshot));
+        ref_blit(expect, BLIT_STRIDE, dst.clip, dx, dy, snapshot, BLIT_STRIDE, fw, fh, r, mode, key);
+        graphics_blit(&dst, dx, dy, from, r, mode);
+        if (memcmp(expect, dst_px, sizeof(expect))) bad++;
+    }
+    return bad;
+}
+
+static void test_blit(const host_framebuffer_t *fb) {
+    srand(17);
+    const cpu_features_t host = g_cpu_features;
+    struct {
+        const char *name;
+        bool sse2, avx2;
+    } configs[] = {
+        {"scalar", false, false},
+        {"sse2", true, false},
+        {"avx2", true, true},
+    };
+    for (auto &config : configs) {
+        if ((config.sse2 && !host.sse2) || (config.avx2 && !host.avx2)) continue;
+        g_cpu_features = host;
+        g_cpu_features.sse2 = config.sse2;
+        g_cpu_features.avx2 = config.avx2;
+        span_init();
+        unsigned int bad = blit_offscreen();
+        CHECK(bad == 0, "%s: %u blits differ from the reference", config.name, bad);
+    }
+    g_cpu_features = host;
+    span_init();
+
+    // the premultiplied packing
+    uint32_t half = graphics_color_to_premultiplied({0xFF, 0x80, 0x00, 0x80});
+    CHECK(half == 0x80804000, "premultiplied pixel 0x%x", half);
+
+    // sprites on the screen through its clip reach VRAM at the next swap
+    surface_t *sprite = surface_create(48, 40);
+    if (!sprite) return;
+    random_sprite(sprite->pixels, 48 * 40, 0);
+    surface_t *screen = graphics_screen();
+    surface_push_clip(screen, 50, 30, 500, 400);
+    for (int i = 0; i < 100; i++) {
+        int32_t x = rand() % (TEST_WIDTH + 60) - 30, y = rand() % (TEST_HEIGHT + 60) - 30;
+        graphics_blit_mode_t mode = blit_modes[i % 3];
+        graphics_blit(screen, x, y, sprite, nullptr, mode);
+        ref_blit(&ref[0][0], TEST_WIDTH, screen->clip, x, y, sprite->pixels, 48, 48, 40, nullptr, mode, 0);
+    }
+    surface_pop_clip(screen);
+    surface_destroy(sprite);
+    CHECK(draw_matches(), "sprites drew differently from the reference");
+    graphics_swap_buffers();
+    CHECK(framebuffer_matches(fb), "framebuffer out of date after blits");
+}
+
+// with every slot taken the new rectangle is folded into the one that grows
+// least; that union can reach other rectangles, which must then be absorbed
+// too so no pixel is copied twice
+static void test_dirty_merge(const host_framebuffer_t *fb) {
+    graphics_swap_buffers();
+    graphics_mark_dirty(0, 0, 100, 100);
+    // crosses the gap under the first one and reaches far to the right
+    graphics_mark_dirty(40, 101, 560, 2);
+    for (uint32_t i = 0; i < GRAPHICS_MAX_DIRTY - 2; i++) graphics_mark_dirty(i * 10, 300, 2, 2);
+    // cheapest to fold into the first rectangle, whose union then overlaps
+    // the second
+    graphics_mark_dirty(0, 104, 100, 4);
+
+    const graphics_context_t *ctx = graphics_get_context();
+    uint32_t overlaps = 0;
+    for (uint32_t i = 0; i < ctx->dirty_count; i++) {
+        for (uint32_t j = i + 1; j < ctx->dirty_count; j++) {
+            const graphics_rect_t *a = &ctx->dirty[i], *b = &ctx->dirty[j];
+            if (a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1) overlaps++;
+        }
+    }
+    CHECK(overlaps == 0, "%u dirty rectangles overlap after folding", overlaps);
+    graphics_swap_buffers();
+    CHECK(framebuffer_matches(fb), "framebuffer out of date after folding dirty rectangles");
+}
+
+// frames that finish early are stretched to the period, late ones are not.
+// a single frame can be short when the sleep before it overshot, since the
+// pacer keeps to its schedule; only the total is checked
+static void test_pacer(void) {
+    graphics_pacer_t pacer;
+    graphics_pacer_start(&pacer, 500);
+    for (int i = 0; i < 20; i++) graphics_pacer_wait(&pacer);
+    CHECK(pacer.frames == 20, "pacer counted %lu frames", pacer.frames);
+    CHECK(pacer.total_ns >= 20 * 1900000ULL || pacer.late, "20 frames took %lu ns", pacer.total_ns);
+}
+
+// VRAM layouts graphics can drive, with how graphics_pixel_format_init()
+// should classify them
+static const struct {
+    const char *name;
+    uint32_t bpp;
+    uint8_t fields[6]; // red, green and blue, each position then size
+    surface_format_t format;
+} layouts[] = {
+    {"xrgb8888", 32, {16, 8, 8, 8, 0, 8}, SURFACE_FORMAT_XRGB8888},
+    {"xbgr8888", 32, {0, 8, 8, 8, 16, 8}, SURFACE_FORMAT_XBGR8888},
+    {"rgb565", 16, {11, 5, 5, 6, 0, 5}, SURFACE_FORMAT_RGB565},
+    {"rgb888", 24, {16, 8, 8, 8, 0, 8}, SURFACE_FORMAT_RGB888},
+    {"rgb555", 15, {10, 5, 5, 5, 0, 5}, SURFACE_FORMAT_OTHER},
+    {"bgr888", 24, {0, 8, 8, 8, 16, 8}, SURFACE_FORMAT_OTHER},
+    {"rgbx8888", 32, {24, 8, 16, 8, 8, 8}, SURFACE_FORMAT_OTHER},
+};
+
+static int layout_format(graphics_pixel_format_t *format, uint32_t bpp, const uint8_t *f) {
+    return graphics_pixel_format_init(format, bpp, f[0], f[1], f[2], f[3], f[4], f[5]);
+}
+
+// reference packer: the top bits of each channel at its position
+static uint32_t ref_pack(const graphics_pixel_format_t *format, color_t c) {
+    return (uint32_t) (c.red >> (8 - format->red_size)) << format->red_position |
+           (uint32_t) (c.green >> (8 - format->green_size)) << format->green_position |
+           (uint32_t) (c.blue >> (8 - format->blue_size)) << format->blue_position;
+}
+
+static void test_pixel_formats(void) {
+    srand(19);
+    for (auto &layout : layouts) {
+        graphics_pixel_format_t format;
+        int status = layout_format(&format, layout.bpp, layout.fields);
+        CHECK(status == 0 && format.format == layout.format && format.bytes == (layout.bpp + 7) / 8,
+              "%s: init %d, classified as %d with %u bytes", layout.name, status, format.format, format.bytes);
+        if (status) continue;
+        unsigned int bad = 0;
+        for (int i = 0; i < 1000; i++) {
+            color_t c = random_color();
+            if (graphics_pixel_format_pack(&format, c) != ref_pack(&format, c)) bad++;
+        }
+        CHECK(bad == 0, "%s: %u colors packed differently from the reference", layout.name, bad);
+    }
+
+    graphics_pixel_format_t format;
+    layout_format(&format, 16, layouts[2].fields);
+    uint32_t pixel = graphics_pixel_format_pack(&format, {0x12, 0x34, 0x56, 255});
+    CHECK(pixel == 0x11AA, "rgb565 packed 0x123456 as 0x%x", pixel);
+    CHECK(graphics_pixel_format_init(&format, 16, 12, 5, 5, 6, 0, 5) == -1, "red past bit 15 accepted");
+    CHECK(graphics_pixel_format_init(&format, 32, 16, 10, 8, 8, 0, 8) == -1, "10-bit red accepted");
+    CHECK(graphics_pixel_format_init(&format, 32, 16, 8, 8, 0, 0, 8) == -1, "missing green accepted");
+    CHECK(graphics_pixel_format_init(&format, 48, 16, 8, 8, 8, 0, 8) == -1, "48 bpp accepted");
+}
+
+// VRAM in each layout, drawn on and swapped: every VRAM pixel must be its
+// back buffer pixel converted. the odd width leaves a tail for the 24-bit
+// loop, and partial dirty rectangles start at any column
+#define VRAM_W 203
+#define VRAM_H 61
+
+static bool vram_matches(const host_framebuffer_t *fb, const graphics_pixel_format_t *format) {
+    surface_t *screen = graphics_screen();
+    for (uint32_t y = 0; y < VRAM_H; y++) {
+        const uint8_t *row = (const uint8_t *) fb->pixels + (size_t) y * fb->pitch;
+        for (uint32_t x = 0; x < VRAM_W; x++) {
+            uint32_t got = 0;
+            for (uint32_t b = 0; b < format->bytes; b++) got |= (uint32_t) row[x * format->bytes + b] << (8 * b);
+            if (got != graphics_pixel_format_pack(format, surface_get_pixel(screen, x, y))) return false;
+        }
+    }
+    return true;
+}
+
+static void test_vram_formats(void) {
+    srand(23);
+    for (auto &layout : layouts) {
+        graphics_pixel_format_t format;
+        host_framebuffer_t fb;
+        if (layout_format(&format, layout.bpp, layout.fields) != 0 ||
+            host_graphics_init_format(&fb, VRAM_W, VRAM_H, &format) != 0) {
+            CHECK(false, "%s: graphics_init_simple failed", layout.name);
+            continue;
+        }
+
+        // drawing stays 32-bit, in VRAM's order when VRAM is 32-bit
+        surface_t *screen = graphics_screen();
+        bool bgr = layout.format == SURFACE_FORMAT_XBGR8888;
+        CHECK(screen->format == (bgr ? SURFACE_FORMAT_XBGR8888 : SURFACE_FORMAT_XRGB8888), "%s: draws as %d",
+              layout.name, screen->format);
+        uint32_t pixel = graphics_color_to_pixel({0x12, 0x34, 0x56, 255});
+        CHECK(pixel == (bgr ? 0x563412u : 0x123456u), "%s: color_to_pixel gave 0x%x", layout.name, pixel);
+
+        unsigned int bad = 0;
+        for (int frame = 0; frame < 30; frame++) {
+            for (int op = 0; op < 6; op++) {
+                int32_t x = rand() % (VRAM_W + 20) - 10, y = rand() % (VRAM_H + 20) - 10;
+                switch (rand() % 3) {
+                case 0:
+                    surface_fill_rect(screen, x, y, rand() % 80, rand() % 40, random_color());
+                    break;
+                case 1:
+                    surface_draw_string(screen, x, y, "vram", random_color(), random_color());
+                    break;
+                default:
+                    surface_draw_line(screen, x, y, rand() % VRAM_W, rand() % VRAM_H, random_color());
+                    break;
+                }
+            }
+            graphics_swap_buffers();
+            if (!vram_matches(&fb, &format)) bad++;
+        }
+        CHECK(bad == 0, "%s: %u frames left VRAM different from the back buffer", layout.name, bad);
+
+        graphics_mark_dirty(0, 0, VRAM_W, VRAM_H);
+        graphics_swap_buffers();
+        uint64_t bytes = graphics_get_frame_stats()->last_vram_bytes;
+        CHECK(bytes == (uint64_t) VRAM_W * VRAM_H * format.bytes, "%s: full swap counted %lu bytes", layout.name,
+              bytes);
+        host_graphics_cleanup(&fb);
+    }
+}
+
+void test_graphics(void) {
+    host_framebuffer_t fb;
+    CHECK(host_graphics_init(&fb, TEST_WIDTH, TEST_HEIGHT) == 0, "graphics_init_simple failed");
+    graphics_context_t *ctx = graphics_get_context();
+    if (!ctx) return;
+    CHECK(ctx->backbuffer != nullptr, "no back buffer allocated");
+
+    graphics_clear_screen(COLOR_BLACK);
+    memset(ref, 0, sizeof(ref));
+    test_colors();
+    graphics_swap_buffers();
+    CHECK(framebuffer_matches(&fb), "framebuffer differs after the first swap");
+
+    test_fills(&fb);
+
+    const graphics_frame_stats_t *stats = graphics_get_frame_stats();
+    CHECK(stats->frames == 501, "%lu frames counted, want 501", stats->frames);
+    test_text(&fb);
+    test_shapes(&fb);
+    test_lines(&fb);
+    test_surfaces(&fb);
+    test_blit(&fb);
+    test_dirty_merge(&fb);
+    test_pacer();
+    host_graphics_cleanup(&fb);
+
+    test_pixel_formats();
+    test_vram_formats();
+}
@@ -0,0 +1,171 @@
+// kernel heap (src/heap.cpp): kmalloc/krealloc/kcalloc under a random
+// workload, each block stamped so overlaps and lost contents show up
+#include "test.h"
+#include "memory.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define HEAP_LIVE 2048
+
+typedef struct {
+    uint8_t *ptr;
+    size_t size;
+    uint8_t stamp;
+} block_t;
+
+static block_t live[HEAP_LIVE];
+
+static size_t random_size(void) {
+    switch (rand() % 8) {
+    case 0:
+        return 2048 + (size_t) rand() % 30000; // large, straight from the buddy allocator
+    case 1:
+    case 2:
+        return 257 + (size_t) rand() % 1792;
+    default:
+        return 1 + (size_t) rand() % 256;
+    }
+}
+
+static void stamp(block_t *b) {
+    for (size_t i = 0; i < b->size; i++) b->ptr[i] = (uint8_t) (b->stamp + i);
+}
+
+static bool stamp_intact(const block_t *b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (b->ptr[i] != (uint8_t) (b->stamp + i)) return false;
+    }
+    return true;
+}
+
+static void test_random(void) {
+    uint64_t free_before = memory_get_free_frames();
+    unsigned int n = 0;
+    unsigned int corrupt = 0;
+    unsigned int misaligned = 0;
+
+    srand(11);
+    for (int step = 0; step < 100000; step++) {
+        int op = rand() % 10;
+        if (n < HEAP_LIVE && (n == 0 || op < 5)) {
+            block_t *b = &live[n];
+            b->size = random_size();
+            b->stamp = (uint8_t) rand();
+            if (op == 0) {
+                b->ptr = (uint8_t *) kcalloc(1, b->size);
+                for (size_t i = 0; b->ptr && i < b->size; i++) {
+                    if (b->ptr[i]) {
+                        corrupt++;
+                        break;
+                    }
+                }
+            } else {
+                b->ptr = (uint8_t *) kmalloc(b->size);
+            }
+            CHECK(b->ptr != nullptr, "allocation of %zu bytes failed", b->size);
+            if (!b->ptr) continue;
+            if ((uintptr_t) b->ptr % (b->size < 16 ? 8 : 16)) misaligned++;
+            stamp(b);
+            n++;
+        } else if (op < 7) {
+            // grow or shrink, keeping the common prefix
+            block_t *b = &live[(unsigned int) rand() % n];
+            size_t new_size = random_size();
+            size_t keep = new_size < b->size ? new_size : b->size;
+            uint8_t *p = (uint8_t *) krealloc(b->ptr, new_size);
+            CHECK(p != nullptr, "krealloc to %zu bytes failed", new_size);
+            if (!p) continue;
+            b->ptr = p;
+            if (!stamp_intact(b, keep)) corrupt++;
+            b->size = new_size;
+            stamp(b);
+        } else {
+            unsigned int i = (unsigned int) rand() % n;
+            if (!stamp_intact(&live[i], live[i].size)) corrupt++;
+            kfree(live[i].ptr);
+            live[i] = live[--n];
+        }
+    }
+    CHECK(corrupt == 0, "%u blocks lost their contents", corrupt);
+    CHECK(misaligned == 0, "%u blocks misaligned", misaligned);
+
+    while (n) {
+        n--;
+        if (!stamp_intact(&live[n], live[n].size)) corrupt++;
+        kfree(live[n].ptr);
+    }
+    CHECK(corrupt == 0, "blocks corrupted at teardown");
+    kfree(nullptr);
+
+    // the kmalloc caches keep one empty slab each; nothing else stays out
+    CHECK(free_before - memory_get_free_frames() <= 8 * 4,
+          "%lu frames still held after freeing everything", free_before - memory_get_free_frames());
+}
+
+static void test_cache(void) {
+    kmem_cache_t *cache = kmem_cache_create("test-obj", 200, 128, kmem_ctor_zero);
+    CHECK(cache != nullptr, "kmem_cache_create failed");
+    if (!cache) return;
+
+    static uint8_t *objs[1000];
+    unsigned int bad = 0;
+    for (int round = 0; round < 3; round++) {
+        for (auto &obj : objs) {
+            obj = (uint8_t *) kmem_cache_alloc(cache);
+            if (!obj || (uintptr_t) obj % 128) {
+                bad++;
+                continue;
+            }
+            for (int i = 0; i < 200; i++) bad += obj[i] != 0;
+            for (int i = 0; i < 200; i++) obj[i] = (uint8_t) (i + 1);
+        }
+        // objects go back in their constructed (zeroed) state
+        for (auto &obj : objs) {
+            if (!obj) continue;
+            for (int i = 0; i < 200; i++) obj[i] = 0;
+            kmem_cache_free(cache, obj);
+        }
+    }
+    CHECK(bad == 0, "%u cache objects misaligned or not zeroed", bad);
+}
+
+// page-aligned objects keep their slab headers off-slab: every object costs
+// one frame, and frees in any order find their descriptor again
+static void test_page_cache(void) {
+    kmem_cache_t *cache = kmem_cache_create("test-page", 4096, 4096, kmem_ctor_zero);
+    CHECK(cache != nullptr, "kmem_cache_create failed for page-sized objects");
+    if (!cache) return;
+
+    static uint8_t *objs[1000];
+    uint64_t free_before = memory_get_free_frames();
+    unsigned int bad = 0;
+    for (auto &obj : objs) {
+        obj = (uint8_t *) kmem_cache_alloc(cache);
+        if (!obj || (uintptr_t) obj % 4096) {
+            bad++;
+            continue;
+        }
+        for (int i = 0; i < 4096; i += 64) bad += obj[i] != 0;
+        obj[64] = 1;
+    }
+    CHECK(bad == 0, "%u page objects misaligned or not zeroed", bad);
+    // descriptors and the lookup table come from kmalloc, a few frames at most
+    uint64_t used = free_before - memory_get_free_frames();
+    CHECK(used >= 1000 && used <= 1000 + 1000 / 16, "%lu frames for 1000 page objects", used);
+
+    // free in a scattered order so lookups cross removed entries
+    for (unsigned int i = 0; i < 1000; i++) {
+        uint8_t *obj = objs[i * 7 % 1000];
+        if (!obj) continue;
+        obj[64] = 0;
+        kmem_cache_free(cache, obj);
+    }
+    uint64_t held = free_before - memory_get_free_frames();
+    CHECK(held <= 1000 / 16, "%lu frames still held after freeing page objects", held);
+}
+
+void test_heap(void) {
+    test_random();
+    test_cache();
+    test_page_cache();
+}
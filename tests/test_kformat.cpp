@@ -0,0 +1,70 @@
+// tests for ksnprintf in src/kformat.cpp against the host's snprintf
+#include "test.h"
+#include "kformat.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// format the same arguments with both and compare text and return value
+#define CHECK_FORMAT(...)                                                                  \
+    do {                                                                                   \
+        char got[256], want[256];                                                          \
+        int got_len = ksnprintf(got, sizeof(got), __VA_ARGS__);                            \
+        int want_len = snprintf(want, sizeof(want), __VA_ARGS__);                          \
+        CHECK(got_len == want_len && strcmp(got, want) == 0, "%s: got '%s' (%d), want '%s' (%d)", \
+              #__VA_ARGS__, got, got_len, want, want_len);                                 \
+    } while (0)
+
+static void test_conversions(void) {
+    CHECK_FORMAT("plain text");
+    CHECK_FORMAT("%d %i %u", 0, -42, 4000000000u);
+    CHECK_FORMAT("%d %d", INT32_MIN, INT32_MAX);
+    CHECK_FORMAT("%x %X %o", 0xdeadbeefu, 0xabcu, 0755u);
+    CHECK_FORMAT("%c%c%%%c", 'a', 'b', 'c');
+    CHECK_FORMAT("%s|%s|", "hello", "");
+    CHECK_FORMAT("%ld %lu %lx", -1L, 18446744073709551615UL, 0x123456789abcdefUL);
+    CHECK_FORMAT("%lld %llu %llx", (long long) INT64_MIN, 1ULL << 63, 0xfedcba9876543210ULL);
+    CHECK_FORMAT("%zu %zx", (size_t) 1 << 40, (size_t) 0xffff);
+    CHECK_FORMAT("%hhu %hhd %hu %hd", 0x1ff, 0xff, 0x1ffff, 0xffff);
+}
+
+static void test_width_precision(void) {
+    CHECK_FORMAT("[%5d] [%-5d] [%05d] [%+d] [% d]", 42, 42, -42, 42, 42);
+    CHECK_FORMAT("[%016lx] [%-16lx] [%#x] [%#X] [%#o] [%#x]", 0x1234UL, 0xabUL, 255u, 255u, 8u, 0u);
+    CHECK_FORMAT("[%.3d] [%8.3d] [%-8.3d] [%.0d]", 7, -7, 7, 0);
+    CHECK_FORMAT("[%.0u] [%.0x] [%#.0o]", 0u, 0u, 0u);
+    CHECK_FORMAT("[%10s] [%-10s] [%.3s] [%8.2s]", "abc", "abc", "abcdef", "abcdef");
+    CHECK_FORMAT("[%*d] [%-*d] [%*d] [%.*s] [%.*d]", 6, 1, 6, 2, -6, 3, 2, "xyz", -1, 5);
+    CHECK_FORMAT("[%3c] [%-3c]", 'x', 'y');
+    CHECK_FORMAT("[%2u] base=0x%016lx len=0x%016lx", 3u, 0x100000UL, 0x7fee0000UL);
+}
+
+static void test_pointer_and_truncation(void) {
+    char buf[32];
+    ksnprintf(buf, sizeof(buf), "%p", (void *) 0x1234abcd);
+    CHECK(strcmp(buf, "0x1234abcd") == 0, "%%p gave '%s'", buf);
+    ksnprintf(buf, sizeof(buf), "%p", (void *) nullptr);
+    CHECK(strcmp(buf, "0x0") == 0, "%%p of nullptr gave '%s'", buf);
+
+    memset(buf, 'Z', sizeof(buf));
+    int len = ksnprintf(buf, 8, "%s-%d", "truncated", 12345);
+    CHECK(len == 15 && strcmp(buf, "truncat") == 0 && buf[8] == 'Z', "truncation gave '%s' (%d)", buf, len);
+    len = ksnprintf(nullptr, 0, "%08x", 1u);
+    CHECK(len == 8, "size 0 returned %d", len);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+    // a precision turns off zero padding
+    ksnprintf(buf, sizeof(buf), "[%08.3d]", 7);
+    CHECK(strcmp(buf, "[     007]") == 0, "%%08.3d gave '%s'", buf);
+    // unknown conversions are printed as written
+    ksnprintf(buf, sizeof(buf), "%y %5w");
+    CHECK(strcmp(buf, "%y %5w") == 0, "unknown conversion gave '%s'", buf);
+#pragma GCC diagnostic pop
+}
+
+void test_kformat(void) {
+    test_conversions();
+    test_width_precision();
+    test_pointer_and_truncation();
+}
@@ -0,0 +1,132 @@
+// tests for the klog ring in src/klog.cpp, read back through the
+// console_write() capture in host_shims.cpp
+#include "test.h"
+#include "host_shims.h"
+#include "console.h"
+#include "klog.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+// matches KLOG_SLOTS in klog.cpp
+#define RING_SLOTS 1024
+
+static void log_str(klog_level_t level, const char *s) {
+    klog_write(level, s, strlen(s));
+}
+
+// render and return what reached the console since the last call
+static const char *rendered(void) {
+    g_host_console_len = 0;
+    klog_render();
+    g_host_console[g_host_console_len < HOST_CONSOLE_SIZE ? g_host_console_len : HOST_CONSOLE_SIZE - 1] = 0;
+    return g_host_console;
+}
+
+static void test_levels(void) {
+    log_str(KLOG_INFO, "hello ");
+    log_str(KLOG_DEBUG, "hidden\n");
+    log_str(KLOG_ERR, "world\n");
+    CHECK(strcmp(rendered(), "hello world\n") == 0, "rendered '%s'", g_host_console);
+    CHECK(strcmp(rendered(), "") == 0, "second render repeated '%s'", g_host_console);
+
+    klog_set_console_level(KLOG_DEBUG);
+    log_str(KLOG_DEBUG, "shown\n");
+    CHECK(strcmp(rendered(), "shown\n") == 0, "debug level rendered '%s'", g_host_console);
+    klog_set_console_level(KLOG_INFO);
+}
+
+static void test_long_message(void) {
+    char msg[1000];
+    for (size_t i = 0; i < sizeof(msg) - 1; i++) msg[i] = (char) ('a' + i % 26);
+    msg[sizeof(msg) - 1] = 0;
+    log_str(KLOG_INFO, msg);
+    CHECK(strcmp(rendered(), msg) == 0, "long message split across slots came back different");
+}
+
+static void test_overflow(void) {
+    const unsigned count = RING_SLOTS + 300;
+    char line[32];
+    for (unsigned i = 0; i < count; i++) {
+        snprintf(line, sizeof(line), "line %u\n", i);
+        log_str(KLOG_INFO, line);
+    }
+    const char *out = rendered();
+    CHECK(strncmp(out, "[klog: 300 messages lost]\nline 300\n", 35) == 0, "overflow rendered '%.40s'", out);
+    snprintf(line, sizeof(line), "line %u\n", count - 1);
+    size_t len = strlen(out);
+    CHECK(len >= strlen(line) && strcmp(out + len - strlen(line), line) == 0, "newest line missing");
+}
+
+static void test_dump(void) {
+    log_str(KLOG_DEBUG, "dump debug\n");
+    log_str(KLOG_WARN, "dump warn\n");
+    rendered();
+
+    g_host_console_len = 0;
+    klog_dump();
+    g_host_console[g_host_console_len] = 0;
+    CHECK(strncmp(g_host_console, "---- klog dump ----\n", 20) == 0, "dump header missing");
+    CHECK(strstr(g_host_console, "] D dump debug\n") != nullptr, "debug message missing from dump");
+    CHECK(strstr(g_host_console, "] W dump warn\n") != nullptr, "warning missing from dump");
+    CHECK(strstr(g_host_console, "---- end of klog ----\n") != nullptr, "dump trailer missing");
+}
+
+// several producers at once; with fewer messages than slots none may be lost
+static void test_producers(void) {
+    const unsigned threads = 4;
+    const unsigned per_thread = 200;
+    std::thread workers[threads];
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t] = std::thread([t] {
+            char line[32];
+            for (unsigned i = 0; i < per_thread; i++) {
+                snprintf(line, sizeof(line), "t%u m%u\n", t, i);
+                log_str(KLOG_INFO, line);
+            }
+        });
+    }
+    for (unsigned t = 0; t < threads; t++) workers[t].join();
+
+    const char *out = rendered();
+    unsigned lines = 0;
+    for (const char *p = out; *p; p++) lines += *p == '\n';
+    CHECK(lines == threads * per_thread, "%u of %u lines rendered", lines, threads * per_thread);
+    char line[32];
+    for (unsigned t = 0; t < threads; t++) {
+        snprintf(line, sizeof(line), "t%u m%u\n", t, per_thread - 1);
+        CHECK(strstr(out, line) != nullptr, "thread %u lost its last line", t);
+    }
+}
+
+// a sink that logs and renders from inside the console write, as an
+// interrupt handler could in the middle of a render
+static bool nest_armed = false;
+
+static void nesting_write(const char *, size_t) {
+    if (!nest_armed) return;
+    nest_armed = false;
+    log_str(KLOG_INFO, "nested\n");
+    klog_render();
+}
+
+static void test_nested_render(void) {
+    static console_sink_t sink = {"nesting", nesting_write, nullptr, nullptr};
+    console_register_sink(&sink);
+    rendered();
+
+    log_str(KLOG_INFO, "outer\n");
+    nest_armed = true;
+    const char *out = rendered();
+    CHECK(strcmp(out, "outer\nnested\n") == 0, "nested render gave '%s'", out);
+    CHECK(strcmp(rendered(), "") == 0, "nested message rendered twice: '%s'", g_host_console);
+}
+
+void test_klog(void) {
+    test_levels();
+    test_long_message();
+    test_overflow();
+    test_dump();
+    test_producers();
+    test_nested_render();
+}
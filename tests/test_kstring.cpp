@@ -0,0 +1,146 @@
+// correctness tests for src/kstring.cpp. every variant the host CPU can run
+// is forced in turn through g_cpu_features, then checked against libc
+#include "test.h"
+#include "kstring.h"
+#include "cpu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GUARD 64
+#define GUARD_BYTE 0xA5
+
+static const size_t large_sizes[] = {1000, 2047, 2048, 2049, 4096 + 13, 65536 + 7, 300000};
+
+static uint8_t *src_buf;
+static uint8_t *dst_buf;
+static uint8_t *ref_buf;
+static size_t buf_size;
+
+static void fill_random(uint8_t *p, size_t n) {
+    for (size_t i = 0; i < n; i++) p[i] = (uint8_t) rand();
+}
+
+static bool guards_intact(const uint8_t *base, size_t off, size_t n) {
+    for (size_t i = off - GUARD; i < off; i++) {
+        if (base[i] != GUARD_BYTE) return false;
+    }
+    for (size_t i = off + n; i < off + n + GUARD; i++) {
+        if (base[i] != GUARD_BYTE) return false;
+    }
+    return true;
+}
+
+static void check_copy(size_t n, size_t s_off, size_t d_off) {
+    s_off += GUARD;
+    d_off += GUARD;
+    fill_random(src_buf + s_off, n);
+    memset(dst_buf, GUARD_BYTE, d_off + n + GUARD);
+    void *ret = kmemcpy(dst_buf + d_off, src_buf + s_off, n);
+    CHECK(ret == dst_buf + d_off, "memcpy n=%zu returned wrong pointer", n);
+    CHECK(memcmp(dst_buf + d_off, src_buf + s_off, n) == 0, "memcpy n=%zu src+%zu dst+%zu", n, s_off, d_off);
+    CHECK(guards_intact(dst_buf, d_off, n), "memcpy n=%zu dst+%zu wrote outside", n, d_off);
+}
+
+static void check_set(size_t n, size_t d_off, int c) {
+    d_off += GUARD;
+    memset(dst_buf, GUARD_BYTE, d_off + n + GUARD);
+    void *ret = kmemset(dst_buf + d_off, c, n);
+    CHECK(ret == dst_buf + d_off, "memset n=%zu returned wrong pointer", n);
+    bool ok = true;
+    for (size_t i = 0; i < n; i++) ok &= dst_buf[d_off + i] == (uint8_t) c;
+    CHECK(ok, "memset n=%zu dst+%zu c=%d", n, d_off, c);
+    CHECK(guards_intact(dst_buf, d_off, n), "memset n=%zu dst+%zu wrote outside", n, d_off);
+}
+
+// move n bytes from base+from to base+to inside one buffer
+static void check_move(size_t n, size_t from, size_t to) {
+    size_t span = (from > to ? from : to) + n + 2 * GUARD;
+    fill_random(dst_buf, span);
+    memcpy(ref_buf, dst_buf, span);
+    memmove(ref_buf + GUARD + to, ref_buf + GUARD + from, n);
+    kmemmove(dst_buf + GUARD + to, dst_buf + GUARD + from, n);
+    CHECK(memcmp(dst_buf, ref_buf, span) == 0, "memmove n=%zu from %zu to %zu", n, from, to);
+}
+
+static int sign(int v) {
+    return (v > 0) - (v < 0);
+}
+
+static void check_cmp(size_t n, size_t a_off, size_t b_off) {
+    uint8_t *a = src_buf + GUARD + a_off;
+    uint8_t *b = dst_buf + GUARD + b_off;
+    fill_random(a, n);
+    memcpy(b, a, n);
+    CHECK(kmemcmp(a, b, n) == 0, "memcmp n=%zu equal buffers", n);
+    if (!n) return;
+
+    size_t pos = (size_t) rand() % n;
+    b[pos] = (uint8_t) (a[pos] + 1 + rand() % 255);
+    CHECK(sign(kmemcmp(a, b, n)) == sign(memcmp(a, b, n)), "memcmp n=%zu diff at %zu", n, pos);
+    CHECK(sign(kmemcmp(b, a, n)) == sign(memcmp(b, a, n)), "memcmp n=%zu diff at %zu (swapped)", n, pos);
+}
+
+static void run_correctness(void) {
+    for (size_t n = 0; n <= 300; n++) {
+        for (size_t s = 0; s < 16; s++) {
+            for (size_t d = 0; d < 16; d++) check_copy(n, s, d);
+            check_set(n, s, (int) (n * 7 + s) - 128);
+        }
+        for (int delta = -40; delta <= 40; delta++) check_move(n, 64, (size_t) (64 + delta));
+        for (size_t s = 0; s < 8; s++) check_cmp(n, s, 7 - s);
+    }
+    for (size_t n : large_sizes) {
+        for (size_t off = 0; off < 64; off += 7) {
+            check_copy(n, off, (off * 3) % 64);
+            check_set(n, off, (int) off);
+            check_cmp(n, off, 63 - off);
+        }
+        static const long deltas[] = {-4097, -64, -33, -8, -1, 1, 3, 32, 65, 4097};
+        for (long delta : deltas) check_move(n, 5000, (size_t) (5000 + delta));
+    }
+}
+
+void test_kstring(void) {
+    buf_size = 8 << 20;
+    src_buf = (uint8_t *) aligned_alloc(64, buf_size);
+    dst_buf = (uint8_t *) aligned_alloc(64, buf_size);
+    ref_buf = (uint8_t *) aligned_alloc(64, buf_size);
+    srand(1);
+
+    const cpu_features_t host = g_cpu_features;
+
+    // each configuration masks the host features down to what it names
+    struct {
+        const char *name;
+        bool erms, sse2, avx2;
+    } configs[] = {
+        {"generic", false, false, false},
+        {"erms", true, false, false},
+        {"sse2", false, true, false},
+        {"avx2", false, true, true},
+    };
+
+    for (auto &config : configs) {
+        if ((config.erms && !host.erms) || (config.sse2 && !host.sse2) || (config.avx2 && !host.avx2)) {
+            printf("  %s: not supported by this CPU, skipped\n", config.name);
+            continue;
+        }
+        g_cpu_features = host;
+        g_cpu_features.erms = config.erms;
+        g_cpu_features.sse2 = config.sse2;
+        g_cpu_features.avx2 = config.avx2;
+        g_cpu_features.avx = config.avx2;
+        kstring_init();
+
+        unsigned before = g_test_failures;
+        run_correctness();
+        printf("  %s: %s\n", config.name, g_test_failures == before ? "ok" : "FAILED");
+    }
+
+    g_cpu_features = host;
+    kstring_init();
+    free(src_buf);
+    free(dst_buf);
+    free(ref_buf);
+}
@@ -0,0 +1,27 @@
+// src/math.cpp against the libm reference
+#include "test.h"
+#include "math.h"
+#include <cmath>
+
+// Bhaskara's approximation is within 0.0017 of the true value; allow one
+// more for integer truncation
+#define TRIG_TOLERANCE 3
+
+void test_math(void) {
+    for (int32_t deg = -720; deg <= 720; deg++) {
+        double rad = deg * M_PI / 180.0;
+        int32_t want_sin = (int32_t) lround(std::sin(rad) * 1000);
+        int32_t want_cos = (int32_t) lround(std::cos(rad) * 1000);
+        int32_t got_sin = math_sin(deg);
+        int32_t got_cos = math_cos(deg);
+        CHECK(math_abs(got_sin - want_sin) <= TRIG_TOLERANCE, "sin(%d) = %d, want %d", deg, got_sin, want_sin);
+        CHECK(math_abs(got_cos - want_cos) <= TRIG_TOLERANCE, "cos(%d) = %d, want %d", deg, got_cos, want_cos);
+    }
+
+    CHECK(math_abs(-5) == 5 && math_abs(5) == 5 && math_abs(0) == 0, "abs");
+    CHECK(math_min(-3, 2) == -3 && math_min(2, -3) == -3, "min");
+    CHECK(math_max(-3, 2) == 2 && math_max(2, -3) == 2, "max");
+    CHECK(math_clamp(-10, 0, 100) == 0, "clamp below");
+    CHECK(math_clamp(50, 0, 100) == 50, "clamp inside");
+    CHECK(math_clamp(500, 0, 100) == 100, "clamp above");
+}
@@ -0,0 +1,172 @@
+// physical frame allocator (src/memory.cpp) on the fake RAM from
+// host_boot_memory(): every frame handed out must be usable, unique and
+// come back on free, and buddy blocks must be aligned and disjoint. also the
+// framebuffer fields read from the Multiboot info
+#include "test.h"
+#include "host_shims.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" uint64_t __bss_end;
+
+#define TOTAL_FRAMES ((HOST_RAM_BASE + HOST_RAM_SIZE) / 4096)
+
+// frames currently held by the test, one bit each
+static uint64_t owned[TOTAL_FRAMES / 64];
+
+static bool frame_usable(uint64_t paddr) {
+    if (paddr < (uint64_t) (uintptr_t) &__bss_end + HOST_RAM_GAP_SIZE || paddr >= HOST_RAM_BASE + HOST_RAM_SIZE)
+        return false;
+    return paddr < HOST_RAM_HOLE_BASE || paddr >= HOST_RAM_HOLE_BASE + HOST_RAM_HOLE_SIZE;
+}
+
+// record 2^order frames at paddr as owned; false if any already were
+static bool take(uint64_t paddr, unsigned int order) {
+    bool ok = true;
+    for (uint64_t f = paddr / 4096; f < paddr / 4096 + (1ULL << order); f++) {
+        if (owned[f / 64] & (1ULL << (f % 64))) ok = false;
+        owned[f / 64] |= 1ULL << (f % 64);
+    }
+    return ok;
+}
+
+static void give_back(uint64_t paddr, unsigned int order) {
+    for (uint64_t f = paddr / 4096; f < paddr / 4096 + (1ULL << order); f++) owned[f / 64] &= ~(1ULL << (f % 64));
+}
+
+static void test_exhaust_single(void) {
+    uint64_t free_before = memory_get_free_frames();
+    uint64_t *frames = (uint64_t *) malloc((free_before + 1) * sizeof(uint64_t));
+    uint64_t count = 0;
+    uint64_t bad = 0;
+
+    uint64_t paddr;
+    while (count <= free_before && (paddr = frame_alloc()) != 0) {
+        if (paddr % 4096 || !frame_usable(paddr) || !take(paddr, 0)) bad++;
+        frames[count++] = paddr;
+    }
+    CHECK(count == free_before, "frame_alloc gave %lu frames, %lu were free", count, free_before);
+    CHECK(bad == 0, "%lu frames unaligned, reserved or handed out twice", bad);
+    CHECK(memory_get_free_frames() == 0, "free count %lu after exhausting", memory_get_free_frames());
+    CHECK(frames_alloc(0) == 0, "frames_alloc succeeded with no free frames");
+
+    // frames can be touched
+    *(volatile uint64_t *) phys_to_virt(frames[0]) = 0x1234;
+    *(volatile uint64_t *) phys_to_virt(frames[count - 1]) = 0x5678;
+
+    for (uint64_t i = 0; i < count; i++) {
+        frame_free(frames[i]);
+        give_back(frames[i], 0);
+    }
+    frame_free(frames[0]); // double free is ignored
+    CHECK(memory_get_free_frames() == free_before, "free count %lu after freeing all, want %lu",
+          memory_get_free_frames(), free_before);
+    free(frames);
+}
+
+static void test_buddy_blocks(void) {
+    uint64_t free_before = memory_get_free_frames();
+
+    for (unsigned int order = 0; order <= FRAME_ORDER_2M + 2; order++) {
+        uint64_t paddr = frames_alloc(order);
+        CHECK(paddr != 0, "frames_alloc(%u) failed", order);
+        if (!paddr) continue;
+        CHECK(paddr % (4096ULL << order) == 0, "order %u block 0x%lx misaligned", order, paddr);
+        CHECK(frame_usable(paddr) && frame_usable(paddr + (4096ULL << order) - 1),
+              "order %u block 0x%lx overlaps reserved memory", order, paddr);
+        frames_free(paddr, order);
+    }
+    CHECK(memory_get_free_frames() == free_before, "buddy round trip leaked frames");
+
+    // a block larger than any usable range cannot be found
+    CHECK(frames_alloc(FRAME_MAX_ORDER) == 0, "1 GiB block allocated from 512 MiB");
+}
+
+// random mix of single frames and blocks, checked for overlap
+static void test_mixed(void) {
+    struct held {
+        uint64_t paddr;
+        unsigned int order;
+    };
+    static held live[4096];
+    uint64_t free_before = memory_get_free_frames();
+    unsigned int n = 0;
+    uint64_t overlaps = 0;
+
+    srand(7);
+    for (int step = 0; step < 200000; step++) {
+        if (n < 4096 && (n == 0 || rand() % 3 != 0)) {
+            unsigned int order = rand() % 4 == 0 ? (unsigned int) (rand() % 8) : 0;
+            uint64_t paddr = order == 0 && rand() % 2 ? frame_alloc() : frames_alloc(order);
+            if (!paddr) continue;
+            if (paddr % (4096ULL << order) || !frame_usable(paddr) || !take(paddr, order)) overlaps++;
+            live[n++] = {paddr, order};
+        } else {
+            unsigned int i = (unsigned int) rand() % n;
+            give_back(live[i].paddr, live[i].order);
+            if (live[i].order == 0 && rand() % 2) {
+                frame_free(live[i].paddr);
+            } else {
+                frames_free(live[i].paddr, live[i].order);
+            }
+            live[i] = live[--n];
+        }
+    }
+    CHECK(overlaps == 0, "%lu allocations overlapped, were misaligned or reserved", overlaps);
+
+    while (n) {
+        n--;
+        give_back(live[n].paddr, live[n].order);
+        frames_free(live[n].paddr, live[n].order);
+    }
+    CHECK(memory_get_free_frames() == free_before, "free count %lu after mixed run, want %lu",
+          memory_get_free_frames(), free_before);
+
+    // freed single frames coalesce back into large blocks
+    uint64_t big = frames_alloc(FRAME_ORDER_2M + 4);
+    CHECK(big != 0, "no 32 MiB block after the mixed run");
+    if (big) frames_free(big, FRAME_ORDER_2M + 4);
+}
+
+// the allocator metadata (bitmap, two summary levels, buddy links and orders)
+// is carved out of usable RAM past the reserved gap; memory_init() faults if
+// it lands in the gap, and only the metadata frames may be missing here
+static void test_boot_reservations(void) {
+    uint64_t words = (TOTAL_FRAMES + 63) / 64;
+    uint64_t summary = (words + 63) / 64;
+    uint64_t top = (summary + 63) / 64;
+    uint64_t metadata = (words + summary + top) * 8 + TOTAL_FRAMES * 9;
+    uint64_t usable = (HOST_RAM_SIZE - HOST_RAM_GAP_SIZE - HOST_RAM_HOLE_SIZE) / 4096;
+    uint64_t want = usable - (metadata + 4095) / 4096;
+    CHECK(memory_get_free_frames() == want, "%lu frames free after boot, want %lu", memory_get_free_frames(), want);
+}
+
+// the Multiboot color info sits at byte 110 of the info structure, fields
+// unpadded in spec order
+static void test_framebuffer_channels(void) {
+    static uint8_t info[128] __attribute__((aligned(8)));
+    static const uint8_t fields[6] = {11, 5, 5, 6, 0, 5};
+    memset(info, 0xEE, sizeof(info));
+    memcpy(info + 110, fields, sizeof(fields));
+
+    uint8_t position[3], size[3];
+    framebuffer_get_channels((uint32_t) (uintptr_t) info, position, size);
+    CHECK(position[0] == 11 && size[0] == 5 && position[1] == 5 && size[1] == 6 && position[2] == 0 && size[2] == 5,
+          "channels read as R:%u@%u G:%u@%u B:%u@%u", size[0], position[0], size[1], position[1], size[2],
+          position[2]);
+}
+
+void test_memory(void) {
+    const memory_range_t *ranges;
+    uint32_t count = memory_usable_ranges(&ranges);
+    CHECK(count == 2, "%u usable ranges, want 2", count);
+    CHECK(memory_get_nframes() == TOTAL_FRAMES, "nframes %lu, want %llu", memory_get_nframes(), TOTAL_FRAMES);
+
+    test_boot_reservations();
+    memset(owned, 0, sizeof(owned));
+    test_exhaust_single();
+    test_buddy_blocks();
+    test_mixed();
+    test_framebuffer_channels();
+}
@@ -0,0 +1,97 @@
+// page table updates (src/paging.cpp) on tables in the fake RAM that are
+// never loaded: memory types must be encoded for each page size and survive
+// huge pages being split
+#include "test.h"
+#include "host_shims.h"
+#include "paging.h"
+
+#define ADDR_MASK 0x000FFFFFFFFFF000ULL
+// the PAT bit of a 4 KiB entry and of a huge one
+#define PAT_4K 0x80ULL
+#define PAT_HUGE 0x1000ULL
+#define TYPE_BITS (PAGE_WRITETHROUGH | PAGE_CACHE_DISABLE)
+
+static uint64_t *pml4;
+
+// the entry for virt in the table of the given level, 4 the PML4 and 1 a
+// page table; nullptr when the walk ends earlier
+static uint64_t *walk(uint64_t virt, int level) {
+    uint64_t *table = pml4;
+    for (int l = 4;; l--) {
+        uint64_t *entry = &table[(virt >> (3 + 9 * l)) & 0x1FF];
+        if (l == level) return entry;
+        if (!(*entry & PAGE_PRESENT) || (*entry & PAGE_HUGE)) return nullptr;
+        table = (uint64_t *) (uintptr_t) (*entry & ADDR_MASK);
+    }
+}
+
+// count the entries of the 4 KiB table holding virt, skipping index hole,
+// that do not map phys + i * 4096 write-combining
+static unsigned int bad_wc_pages(uint64_t virt, uint64_t phys, int hole) {
+    const uint64_t *pt = walk(virt, 1);
+    if (!pt) return 512;
+    unsigned int bad = 0;
+    for (int i = 0; i < 512; i++) {
+        uint64_t e = pt[i];
+        if (i == hole) {
+            if (e) bad++;
+        } else if ((e & ADDR_MASK) != phys + i * 4096ULL || !(e & PAGE_PRESENT) ||
+                   (e & (PAT_4K | TYPE_BITS)) != (PAT_4K | PAGE_WRITETHROUGH)) {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+static void test_split_2m(void) {
+    const uint64_t virt = 0x0000500000000000ULL, phys = 0xE0000000ULL;
+    CHECK(paging_map_range(virt, phys, 2 << 20, PAGE_PRESENT | PAGE_RW, PAGE_MEM_WC) == 0, "2 MiB WC map failed");
+    const uint64_t *pd_entry = walk(virt, 2);
+    uint64_t e = pd_entry ? *pd_entry : 0;
+    CHECK((e & (PAGE_HUGE | PAT_HUGE | TYPE_BITS)) == (PAGE_HUGE | PAT_HUGE | PAGE_WRITETHROUGH),
+          "2 MiB WC entry 0x%lx", e);
+
+    // unmapping one page splits the rest into 4 KiB pages of the same type
+    paging_unmap_range(virt + 4096, 4096);
+    CHECK(paging_get_physical(virt + 4096) == 0, "unmapped page still mapped");
+    CHECK(paging_get_physical(virt + 0x1234A) == phys + 0x1234A, "split page maps 0x%lx",
+          paging_get_physical(virt + 0x1234A));
+    unsigned int bad = bad_wc_pages(virt, phys, 1);
+    CHECK(bad == 0, "%u of the 4 KiB entries split from a WC 2 MiB page are wrong", bad);
+
+    // the emptied page table goes away
+    paging_unmap_range(virt, 2 << 20);
+    pd_entry = walk(virt, 2);
+    CHECK(pd_entry && *pd_entry == 0, "page directory entry left as 0x%lx", pd_entry ? *pd_entry : 0);
+}
+
+static void test_split_1g(void) {
+    const uint64_t virt = 0x0000508000000000ULL, phys = 0x100000000ULL;
+    CHECK(paging_map_range(virt, phys, 1 << 30, PAGE_PRESENT | PAGE_RW, PAGE_MEM_WC) == 0, "1 GiB WC map failed");
+
+    // a 1 GiB page splits into 2 MiB ones, then the one holding the hole
+    // into 4 KiB ones; every level keeps the WC type in its own PAT bit
+    paging_unmap_range(virt + (2 << 20) + 4096, 4096);
+    const uint64_t *pd = walk(virt, 2);
+    unsigned int bad = pd ? 0 : 512;
+    for (int i = 0; pd && i < 512; i++) {
+        if (i == 1) continue;
+        uint64_t e = pd[i];
+        if ((e & ADDR_MASK & ~PAT_HUGE) != phys + ((uint64_t) i << 21) ||
+            (e & (PAGE_HUGE | PAT_HUGE | TYPE_BITS)) != (PAGE_HUGE | PAT_HUGE | PAGE_WRITETHROUGH)) {
+            bad++;
+        }
+    }
+    CHECK(bad == 0, "%u of the 2 MiB entries split from a WC 1 GiB page are wrong", bad);
+    bad = bad_wc_pages(virt + (2 << 20), phys + (2 << 20), 1);
+    CHECK(bad == 0, "%u of the 4 KiB entries split from a WC 2 MiB page are wrong", bad);
+    CHECK(paging_get_physical(virt + (5 << 20) + 7) == phys + (5 << 20) + 7, "2 MiB page maps 0x%lx",
+          paging_get_physical(virt + (5 << 20) + 7));
+    paging_unmap_range(virt, 1 << 30);
+}
+
+void test_paging(void) {
+    pml4 = paging_init_hosted();
+    test_split_2m();
+    test_split_1g();
+}
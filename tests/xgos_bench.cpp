@@ -0,0 +1,473 @@
+// throughput of the kernel's allocators, fills, copies and formatting,
+// built for the host. prints one "name value unit" line per measurement so
+// runs can be diffed from commit to commit
+#include "host_shims.h"
+#include "console.h"
+#include "cpu.h"
+#include "fbcon.h"
+#include "graphics.h"
+#include "kformat.h"
+#include "klog.h"
+#include "kstring.h"
+#include "memory.h"
+#include "span.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MIN_NS 50000000ULL
+#define BENCH_BATCH 1024
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+
+// run op(arg) until BENCH_MIN_NS have passed; returns nanoseconds per call
+static double bench_ns(void (*op)(size_t), size_t arg) {
+    op(arg); // warm up
+    uint64_t calls = 0;
+    uint64_t start = host_now_ns();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 16; i++) op(arg);
+        calls += 16;
+        elapsed = host_now_ns() - start;
+    } while (elapsed < BENCH_MIN_NS);
+    return (double) elapsed / calls;
+}
+
+static void report(const char *name, size_t arg, double value, const char *unit) {
+    printf("%s/%zu %.2f %s\n", name, arg, value, unit);
+}
+
+// --- allocators: each op allocates and frees a batch, so the cost per
+// allocation includes the matching free ---
+
+static uint64_t frames[BENCH_BATCH];
+static void *objs[BENCH_BATCH];
+
+static void op_frame(size_t) {
+    for (auto &f : frames) f = frame_alloc();
+    for (auto f : frames) frame_free(f);
+}
+
+static void op_frames(size_t order) {
+    for (auto &f : frames) f = frames_alloc((unsigned int) order);
+    for (auto f : frames) frames_free(f, (unsigned int) order);
+}
+
+static void op_kmalloc(size_t size) {
+    for (auto &p : objs) p = kmalloc(size);
+    for (auto p : objs) kfree(p);
+}
+
+static void bench_allocators(void) {
+    report("frame_alloc", 0, bench_ns(op_frame, 0) / BENCH_BATCH, "ns/op");
+    static const size_t orders[] = {0, 2, FRAME_ORDER_2M};
+    for (size_t order : orders) {
+        report("frames_alloc", order, bench_ns(op_frames, order) / BENCH_BATCH, "ns/op");
+    }
+    static const size_t sizes[] = {16, 64, 256, 2048, 16384};
+    for (size_t size : sizes) {
+        report("kmalloc", size, bench_ns(op_kmalloc, size) / BENCH_BATCH, "ns/op");
+    }
+}
+
+// --- kstring ---
+
+static uint8_t *src_buf;
+static uint8_t *dst_buf;
+
+static void op_kmemcpy(size_t n) {
+    kmemcpy(dst_buf, src_buf, n);
+    asm volatile("" : : : "memory");
+}
+
+static void op_kmemset(size_t n) {
+    kmemset(dst_buf, (int) n, n);
+    asm volatile("" : : : "memory");
+}
+
+static void bench_kstring(void) {
+    static const size_t sizes[] = {16, 64, 256, 2048, 16384, 262144, 4194304};
+    src_buf = (uint8_t *) aligned_alloc(64, 4194304);
+    dst_buf = (uint8_t *) aligned_alloc(64, 4194304);
+    memset(src_buf, 1, 4194304);
+    for (size_t n : sizes) report("kmemcpy", n, n / bench_ns(op_kmemcpy, n), "GB/s");
+    for (size_t n : sizes) report("kmemset", n, n / bench_ns(op_kmemset, n), "GB/s");
+    free(src_buf);
+    free(dst_buf);
+}
+
+// --- formatting: typical kernel messages, per call ---
+
+static char msg_buf[256];
+
+static void op_ksnprintf(size_t which) {
+    if (which == 0) {
+        ksnprintf(msg_buf, sizeof(msg_buf), "frames total=%lu free=%lu reserved=%lu\n", 131072UL, 126976UL, 4096UL);
+    } else if (which == 1) {
+        ksnprintf(msg_buf, sizeof(msg_buf), "  [%2u] base=0x%016lx len=0x%016lx type=%u\n", 3u, 0x100000UL,
+                  0x7fee0000UL, 1u);
+    } else {
+        ksnprintf(msg_buf, sizeof(msg_buf), "%s: %-12s %8d %5.3s %p\n", "graphics", "swap", -1234, "abcdef",
+                  (void *) msg_buf);
+    }
+    asm volatile("" : : : "memory");
+}
+
+static void op_snprintf(size_t which) {
+    if (which == 0) {
+        snprintf(msg_buf, sizeof(msg_buf), "frames total=%lu free=%lu reserved=%lu\n", 131072UL, 126976UL, 4096UL);
+    } else if (which == 1) {
+        snprintf(msg_buf, sizeof(msg_buf), "  [%2u] base=0x%016lx len=0x%016lx type=%u\n", 3u, 0x100000UL,
+                 0x7fee0000UL, 1u);
+    } else {
+        snprintf(msg_buf, sizeof(msg_buf), "%s: %-12s %8d %5.3s %p\n", "graphics", "swap", -1234, "abcdef",
+                 (void *) msg_buf);
+    }
+    asm volatile("" : : : "memory");
+}
+
+// format and append to the log ring, as kprintf does at a level the
+// console does not show
+static void op_klog(size_t which) {
+    op_ksnprintf(which);
+    klog_write(KLOG_DEBUG, msg_buf, strlen(msg_buf));
+}
+
+static void bench_format(void) {
+    for (size_t which = 0; which < 3; which++) {
+        report("ksnprintf", which, 1000 / bench_ns(op_ksnprintf, which), "Mmsg/s");
+        report("snprintf", which, 1000 / bench_ns(op_snprintf, which), "Mmsg/s");
+        report("klog", which, 1000 / bench_ns(op_klog, which), "Mmsg/s");
+    }
+}
+
+// --- graphics: square fills of side n, and full-frame clear and swap ---
+
+static void op_fill_rect(size_t n) {
+    static uint32_t pos = 0;
+    pos = (pos + 97) % (BENCH_HEIGHT - n + 1);
+    graphics_fill_rect(pos, pos, (uint32_t) n, (uint32_t) n, COLOR_BLUE);
+}
+
+static void op_clear(size_t) {
+    graphics_clear_screen(COLOR_RED);
+}
+
+// the whole frame changed: copy every row to the framebuffer
+static void op_swap_full(size_t) {
+    graphics_mark_dirty(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+    graphics_swap_buffers();
+}
+
+// n single pixels of one color, converted on every call or once up front
+static void op_put_pixel(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        graphics_put_pixel((uint32_t) (i * 7) % BENCH_WIDTH, (uint32_t) i % BENCH_HEIGHT, COLOR_CYAN);
+    }
+}
+
+static void op_put_packed(size_t n) {
+    uint32_t pixel = graphics_color_to_pixel(COLOR_CYAN);
+    for (size_t i = 0; i < n; i++) {
+        graphics_put_packed((uint32_t) (i * 7) % BENCH_WIDTH, (uint32_t) i % BENCH_HEIGHT, pixel);
+    }
+}
+
+// n characters of text per call: the old per-pixel renderer (mask per bit,
+// graphics_put_pixel() for each pixel) against the batched one
+
+static const char bench_text[] = "The quick brown fox jumps over the lazy dog 0123456789 !@#$%^&*() "
+                                 "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG";
+
+static void op_text_put_pixel(size_t n) {
+    static uint32_t y = 0;
+    y = (y + 8) % (BENCH_HEIGHT - 8);
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *glyph = graphics_glyph(bench_text[i % (sizeof(bench_text) - 1)]);
+        for (uint32_t row = 0; row < 8; row++) {
+            for (uint32_t col = 0; col < 8; col++) {
+                graphics_put_pixel((uint32_t) i * 8 + col, y + row,
+                                   (glyph[row] >> col) & 1 ? COLOR_WHITE : COLOR_BLACK);
+            }
+        }
+    }
+}
+
+static char text_line[241];
+
+static void op_draw_string(size_t n) {
+    static uint32_t y = 0;
+    y = (y + 8) % (BENCH_HEIGHT - 8);
+    text_line[n] = 0;
+    graphics_draw_string(0, y, text_line, COLOR_WHITE, COLOR_BLACK);
+    text_line[n] = bench_text[n % (sizeof(bench_text) - 1)];
+}
+
+static void op_draw_string_transparent(size_t n) {
+    static uint32_t y = 0;
+    y = (y + 8) % (BENCH_HEIGHT - 8);
+    text_line[n] = 0;
+    graphics_draw_string_transparent(0, y, text_line, COLOR_WHITE);
+    text_line[n] = bench_text[n % (sizeof(bench_text) - 1)];
+}
+
+static void bench_text_render(void) {
+    for (size_t i = 0; i < sizeof(text_line) - 1; i++) text_line[i] = bench_text[i % (sizeof(bench_text) - 1)];
+    static const size_t lengths[] = {16, 240};
+    for (size_t n : lengths) {
+        report("text_put_pixel", n, n / bench_ns(op_text_put_pixel, n) * 1000, "Mchar/s");
+        report("draw_string", n, n / bench_ns(op_draw_string, n) * 1000, "Mchar/s");
+        report("draw_string_transparent", n, n / bench_ns(op_draw_string_transparent, n) * 1000, "Mchar/s");
+    }
+}
+
+// --- filled shapes of radius r per call; the old circle tested every pixel
+// of the bounding box and plotted each hit ---
+
+static uint32_t shape_x(size_t r) {
+    static uint32_t pos = 0;
+    pos = (pos + 97) % (BENCH_HEIGHT - 2 * (uint32_t) r);
+    return pos + (uint32_t) r;
+}
+
+static void op_circle_bbox(size_t r) {
+    uint32_t c = shape_x(r);
+    int radius = (int) r;
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            if (x * x + y * y <= radius * radius) graphics_put_pixel(c + x, c + y, COLOR_GREEN);
+        }
+    }
+}
+
+static void op_fill_circle(size_t r) {
+    uint32_t c = shape_x(r);
+    graphics_fill_circle(c, c, (uint32_t) r, COLOR_GREEN);
+}
+
+static void op_fill_ellipse(size_t r) {
+    uint32_t c = shape_x(r);
+    graphics_fill_ellipse(c, c, (uint32_t) r, (uint32_t) r / 2, COLOR_GREEN);
+}
+
+static void op_fill_rounded_rect(size_t r) {
+    uint32_t c = shape_x(r);
+    graphics_fill_rounded_rect(c - (uint32_t) r, c - (uint32_t) r, 2 * (uint32_t) r + 1, 2 * (uint32_t) r + 1,
+                               (uint32_t) r / 4, COLOR_GREEN);
+}
+
+static void bench_shapes(void) {
+    static const size_t radii[] = {8, 64, 256};
+    for (size_t r : radii) {
+        report("fill_circle_bbox", r, 1e6 / bench_ns(op_circle_bbox, r), "kshape/s");
+        report("fill_circle", r, 1e6 / bench_ns(op_fill_circle, r), "kshape/s");
+        report("fill_ellipse", r, 1e6 / bench_ns(op_fill_ellipse, r), "kshape/s");
+        report("fill_rounded_rect", r, 1e6 / bench_ns(op_fill_rounded_rect, r), "kshape/s");
+    }
+}
+
+// --- lines: n pixels long and on screen, or reaching n pixels past both
+// screen edges; the old line stepped through put_pixel ---
+
+static void op_line_put_pixel(size_t n) {
+    static int y = 0;
+    y = (y + 7) % (BENCH_HEIGHT - (int) n / 2);
+    int x0 = 0, y0 = y, x1 = (int) n - 1, y1 = y + (int) n / 2;
+    int dx = x1 - x0, dy = y1 - y0, err = dx - dy;
+    while (1) {
+        graphics_put_pixel((uint32_t) x0, (uint32_t) y0, COLOR_WHITE);
+        if (x0 == x1 && y0 == y1) break;
+        int e2 = 2 * err;
+        if (e2 > -dy) {
+            err -= dy;
+            x0++;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y0++;
+        }
+    }
+}
+
+static void op_draw_line(size_t n) {
+    static int32_t y = 0;
+    y = (y + 7) % (BENCH_HEIGHT - (int32_t) n / 2);
+    graphics_draw_line(0, y, (int32_t) n - 1, y + (int32_t) n / 2, COLOR_WHITE);
+}
+
+static void op_draw_line_offscreen(size_t n) {
+    static int32_t y = 0;
+    y = (y + 7) % BENCH_HEIGHT;
+    graphics_draw_line(-(int32_t) n, y - 300, BENCH_WIDTH + (int32_t) n, y + 300, COLOR_WHITE);
+}
+
+// a wireframe of n short segments per call
+static graphics_point_t wire[2 * 4096];
+
+static void op_draw_segments(size_t n) {
+    graphics_draw_segments(wire, n, COLOR_WHITE);
+}
+
+static void bench_lines(void) {
+    static const size_t lengths[] = {16, 256, 1024};
+    for (size_t n : lengths) {
+        report("line_put_pixel", n, 1e6 / bench_ns(op_line_put_pixel, n), "klines/s");
+        report("draw_line", n, 1e6 / bench_ns(op_draw_line, n), "klines/s");
+    }
+    report("draw_line_offscreen", 100000, 1e6 / bench_ns(op_draw_line_offscreen, 100000), "klines/s");
+
+    for (size_t i = 0; i < 4096; i++) {
+        int32_t x = rand() % (BENCH_WIDTH - 40) + 20, y = rand() % (BENCH_HEIGHT - 40) + 20;
+        wire[2 * i] = {x, y};
+        wire[2 * i + 1] = {x + rand() % 41 - 20, y + rand() % 41 - 20};
+    }
+    report("draw_segments", 4096, 4096e6 / bench_ns(op_draw_segments, 4096), "klines/s");
+}
+
+// --- blits: an n x n part of a sprite onto the back buffer per mode, with
+// the keyed and blended modes once per row loop the CPU has, and scrolling
+// the whole frame up by one text line in place ---
+
+static surface_t *blit_sprite;
+static graphics_blit_mode_t blit_mode;
+
+static void op_blit(size_t n) {
+    static uint32_t pos = 0;
+    pos = (pos + 97) % (BENCH_HEIGHT - n + 1);
+    graphics_rect_t part = {0, 0, (uint32_t) n, (uint32_t) n};
+    graphics_blit(graphics_screen(), (int32_t) pos, (int32_t) pos, blit_sprite, &part, blit_mode);
+}
+
+static void op_scroll(size_t) {
+    graphics_rect_t below = {0, 8, BENCH_WIDTH, BENCH_HEIGHT};
+    graphics_blit(graphics_screen(), 0, 0, graphics_screen(), &below, GRAPHICS_BLIT_COPY);
+}
+
+static void bench_blit(void) {
+    blit_sprite = surface_create(256, 256);
+    if (!blit_sprite) return;
+    // an alpha ramp across the sprite, so most blended pixels take the
+    // general path, and every fourth 4-pixel run keyed out
+    for (uint32_t y = 0; y < 256; y++) {
+        for (uint32_t x = 0; x < 256; x++) {
+            color_t c = {(uint8_t) x, (uint8_t) y, (uint8_t) (x ^ y), (uint8_t) x};
+            blit_sprite->pixels[y * 256 + x] = x % 16 < 4 ? 0 : graphics_color_to_premultiplied(c);
+        }
+    }
+
+    const cpu_features_t host = g_cpu_features;
+    static const size_t sides[] = {16, 64, 256};
+    for (size_t n : sides) {
+        blit_mode = GRAPHICS_BLIT_COPY;
+        report("blit_copy", n, n * n / bench_ns(op_blit, n) * 1000, "Mpix/s");
+
+        struct {
+            const char *key_name, *alpha_name;
+            bool sse2, avx2;
+        } loops[] = {
+            {"blit_key_scalar", "blit_alpha_scalar", false, false},
+            {"blit_key_sse2", "blit_alpha_sse2", true, false},
+            {"blit_key_avx2", "blit_alpha_avx2", true, true},
+        };
+        for (auto &loop : loops) {
+            if ((loop.sse2 && !host.sse2) || (loop.avx2 && !host.avx2)) continue;
+            g_cpu_features.sse2 = loop.sse2;
+            g_cpu_features.avx2 = loop.avx2;
+            span_init();
+            blit_mode = GRAPHICS_BLIT_COLOR_KEY;
+            report(loop.key_name, n, n * n / bench_ns(op_blit, n) * 1000, "Mpix/s");
+            blit_mode = GRAPHICS_BLIT_ALPHA;
+            report(loop.alpha_name, n, n * n / bench_ns(op_blit, n) * 1000, "Mpix/s");
+        }
+        g_cpu_features = host;
+        span_init();
+    }
+    const double scrolled = (double) BENCH_WIDTH * (BENCH_HEIGHT - 8);
+    report("blit_scroll", BENCH_WIDTH, scrolled / bench_ns(op_scroll, 0) * 1000, "Mpix/s");
+    surface_destroy(blit_sprite);
+}
+
+// one log line of n characters on the framebuffer console; every line
+// scrolls once the screen is full
+static void op_fbcon_line(size_t n) {
+    static char line[256];
+    if (!line[0]) {
+        for (size_t i = 0; i < sizeof(line); i++) line[i] = (char) ('!' + i % 90);
+    }
+    line[n - 1] = '\n';
+    console_write(line, n);
+    line[n - 1] = (char) ('!' + (n - 1) % 90);
+    g_host_console_len = 0;
+}
+
+// --- full-frame swaps to VRAM in layouts the back buffer is converted to ---
+
+static void bench_vram_formats(void) {
+    static const struct {
+        const char *name;
+        uint32_t bpp;
+        uint8_t fields[6];
+    } layouts[] = {
+        {"swap_rgb565", 16, {11, 5, 5, 6, 0, 5}},
+        {"swap_rgb888", 24, {16, 8, 8, 8, 0, 8}},
+        {"swap_rgb555", 15, {10, 5, 5, 5, 0, 5}},
+    };
+    const double frame_pixels = (double) BENCH_WIDTH * BENCH_HEIGHT;
+    for (auto &layout : layouts) {
+        graphics_pixel_format_t format;
+        host_framebuffer_t fb;
+        const uint8_t *f = layout.fields;
+        if (graphics_pixel_format_init(&format, layout.bpp, f[0], f[1], f[2], f[3], f[4], f[5]) != 0 ||
+            host_graphics_init_format(&fb, BENCH_WIDTH, BENCH_HEIGHT, &format) != 0) {
+            fprintf(stderr, "xgos_bench: graphics init failed for %s\n", layout.name);
+            exit(1);
+        }
+        graphics_clear_screen(COLOR_MAGENTA);
+        report(layout.name, BENCH_WIDTH, frame_pixels / bench_ns(op_swap_full, 0) * 1000, "Mpix/s");
+        host_graphics_cleanup(&fb);
+    }
+}
+
+static void bench_graphics(void) {
+    host_framebuffer_t fb;
+    if (host_graphics_init(&fb, BENCH_WIDTH, BENCH_HEIGHT) != 0) {
+        fprintf(stderr, "xgos_bench: graphics init failed\n");
+        exit(1);
+    }
+
+    static const size_t sides[] = {16, 64, 256, 1024};
+    for (size_t n : sides) report("fill_rect", n, n * n / bench_ns(op_fill_rect, n) * 1000, "Mpix/s");
+    const double frame_pixels = (double) BENCH_WIDTH * BENCH_HEIGHT;
+    report("clear_screen", BENCH_WIDTH, frame_pixels / bench_ns(op_clear, 0) * 1000, "Mpix/s");
+    report("swap_full", BENCH_WIDTH, frame_pixels / bench_ns(op_swap_full, 0) * 1000, "Mpix/s");
+    report("put_pixel", 4096, 4096 / bench_ns(op_put_pixel, 4096) * 1000, "Mpix/s");
+    report("put_packed", 4096, 4096 / bench_ns(op_put_packed, 4096) * 1000, "Mpix/s");
+    bench_text_render();
+    bench_shapes();
+    bench_lines();
+    bench_blit();
+
+    if (fbcon_init() == 0) {
+        static const size_t lengths[] = {40, 80, 200};
+        for (size_t n : lengths) report("fbcon_line", n, 1e6 / bench_ns(op_fbcon_line, n), "klines/s");
+        fbcon_release();
+    }
+
+    host_graphics_cleanup(&fb);
+    bench_vram_formats();
+}
+
+int main(int argc, char **argv) {
+    g_host_quiet = !(argc > 1 && strcmp(argv[1], "-v") == 0);
+    host_detect_cpu();
+    host_boot_memory();
+    kstring_init();
+
+    bench_allocators();
+    bench_kstring();
+    bench_format();
+    bench_graphics();
+    return 0;
+}
@@ -0,0 +1,40 @@
+// unit tests for the kernel's hardware-independent modules, built for the
+// host. exits non-zero if any check fails
+#include "test.h"
+#include "host_shims.h"
+#include <string.h>
+
+unsigned g_test_failures = 0;
+
+static void run(const char *name, void (*group)(void)) {
+    printf("%s:\n", name);
+    fflush(stdout);
+    unsigned before = g_test_failures;
+    group();
+    printf("%s: %s\n", name, g_test_failures == before ? "ok" : "FAILED");
+}
+
+int main(int argc, char **argv) {
+    // -v shows the kernel's own kprintf output
+    g_host_quiet = !(argc > 1 && strcmp(argv[1], "-v") == 0);
+    host_detect_cpu();
+
+    run("kstring", test_kstring);
+    run("klog", test_klog);
+    run("kformat", test_kformat);
+    run("math", test_math);
+
+    host_boot_memory();
+    run("memory", test_memory);
+    run("heap", test_heap);
+    run("paging", test_paging);
+    run("graphics", test_graphics);
+    run("fbcon", test_fbcon);
+
+    if (g_test_failures) {
+        printf("%u checks failed\n", g_test_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}